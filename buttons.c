@@ -1,6 +1,7 @@
 /* Interrupt routine for tick count and handling the buttons */
 
 #include "buttons.h"
+#include "events.h"
 #include "BIOS.h"
 #include <stm32f10x.h>
 
@@ -41,7 +42,10 @@ void __irq__ TIM3_IRQHandler(void)
     
     // Only record keypresses the first time the key goes down
     if (keys && TICKCOUNT - KEYS_LAST_DOWN > DEBOUNCE)
+    {
         KEYS_PRESSED |= keys;
+        post_event(EVENT_KEYS);
+    }
     
     if (keys) KEYS_LAST_DOWN = TICKCOUNT;
     if (!keys) KEYS_LAST_UP = TICKCOUNT;
@@ -56,9 +60,15 @@ void __irq__ TIM3_IRQHandler(void)
     if (time_down > REPEAT_DELAY && (keys & REPEAT_KEYS))
     {
         if ((time_down - REPEAT_DELAY) % REPEAT_PERIOD == 0)
+        {
             KEYS_PRESSED |= (keys & REPEAT_KEYS);
+            post_event(EVENT_KEYS);
+        }
     }
     
+    if (TICKCOUNT % 1000 == 0)
+        post_event(EVENT_TIMER);
+    
     TimerTick();
 }
 
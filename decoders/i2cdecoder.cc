@@ -0,0 +1,381 @@
+#include "i2cdecoder.hh"
+#include <stdio.h>
+
+void I2cEvent::to_string(char *buf, size_t size) const
+{
+    switch (type)
+    {
+        case I2C_START: snprintf(buf, size, "S"); break;
+        case I2C_REPEATED_START: snprintf(buf, size, "Sr"); break;
+        case I2C_STOP: snprintf(buf, size, "P"); break;
+        case I2C_ACK: snprintf(buf, size, "A"); break;
+        case I2C_NACK: snprintf(buf, size, "N"); break;
+        case I2C_ADDRESS:
+            snprintf(buf, size, "%02X%c", data >> 1, (data & 1) ? 'R' : 'W');
+            break;
+        case I2C_DATA: snprintf(buf, size, "%02X", data); break;
+    }
+}
+
+I2cDecoder::I2cDecoder(const SignalStream &stream, const i2c_config_t &config):
+    stream(stream, (1 << config.scl_channel) | (1 << config.sda_channel)),
+    config(config), scl_mask(1 << config.scl_channel),
+    sda_mask(1 << config.sda_channel), state(), resume(false)
+{
+    restart(0);
+}
+
+// Start decoding with an idle bus, so that a START or STOP at the given
+// time is decoded.
+void I2cDecoder::restart(signaltime_t time)
+{
+    state = state_t();
+    state.bus = BUS_IDLE;
+    state.levels = scl_mask | sda_mask;
+    resume = false;
+
+    SignalEvent event;
+    stream.seek(time > 0 ? time - 1 : 0);
+    if (stream.read_forwards(event))
+    {
+        state.position = event.start;
+        state.levels = event.levels;
+    }
+    else
+    {
+        resume = true;
+    }
+}
+
+void I2cDecoder::push(i2c_event_type_t type, signaltime_t start, signaltime_t end,
+                      uint8_t data)
+{
+    I2cEvent &event = state.queue[state.queued++];
+    event.type = type;
+    event.start = start;
+    event.end = end;
+    event.data = data;
+}
+
+void I2cDecoder::condition(bool start, signaltime_t time)
+{
+    bool visible = (state.bus == BUS_DATA) ||
+                   (state.bus == BUS_ADDRESS && config.address < 0);
+
+    if (state.bus == BUS_DATA && state.bits == 9)
+        push(state.ack ? I2C_ACK : I2C_NACK, state.ack_start, time);
+
+    if (start)
+    {
+        state.repeated = (state.bus != BUS_IDLE);
+        state.bus = BUS_ADDRESS;
+        state.start_time = time;
+    }
+    else
+    {
+        if (visible)
+        {
+            if (state.bus == BUS_ADDRESS)
+            {
+                push(state.repeated ? I2C_REPEATED_START : I2C_START,
+                     state.start_time, state.start_time);
+            }
+
+            push(I2C_STOP, time, time);
+        }
+
+        state.bus = BUS_IDLE;
+    }
+
+    state.bits = 0;
+    state.data = 0;
+}
+
+void I2cDecoder::clock_rising(bool sda, signaltime_t time)
+{
+    if (state.bus != BUS_ADDRESS && state.bus != BUS_DATA)
+        return;
+
+    if (state.bits < 8)
+    {
+        if (state.bits == 0)
+            state.byte_start = time;
+
+        state.data = (state.data << 1) | (sda ? 1 : 0);
+        state.bits++;
+    }
+    else if (state.bits == 8)
+    {
+        state.ack = !sda;
+        state.ack_start = time;
+        state.bits = 9;
+
+        if (state.bus == BUS_ADDRESS)
+        {
+            if (config.address >= 0 && (state.data >> 1) != config.address)
+            {
+                state.bus = BUS_SKIP;
+                return;
+            }
+
+            push(state.repeated ? I2C_REPEATED_START : I2C_START,
+                 state.start_time, state.start_time);
+            push(I2C_ADDRESS, state.byte_start, time, state.data);
+            state.bus = BUS_DATA;
+        }
+        else
+        {
+            push(I2C_DATA, state.byte_start, time, state.data);
+        }
+    }
+}
+
+void I2cDecoder::clock_falling(signaltime_t time)
+{
+    if (state.bus == BUS_DATA && state.bits == 9)
+    {
+        push(state.ack ? I2C_ACK : I2C_NACK, state.ack_start, time);
+        state.bits = 0;
+        state.data = 0;
+    }
+}
+
+void I2cDecoder::process(const SignalEvent &event)
+{
+    signals_t old_levels = state.levels;
+    signals_t levels = event.levels;
+    state.position = event.start;
+    state.levels = levels;
+
+    if (levels & SIGNALS_LOST)
+    {
+        state.bus = BUS_IDLE;
+        state.bits = 0;
+        return;
+    }
+
+    if (old_levels & SIGNALS_LOST)
+        return;
+
+    signals_t changed = old_levels ^ levels;
+    if (changed & scl_mask)
+    {
+        if (levels & scl_mask)
+            clock_rising(levels & sda_mask, event.start);
+        else
+            clock_falling(event.start);
+    }
+    else if ((changed & sda_mask) && (levels & scl_mask))
+    {
+        condition(!(levels & sda_mask), event.start);
+    }
+}
+
+bool I2cDecoder::read_forwards(I2cEvent &result)
+{
+    SignalEvent event;
+
+    for (;;)
+    {
+        if (state.queue_pos < state.queued)
+        {
+            result = state.queue[state.queue_pos++];
+            return true;
+        }
+
+        state.queued = state.queue_pos = 0;
+
+        if (resume)
+        {
+            // The latest event is read again, but it has the levels we
+            // already have, so it doesn't decode to anything.
+            stream.seek(state.position);
+            resume = false;
+        }
+
+        if (!stream.read_forwards(event))
+        {
+            resume = true;
+            return false;
+        }
+
+        process(event);
+    }
+}
+
+static bool is_condition(const SignalEvent &before, const SignalEvent &after,
+                         signals_t scl_mask, signals_t sda_mask)
+{
+    if ((before.levels | after.levels) & SIGNALS_LOST)
+        return true; // The bus is idle after lost data, like after STOP
+
+    return (before.levels & scl_mask) && (after.levels & scl_mask) &&
+           ((before.levels ^ after.levels) & sda_mask);
+}
+
+void I2cDecoder::sync(signaltime_t time)
+{
+    SignalEvent before, after;
+
+    // Find the event containing time, or the last one
+    stream.seek(time);
+    stream.read_forwards(after);
+    bool have_after = stream.read_backwards(after);
+
+    while (have_after && stream.read_backwards(before))
+    {
+        if (after.start <= time && is_condition(before, after, scl_mask, sda_mask))
+        {
+            restart(after.start);
+            return;
+        }
+
+        after = before;
+    }
+
+    restart(0);
+}
+
+void I2cDecoder::seek(signaltime_t time)
+{
+    sync(time);
+
+    // Skip the events that end before time
+    for (;;)
+    {
+        state_t previous = state;
+
+        I2cEvent event;
+        if (!read_forwards(event) || event.end > time)
+        {
+            state = previous;
+            resume = true;
+            return;
+        }
+    }
+}
+
+I2cDecoder* I2cDecoder::clone() const
+{
+    return new I2cDecoder(*this);
+}
+
+void I2cTransaction::to_string(char *buf, size_t size) const
+{
+    int pos = snprintf(buf, size, "%02X%c:", address, read ? 'R' : 'W');
+
+    for (int i = 0; i < length && i < max_data; i++)
+    {
+        if (pos + 4 > (int)size)
+            break;
+
+        pos += snprintf(buf + pos, size - pos, " %02X", data[i]);
+    }
+
+    if (length > max_data && pos + 4 <= (int)size)
+        pos += snprintf(buf + pos, size - pos, "...");
+
+    if (nack && pos + 3 <= (int)size)
+        snprintf(buf + pos, size - pos, " N");
+}
+
+I2cTransactionStream::I2cTransactionStream(const I2cDecoder &decoder):
+    decoder(decoder.clone()), current(), started(false), have_address(false)
+{
+}
+
+I2cTransactionStream::I2cTransactionStream(const I2cTransactionStream &other):
+    TypedEventStream<I2cTransaction>(), decoder(other.decoder->clone()), current(other.current),
+    started(other.started), have_address(other.have_address)
+{
+}
+
+bool I2cTransactionStream::read_forwards(I2cTransaction &result)
+{
+    I2cEvent event;
+
+    while (decoder->read_forwards(event))
+    {
+        switch (event.type)
+        {
+            case I2C_START:
+            case I2C_REPEATED_START:
+            {
+                bool done = started && have_address;
+                if (done)
+                {
+                    result = current;
+                    result.end = event.start;
+                }
+
+                current = I2cTransaction();
+                current.start = event.start;
+                started = true;
+                have_address = false;
+
+                if (done)
+                    return true;
+                break;
+            }
+
+            case I2C_ADDRESS:
+                current.address = event.data >> 1;
+                current.read = event.data & 1;
+                have_address = true;
+                break;
+
+            case I2C_DATA:
+                if (current.length < I2cTransaction::max_data)
+                    current.data[current.length] = event.data;
+                current.length++;
+                break;
+
+            case I2C_ACK:
+                break;
+
+            case I2C_NACK:
+                // The master ends a read with NACK, that is not an error
+                if (!current.read || current.length == 0)
+                    current.nack = true;
+                break;
+
+            case I2C_STOP:
+                if (started && have_address)
+                {
+                    result = current;
+                    result.end = event.end;
+                    started = false;
+                    have_address = false;
+                    return true;
+                }
+                started = false;
+                break;
+        }
+    }
+
+    return false;
+}
+
+void I2cTransactionStream::seek(signaltime_t time)
+{
+    decoder->sync(time);
+    started = false;
+    have_address = false;
+
+    I2cTransaction transaction;
+    while (read_forwards(transaction))
+    {
+        if (transaction.end > time)
+        {
+            decoder->sync(transaction.start);
+            started = false;
+            have_address = false;
+            return;
+        }
+    }
+}
+
+I2cTransactionStream* I2cTransactionStream::clone() const
+{
+    return new I2cTransactionStream(*this);
+}
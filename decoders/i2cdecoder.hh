@@ -0,0 +1,162 @@
+/* Decoder for I2C buses.
+ *
+ * I2cDecoder produces the bus conditions and bytes: START (or repeated
+ * START), the address byte, data bytes, the ACK or NACK after each byte
+ * and STOP. The bits are sampled on the rising edges of SCL, and SDA
+ * changing while SCL is high is a START or STOP.
+ *
+ * The address filter drops whole transactions to other devices. The START
+ * is held back until the address byte is known, and after a non-matching
+ * address the decoder only looks for the next START or STOP, so the bytes
+ * of the skipped transaction are never built.
+ *
+ * Decoding is incremental: when the stream runs out, the decoder remembers
+ * its state, and the next read continues from the latest transition once
+ * more data has been captured. Seeking finds the latest START or STOP
+ * before the time and decodes from there.
+ *
+ * I2cTransactionStream groups the events into one event per transaction,
+ * from the START to the STOP or repeated START.
+ */
+
+#pragma once
+
+#include "signalstream.hh"
+#include "projectedsignalstream.hh"
+
+struct i2c_config_t
+{
+    uint8_t scl_channel; // 0 = ch A etc.
+    uint8_t sda_channel;
+    int16_t address; // 7-bit address to decode, or -1 for all
+};
+
+enum i2c_event_type_t
+{
+    I2C_START = 0,
+    I2C_REPEATED_START = 1,
+    I2C_STOP = 2,
+    I2C_ADDRESS = 3,
+    I2C_DATA = 4,
+    I2C_ACK = 5,
+    I2C_NACK = 6
+};
+
+struct I2cEvent: public Event
+{
+    i2c_event_type_t type;
+    uint8_t data; // For I2C_ADDRESS, the address and the R/W bit
+
+    // Formats as S, Sr, P, A, N, the address as e.g. "50W" and data as hex.
+    virtual void to_string(char *buf, size_t size) const;
+};
+
+static_assert(sizeof(I2cEvent) <= EventPool::block_size,
+              "I2cEvent must fit in an EventPool block");
+
+class I2cDecoder: public TypedEventStream<I2cEvent>
+{
+public:
+    I2cDecoder(const SignalStream &stream, const i2c_config_t &config);
+    virtual ~I2cDecoder() {};
+
+    // After seek(), the next event read is the first one that ends after
+    // the given time.
+    virtual void seek(signaltime_t time);
+
+    // Continue decoding from the latest START or STOP at or before the
+    // given time.
+    void sync(signaltime_t time);
+
+    // Decode the next event. Returns false when the data ends; calling
+    // again later continues from where the decoding stopped.
+    virtual bool read_forwards(I2cEvent &result);
+
+    virtual I2cDecoder* clone() const;
+
+private:
+    enum bus_state_t
+    {
+        BUS_IDLE, // Waiting for START
+        BUS_ADDRESS, // Receiving the address byte
+        BUS_DATA, // Receiving data bytes
+        BUS_SKIP // Waiting for START or STOP after a filtered address
+    };
+
+    // Everything needed to continue decoding from the position.
+    struct state_t
+    {
+        signaltime_t position; // Start of the latest event processed
+        signals_t levels; // SCL and SDA at the position
+        bus_state_t bus;
+        bool repeated; // The START was a repeated START
+        signaltime_t start_time; // Time of the START being held back
+        signaltime_t byte_start; // First rising edge of SCL of the byte
+        uint8_t bits; // Bits received, 9 when SCL is high for the ACK bit
+        uint8_t data;
+        signaltime_t ack_start; // Rising edge of SCL of the ACK bit
+        bool ack;
+
+        // Events decoded but not returned yet
+        I2cEvent queue[3];
+        uint8_t queued, queue_pos;
+    };
+
+    ProjectedSignalStream stream;
+    i2c_config_t config;
+    signals_t scl_mask, sda_mask;
+    state_t state;
+    bool resume; // Seek the stream back to state.position before reading
+
+    void restart(signaltime_t time);
+    void push(i2c_event_type_t type, signaltime_t start, signaltime_t end,
+              uint8_t data = 0);
+    void process(const SignalEvent &event);
+    void condition(bool start, signaltime_t time);
+    void clock_rising(bool sda, signaltime_t time);
+    void clock_falling(signaltime_t time);
+};
+
+struct I2cTransaction: public Event
+{
+    static const int max_data = 16;
+
+    uint8_t address; // 7-bit address
+    bool read;
+    bool nack; // The address or a byte written was not acknowledged
+    uint16_t length; // Number of data bytes, even if more than max_data
+    uint8_t data[max_data];
+
+    // Formats as e.g. "50W: 01 02 03", with "..." if the data didn't fit.
+    virtual void to_string(char *buf, size_t size) const;
+};
+
+static_assert(sizeof(I2cTransaction) <= EventPool::block_size,
+              "I2cTransaction must fit in an EventPool block");
+
+class I2cTransactionStream: public TypedEventStream<I2cTransaction>
+{
+public:
+    I2cTransactionStream(const I2cDecoder &decoder);
+    I2cTransactionStream(const I2cTransactionStream &other);
+    virtual ~I2cTransactionStream() {};
+
+    // After seek(), the next transaction read is the first one that ends
+    // after the given time.
+    virtual void seek(signaltime_t time);
+
+    // Read the next complete transaction. Returns false when the data
+    // ends; calling again later continues the transaction in progress.
+    virtual bool read_forwards(I2cTransaction &result);
+
+    virtual I2cTransactionStream* clone() const;
+
+private:
+    std::unique_ptr<I2cDecoder> decoder;
+
+    I2cTransaction current;
+    bool started; // current has been started by a START
+    bool have_address;
+
+    I2cTransactionStream &operator=(const I2cTransactionStream &other);
+};
@@ -0,0 +1,361 @@
+#include "i2cdecoder.hh"
+#include "dsosignalstream.hh"
+#include "varint.hh"
+#include "unittests.h"
+#include <vector>
+#include <time.h>
+
+// Builds an I2C signal tick by tick. Channel A is SCL and B is SDA, and
+// channel C can have an unrelated clock on it.
+class I2cBuilder
+{
+public:
+    I2cBuilder(int half_period): half_period(half_period), scl(1), sda(1),
+        noise_period(0) {}
+
+    void hold(int ticks)
+    {
+        for (int i = 0; i < ticks; i++)
+        {
+            signals_t c = noise_period ? ((ticks_.size() / noise_period) & 1) : 0;
+            ticks_.push_back(scl | (sda << 1) | (c << 2));
+        }
+    }
+
+    void start()
+    {
+        if (!scl)
+        {
+            // Repeated start
+            sda = 1;
+            hold(half_period);
+            scl = 1;
+            hold(half_period);
+        }
+
+        sda = 0;
+        hold(half_period);
+        scl = 0;
+    }
+
+    void bit(bool value)
+    {
+        sda = value;
+        hold(half_period);
+        scl = 1;
+        hold(half_period);
+        scl = 0;
+    }
+
+    void byte(uint8_t data, bool ack = true)
+    {
+        for (int i = 7; i >= 0; i--)
+            bit((data >> i) & 1);
+        bit(!ack);
+    }
+
+    void stop()
+    {
+        sda = 0;
+        hold(half_period);
+        scl = 1;
+        hold(half_period);
+        sda = 1;
+        hold(half_period);
+    }
+
+    // Write the given bytes to a register
+    void write(uint8_t address, uint8_t reg, uint8_t value)
+    {
+        start();
+        byte(address << 1);
+        byte(reg);
+        byte(value);
+        stop();
+    }
+
+    // Encode to the buffer, and store the byte offset after each record.
+    void to_buffer(signal_buffer_t &buffer, std::vector<size_t> *offsets = NULL)
+    {
+        buffer.bytes = 0;
+        size_t i = 0;
+        while (i < ticks_.size())
+        {
+            size_t j = i;
+            while (j < ticks_.size() && ticks_[j] == ticks_[i])
+                j++;
+
+            uint64_t value = ((uint64_t)(j - i) << 4) | ticks_[i];
+            buffer.bytes += varint_encode(buffer.storage + buffer.bytes, value);
+            if (offsets)
+                offsets->push_back((size_t)buffer.bytes);
+            i = j;
+        }
+        buffer.last_duration = 0;
+        buffer.last_value = 0;
+    }
+
+    int half_period;
+    signals_t scl, sda;
+    int noise_period; // Ticks between the edges on channel C, 0 for none
+    std::vector<uint8_t> ticks_;
+};
+
+static i2c_config_t make_config(int address = -1)
+{
+    i2c_config_t config = {0, 1, (int16_t)address};
+    return config;
+}
+
+static bool same_event(const I2cEvent &a, const I2cEvent &b)
+{
+    return a.type == b.type && a.start == b.start && a.end == b.end && a.data == b.data;
+}
+
+static std::vector<I2cEvent> read_all(I2cDecoder &decoder)
+{
+    std::vector<I2cEvent> result;
+    I2cEvent event;
+    while (decoder.read_forwards(event))
+        result.push_back(event);
+    return result;
+}
+
+// Three devices talking on the same bus
+static void build_busy_bus(I2cBuilder &builder, int transactions)
+{
+    builder.hold(20);
+    for (int i = 0; i < transactions; i++)
+    {
+        uint8_t address = (i % 3 == 0) ? 0x50 : (i % 3 == 1) ? 0x1D : 0x68;
+        builder.write(address, i & 0xFF, (i * 7) & 0xFF);
+        builder.hold(15);
+    }
+}
+
+static signal_buffer_t buffer;
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test a write and a read with a repeated start");
+        I2cBuilder builder(5);
+        builder.hold(20);
+        builder.write(0x50, 0x01, 0x02);
+        builder.hold(20);
+        builder.start();
+        builder.byte(0x50 << 1);
+        builder.byte(0x10);
+        builder.start();
+        builder.byte((0x50 << 1) | 1);
+        builder.byte(0xAB);
+        builder.byte(0xCD, false);
+        builder.stop();
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        I2cDecoder decoder(stream, make_config());
+        std::vector<I2cEvent> all = read_all(decoder);
+
+        const char *expected[] = {"S", "50W", "A", "01", "A", "02", "A", "P",
+                                  "S", "50W", "A", "10", "A",
+                                  "Sr", "50R", "A", "AB", "A", "CD", "N", "P"};
+        bool all_ok = (all.size() == sizeof(expected) / sizeof(expected[0]));
+        for (size_t i = 0; all_ok && i < all.size(); i++)
+        {
+            char buf[8];
+            all[i].to_string(buf, sizeof(buf));
+            all_ok = strcmp(buf, expected[i]) == 0;
+        }
+        TEST(all_ok);
+
+        TEST(all[0].type == I2C_START && all[0].start == 20 && all[0].end == 20);
+        TEST(all[1].type == I2C_ADDRESS && all[1].start == 30 && all[1].end == 110);
+        TEST(all[2].type == I2C_ACK && all[2].start == 110 && all[2].end == 115);
+        TEST(all[7].type == I2C_STOP && all[7].start == 305);
+
+        COMMENT("Test grouping to transactions");
+        I2cTransactionStream transactions(decoder);
+        transactions.seek(0);
+        I2cTransaction transaction;
+        TEST(transactions.read_forwards(transaction) && transaction.address == 0x50 &&
+             !transaction.read && transaction.length == 2 && !transaction.nack &&
+             transaction.start == 20 && transaction.end == 305);
+
+        char buf[32];
+        transaction.to_string(buf, sizeof(buf));
+        TEST(strcmp(buf, "50W: 01 02") == 0);
+
+        TEST(transactions.read_forwards(transaction) && transaction.length == 1 &&
+             transaction.data[0] == 0x10 && transaction.end == all[13].start);
+        TEST(transactions.read_forwards(transaction) && transaction.read &&
+             transaction.length == 2 && transaction.data[1] == 0xCD && !transaction.nack);
+        TEST(!transactions.read_forwards(transaction));
+
+        std::unique_ptr<I2cTransaction> allocated;
+        transactions.seek(0);
+        allocated.reset(transactions.read());
+        TEST(allocated && allocated->data[0] == 0x01);
+    }
+
+    {
+        COMMENT("Test the address filter");
+        I2cBuilder builder(5);
+        builder.noise_period = 3;
+        build_busy_bus(builder, 30);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        I2cDecoder all_decoder(stream, make_config());
+        I2cDecoder filtered_decoder(stream, make_config(0x1D));
+        std::vector<I2cEvent> all = read_all(all_decoder);
+        std::vector<I2cEvent> filtered = read_all(filtered_decoder);
+        TEST(all.size() == 30 * 8);
+        TEST(filtered.size() == 10 * 8);
+
+        // The filtered events are the transactions 1, 4, 7...
+        bool all_ok = true;
+        for (size_t i = 0; i < filtered.size(); i++)
+        {
+            size_t transaction = (i / 8) * 3 + 1;
+            all_ok = all_ok && same_event(filtered[i], all[transaction * 8 + i % 8]);
+        }
+        TEST(all_ok);
+
+        I2cTransactionStream transactions(filtered_decoder);
+        transactions.seek(0);
+        I2cTransaction transaction;
+        int count = 0;
+        all_ok = true;
+        while (transactions.read_forwards(transaction))
+        {
+            int i = count * 3 + 1;
+            all_ok = all_ok && transaction.address == 0x1D && transaction.length == 2 &&
+                     transaction.data[0] == i && transaction.data[1] == ((i * 7) & 0xFF);
+            count++;
+        }
+        TEST(all_ok && count == 10);
+
+        COMMENT("Test seeking");
+        all_ok = true;
+        signaltime_t last = all.back().end;
+        for (signaltime_t time = 0; time <= last; time += 13)
+        {
+            size_t expected = 0;
+            while (all[expected].end <= time)
+                expected++;
+
+            I2cEvent event;
+            all_decoder.seek(time);
+            all_ok = all_ok && all_decoder.read_forwards(event) &&
+                     same_event(event, all[expected]);
+
+            if (expected + 1 < all.size())
+            {
+                all_ok = all_ok && all_decoder.read_forwards(event) &&
+                         same_event(event, all[expected + 1]);
+            }
+
+            expected = 0;
+            while (expected < filtered.size() && filtered[expected].end <= time)
+                expected++;
+
+            filtered_decoder.seek(time);
+            if (expected < filtered.size())
+            {
+                all_ok = all_ok && filtered_decoder.read_forwards(event) &&
+                         same_event(event, filtered[expected]);
+            }
+            else
+            {
+                all_ok = all_ok && !filtered_decoder.read_forwards(event);
+            }
+
+            transactions.seek(time);
+            if (transactions.read_forwards(transaction))
+            {
+                all_ok = all_ok && transaction.end > time &&
+                         transaction.end - transaction.start < 300 &&
+                         transaction.data[0] % 3 == 1;
+            }
+        }
+        TEST(all_ok);
+    }
+
+    {
+        COMMENT("Test incremental decoding");
+        I2cBuilder builder(4);
+        builder.noise_period = 7;
+        build_busy_bus(builder, 12);
+        std::vector<size_t> offsets;
+        builder.to_buffer(buffer, &offsets);
+        size_t total_bytes = buffer.bytes;
+
+        DSOSignalStream stream(&buffer);
+        I2cDecoder reference(stream, make_config());
+        std::vector<I2cEvent> all = read_all(reference);
+
+        // Capture one record at a time, with the next one in progress
+        buffer.bytes = 0;
+        I2cDecoder decoder(stream, make_config());
+        I2cTransactionStream transactions(decoder);
+        std::vector<I2cEvent> received;
+        int transaction_count = 0;
+        for (size_t i = 0; i < offsets.size(); i++)
+        {
+            buffer.bytes = (i == 0) ? 0 : offsets[i - 1];
+            uint64_t value;
+            varint_decode_forwards(buffer.storage, buffer.bytes, value);
+            buffer.last_value = value & 0x0F;
+            buffer.last_duration = (value >> 4) / 2;
+
+            I2cEvent event;
+            while (decoder.read_forwards(event))
+                received.push_back(event);
+
+            I2cTransaction transaction;
+            while (transactions.read_forwards(transaction))
+                transaction_count++;
+        }
+
+        buffer.bytes = total_bytes;
+        buffer.last_duration = 0;
+        I2cEvent event;
+        while (decoder.read_forwards(event))
+            received.push_back(event);
+
+        bool all_ok = (received.size() == all.size());
+        for (size_t i = 0; all_ok && i < all.size(); i++)
+            all_ok = same_event(received[i], all[i]);
+        TEST(all_ok);
+        TEST(transaction_count == 12);
+    }
+
+    {
+        COMMENT("Test decoding speed");
+        I2cBuilder builder(2);
+        build_busy_bus(builder, 150); // Fits in the buffer
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        for (int address = -1; address <= 0x50; address += 0x51)
+        {
+            I2cDecoder decoder(stream, make_config(address));
+            I2cEvent event;
+
+            clock_t start = clock();
+            int count = 0;
+            while (decoder.read_forwards(event))
+                count++;
+            clock_t end = clock();
+
+            TEST(count == ((address < 0) ? 150 * 8 : 50 * 8));
+            printf("Decoded %d events from %d bytes in %ld ms\n",
+                   count, (int)buffer.bytes, (long)((end - start) * 1000 / CLOCKS_PER_SEC));
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,175 @@
+#include "modbusdecoder.hh"
+#include <stdio.h>
+
+void ModbusEvent::to_string(char *buf, size_t size) const
+{
+    int pos = snprintf(buf, size, "%02X:%02X", address, function);
+    if (pos >= (int)size)
+        return;
+
+    // Show as many data bytes as fit, leaving room for the '!'
+    int reserve = crc_ok ? 0 : 1;
+    const char *separator = " ";
+    for (int i = 0; i < length && i < max_data; i++)
+    {
+        if (pos + (int)strlen(separator) + 2 + reserve >= (int)size)
+            break;
+
+        pos += snprintf(buf + pos, size - pos, "%s%02X", separator, data[i]);
+        separator = "";
+    }
+
+    if (!crc_ok)
+        snprintf(buf + pos, size - pos, "!");
+}
+
+ModbusDecoder::ModbusDecoder(const TypedEventStream<UartEvent> &source):
+    source(source.clone()), next(), have_next(false)
+{
+    restart(0);
+}
+
+ModbusDecoder::ModbusDecoder(const ModbusDecoder &other):
+    TypedEventStream<ModbusEvent>(), source(other.source->clone()),
+    next(other.next), have_next(other.have_next)
+{
+}
+
+// The silent interval is measured from the length of the previous
+// character, so the baudrate doesn't have to be configured.
+bool ModbusDecoder::is_gap(const UartEvent &previous, const UartEvent &next)
+{
+    signaltime_t char_ticks = previous.end - previous.start;
+    return 2 * (next.start - previous.end) >= 7 * char_ticks;
+}
+
+void ModbusDecoder::restart(signaltime_t time)
+{
+    source->seek(time);
+    have_next = false;
+}
+
+bool ModbusDecoder::read_forwards(ModbusEvent &result)
+{
+    if (!have_next && !(have_next = source->read_forwards(next)))
+        return false;
+
+    UartEvent previous;
+    uint16_t crc = 0xFFFF;
+    int count = 0;
+    bool char_error = false;
+
+    result.start = next.start;
+    result.address = 0;
+    result.function = 0;
+
+    for (;;)
+    {
+        uint8_t byte = next.data;
+        char_error = char_error || next.parity_error || next.framing_error;
+
+        if (count == 0)
+            result.address = byte;
+        else if (count == 1)
+            result.function = byte;
+        else if (count - 2 < ModbusEvent::max_data)
+            result.data[count - 2] = byte;
+
+        crc ^= byte;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+
+        count++;
+        previous = next;
+
+        if (!(have_next = source->read_forwards(next)))
+        {
+            // A frame at the end of the data is complete only if the CRC
+            // matches, otherwise try it again when there is more data.
+            if (crc == 0 && count >= 4)
+                break;
+
+            restart(result.start);
+            return false;
+        }
+
+        if (is_gap(previous, next) || count == max_frame)
+            break;
+    }
+
+    result.end = previous.end;
+    result.crc_ok = (crc == 0 && count >= 4 && !char_error);
+
+    if (count >= 4)
+        result.length = count - 4;
+    else
+        result.length = (count > 2) ? count - 2 : 0;
+
+    return true;
+}
+
+// Find the start of a frame at or before the given time.
+signaltime_t ModbusDecoder::find_sync_point(signaltime_t time)
+{
+    UartEvent event;
+    source->seek(time);
+    if (!source->read_forwards(event))
+        return time; // No characters to measure the interval with
+
+    signaltime_t char_ticks = event.end - event.start;
+    if (char_ticks < 1)
+        char_ticks = 1;
+
+    for (int chars = resync_chars; ; chars *= 2)
+    {
+        signaltime_t from = time - chars * char_ticks;
+        if (from < 0)
+            from = 0;
+
+        // The start of the data is a frame boundary, and so is the first
+        // character after each silent interval.
+        signaltime_t sync = (from == 0) ? 0 : -1;
+        UartEvent previous;
+        bool have_previous = false;
+        source->seek(from);
+        while (source->read_forwards(event) && event.start <= time)
+        {
+            if (have_previous && is_gap(previous, event))
+                sync = event.start;
+
+            previous = event;
+            have_previous = true;
+        }
+
+        if (sync >= 0)
+            return sync;
+
+        // No silent intervals, the line is probably not Modbus.
+        if (from == 0 || chars > 2 * max_frame)
+            return from;
+    }
+}
+
+void ModbusDecoder::seek(signaltime_t time)
+{
+    restart(find_sync_point(time));
+
+    // Skip the frames that end before time
+    for (;;)
+    {
+        ModbusEvent frame;
+        if (!read_forwards(frame))
+            return;
+
+        if (frame.end > time)
+        {
+            restart(frame.start);
+            return;
+        }
+    }
+}
+
+ModbusDecoder* ModbusDecoder::clone() const
+{
+    return new ModbusDecoder(*this);
+}
@@ -0,0 +1,82 @@
+/* Decoder for Modbus RTU frames, stacked on top of a UART decoder.
+ *
+ * Reads the characters from another decoder instead of a SignalStream, so
+ * the source can be a UartDecoder directly, or a CachedEventStream of one
+ * when the same characters are needed by several layers. The characters
+ * are pulled from the source only as far as needed for the frames being
+ * read, so seeking to the visible range decodes only that range in every
+ * layer.
+ *
+ * A frame ends at a silent interval of at least 3.5 characters, measured
+ * with the length of the previous character. The CRC is computed as the
+ * bytes come in, so the frame doesn't have to be stored.
+ *
+ * If the data ends in the middle of a frame, it is returned only if the
+ * CRC matches. Otherwise the decoder returns false and tries again from
+ * the start of the frame on the next read, as more data may have been
+ * captured meanwhile.
+ */
+
+#pragma once
+
+#include "eventstream.hh"
+#include "uartdecoder.hh"
+
+struct ModbusEvent: public Event
+{
+    static const int max_data = 8;
+
+    uint8_t address;
+    uint8_t function; // Bit 7 is set in exception responses
+    uint8_t length; // Bytes between the function code and the CRC
+    uint8_t data[max_data]; // The first bytes of them
+    bool crc_ok; // False also if the frame is too short or a character
+                 // had a framing or parity error
+
+    bool is_exception() const { return function & 0x80; }
+
+    // Formats as hex "AA:FF DDDD", with a '!' appended if the CRC is wrong
+    virtual void to_string(char *buf, size_t size) const;
+};
+
+static_assert(sizeof(ModbusEvent) <= EventPool::block_size,
+              "ModbusEvent must fit in an EventPool block");
+
+class ModbusDecoder: public TypedEventStream<ModbusEvent>
+{
+public:
+    // The constructor clones the source.
+    ModbusDecoder(const TypedEventStream<UartEvent> &source);
+    ModbusDecoder(const ModbusDecoder &other);
+    virtual ~ModbusDecoder() {};
+
+    // After seek(), the next frame read is the first one that ends after
+    // the given time.
+    virtual void seek(signaltime_t time);
+
+    // Decode the next frame. Returns false at the end of the data.
+    virtual bool read_forwards(ModbusEvent &result);
+
+    virtual ModbusDecoder* clone() const;
+
+    // Longest frame allowed by the standard. Longer runs of characters
+    // without a silent interval are split.
+    static const int max_frame = 256;
+
+    // Number of characters to look back for a silent interval when
+    // seeking, doubled until one is found.
+    static const int resync_chars = 16;
+
+private:
+    std::unique_ptr<TypedEventStream<UartEvent> > source;
+
+    // The character after the previous frame, if already read.
+    UartEvent next;
+    bool have_next;
+
+    static bool is_gap(const UartEvent &previous, const UartEvent &next);
+    void restart(signaltime_t time);
+    signaltime_t find_sync_point(signaltime_t time);
+
+    ModbusDecoder &operator=(const ModbusDecoder &other);
+};
@@ -0,0 +1,282 @@
+#include "modbusdecoder.hh"
+#include "cachedeventstream.hh"
+#include "dsosignalstream.hh"
+#include "varint.hh"
+#include "unittests.h"
+#include <vector>
+
+// Builds a Modbus RTU signal, 8N1 with 100 ticks per bit on channel A.
+class ModbusBuilder
+{
+public:
+    void level(bool high, int ticks)
+    {
+        ticks_.insert(ticks_.end(), ticks, high ? 1 : 0);
+    }
+
+    void idle(int chars)
+    {
+        level(true, chars * 1000);
+    }
+
+    void send(uint8_t data)
+    {
+        level(false, 100);
+        for (int i = 0; i < 8; i++)
+            level((data >> i) & 1, 100);
+        level(true, 100);
+    }
+
+    // Send the bytes followed by their CRC, low byte first. Set the CRC
+    // wrong if bad_crc is set.
+    void frame(const std::vector<uint8_t> &bytes, bool bad_crc = false)
+    {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < bytes.size(); i++)
+        {
+            send(bytes[i]);
+            crc ^= bytes[i];
+            for (int j = 0; j < 8; j++)
+                crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+        }
+
+        if (bad_crc)
+            crc ^= 0x0100;
+
+        send(crc & 0xFF);
+        send(crc >> 8);
+    }
+
+    void to_buffer(signal_buffer_t &buffer)
+    {
+        buffer.bytes = 0;
+        size_t i = 0;
+        while (i < ticks_.size())
+        {
+            size_t j = i;
+            while (j < ticks_.size() && ticks_[j] == ticks_[i])
+                j++;
+
+            uint64_t value = ((uint64_t)(j - i) << 4) | ticks_[i];
+            buffer.bytes += varint_encode(buffer.storage + buffer.bytes, value);
+            i = j;
+        }
+        buffer.last_duration = 0;
+        buffer.last_value = 0;
+    }
+
+    std::vector<uint8_t> ticks_;
+};
+
+// Passes the characters through and counts them.
+class CountingStream: public TypedEventStream<UartEvent>
+{
+public:
+    CountingStream(const TypedEventStream<UartEvent> &source, int *reads):
+        source(source.clone()), reads(reads) {}
+
+    CountingStream(const CountingStream &other):
+        TypedEventStream<UartEvent>(), source(other.source->clone()),
+        reads(other.reads) {}
+
+    virtual void seek(signaltime_t time)
+    {
+        source->seek(time);
+    }
+
+    virtual bool read_forwards(UartEvent &result)
+    {
+        (*reads)++;
+        return source->read_forwards(result);
+    }
+
+    virtual CountingStream* clone() const
+    {
+        return new CountingStream(*this);
+    }
+
+private:
+    std::unique_ptr<TypedEventStream<UartEvent> > source;
+    int *reads;
+};
+
+static const uart_config_t config = {1000000, 10000, 8, UART_PARITY_NONE, 1, 0};
+
+static std::vector<uint8_t> make_bytes(int count, int seed)
+{
+    std::vector<uint8_t> bytes;
+    for (int i = 0; i < count; i++)
+        bytes.push_back((seed * 31 + i * 7) & 0xFF);
+    return bytes;
+}
+
+static signal_buffer_t buffer;
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test request, response and exception frames");
+        ModbusBuilder builder;
+        builder.idle(2);
+        builder.frame({0x01, 0x03, 0x00, 0x6B, 0x00, 0x03});
+        builder.idle(4);
+        builder.frame({0x01, 0x03, 0x06, 0x02, 0x2B, 0x00, 0x00, 0x00, 0x64,
+                       0x11, 0x22});
+        builder.idle(4);
+        builder.frame({0x01, 0x83, 0x02}, true);
+        builder.idle(4);
+        builder.frame({0x02, 0x01, 0x00, 0x00, 0x00, 0x08});
+        builder.idle(2);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder uart(stream, config);
+        ModbusDecoder decoder(uart);
+        ModbusEvent event;
+
+        TEST(decoder.read_forwards(event) && event.address == 0x01 &&
+             event.function == 0x03 && event.length == 4 && event.crc_ok &&
+             event.data[1] == 0x6B && event.start == 2000 && event.end == 10000);
+        char buf[12];
+        event.to_string(buf, sizeof(buf));
+        TEST(strcmp(buf, "01:03 006B") == 0);
+
+        TEST(decoder.read_forwards(event) && event.length == 9 && event.crc_ok &&
+             event.data[7] == 0x11 && event.start == 14000 && event.end == 27000);
+
+        TEST(decoder.read_forwards(event) && event.is_exception() && !event.crc_ok &&
+             event.length == 1 && event.data[0] == 0x02);
+        event.to_string(buf, sizeof(buf));
+        TEST(strcmp(buf, "01:83 02!") == 0);
+
+        TEST(decoder.read_forwards(event) && event.address == 0x02 && event.crc_ok);
+        TEST(!decoder.read_forwards(event));
+
+        std::unique_ptr<ModbusEvent> allocated;
+        decoder.seek(12000);
+        allocated.reset(decoder.read());
+        TEST(allocated && allocated->start == 14000);
+    }
+
+    {
+        COMMENT("Test characters too close together to be separate frames");
+        ModbusBuilder builder;
+        builder.idle(2);
+        builder.frame({0x05, 0x06, 0x00, 0x01});
+        builder.idle(3);
+        builder.frame({0x05, 0x06, 0x00, 0x02});
+        builder.idle(4);
+        builder.frame({0x05, 0x06, 0x00, 0x03});
+        builder.idle(2);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder uart(stream, config);
+        ModbusDecoder decoder(uart);
+        ModbusEvent event;
+
+        TEST(decoder.read_forwards(event) && event.length == 8 && !event.crc_ok);
+        TEST(decoder.read_forwards(event) && event.length == 2 && event.crc_ok);
+        TEST(!decoder.read_forwards(event));
+    }
+
+    {
+        COMMENT("Test seeking through a cache of the characters");
+        ModbusBuilder builder;
+        builder.idle(1);
+        for (int i = 0; i < 60; i++)
+        {
+            builder.frame(make_bytes(2 + i % 7, i), i % 10 == 4);
+            builder.idle(4 + i % 3);
+        }
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder uart(stream, config);
+        CachedEventStream<UartEvent> cache(uart, 128, 16);
+        ModbusDecoder decoder(cache);
+
+        std::vector<ModbusEvent> all;
+        ModbusEvent event;
+        while (decoder.read_forwards(event))
+            all.push_back(event);
+        TEST(all.size() == 60);
+
+        bool all_ok = true;
+        for (size_t i = 0; i < all.size(); i++)
+        {
+            all_ok = all_ok && all[i].crc_ok == (i % 10 != 4) &&
+                     all[i].length == i % 7 && all[i].address == ((i * 31) & 0xFF);
+        }
+        TEST(all_ok);
+
+        all_ok = true;
+        signaltime_t last = all.back().end;
+        for (signaltime_t time = 0; time < last; time += 3571)
+        {
+            size_t expected = 0;
+            while (all[expected].end <= time)
+                expected++;
+
+            decoder.seek(time);
+            all_ok = all_ok && decoder.read_forwards(event) &&
+                     event.start == all[expected].start &&
+                     event.function == all[expected].function;
+        }
+        TEST(all_ok);
+
+        decoder.seek(last);
+        TEST(!decoder.read_forwards(event));
+    }
+
+    {
+        COMMENT("Test that only the characters near the seek are decoded");
+        ModbusBuilder builder;
+        builder.idle(1);
+        for (int i = 0; i < 100; i++)
+        {
+            builder.frame(make_bytes(6, i));
+            builder.idle(4);
+        }
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder uart(stream, config);
+        int reads = 0;
+        CountingStream counter(uart, &reads);
+        ModbusDecoder decoder(counter);
+        ModbusEvent event;
+
+        decoder.seek(50 * 12000 + 5000);
+        TEST(decoder.read_forwards(event) && event.start == 50 * 12000 + 1000 &&
+             event.crc_ok);
+        TEST(reads > 0 && reads < 60);
+    }
+
+    {
+        COMMENT("Test data ending in the middle of a frame");
+        ModbusBuilder builder;
+        builder.idle(2);
+        builder.frame({0x10, 0x10, 0x00, 0x01, 0x00, 0x01, 0x02, 0x12, 0x34});
+        ModbusBuilder partial = builder;
+        partial.ticks_.resize(2000 + 6 * 1000);
+        partial.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder uart(stream, config);
+        ModbusDecoder decoder(uart);
+        ModbusEvent event;
+
+        TEST(!decoder.read_forwards(event));
+        TEST(!decoder.read_forwards(event));
+
+        builder.to_buffer(buffer);
+        TEST(decoder.read_forwards(event) && event.function == 0x10 &&
+             event.length == 7 && event.crc_ok && event.start == 2000);
+        TEST(!decoder.read_forwards(event));
+    }
+
+    return status;
+}
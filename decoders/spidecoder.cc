@@ -0,0 +1,189 @@
+#include "spidecoder.hh"
+#include <stdio.h>
+
+void SpiEvent::to_string(char *buf, size_t size) const
+{
+    int digits = (bits + 3) / 4;
+    snprintf(buf, size, "%0*lX/%0*lX%s", digits, (unsigned long)mosi,
+             digits, (unsigned long)miso, incomplete ? "?" : "");
+}
+
+SpiDecoder::SpiDecoder(const SignalStream &stream, const spi_config_t &config):
+    stream(stream.clone()), config(config),
+    cs_mask(1 << config.cs_channel),
+    cs_active(config.cs_active_high ? cs_mask : 0),
+    sck_mask(1 << config.sck_channel),
+    mosi_mask(1 << config.mosi_channel),
+    miso_mask(1 << config.miso_channel),
+    sample_on_rising(config.cpol == config.cpha),
+    leading_rising(!config.cpol),
+    in_window(false), position(0), word(), word_started(false)
+{
+}
+
+SpiDecoder::SpiDecoder(const SpiDecoder &other):
+    TypedEventStream<SpiEvent>(), stream(other.stream->clone()), config(other.config),
+    cs_mask(other.cs_mask), cs_active(other.cs_active), sck_mask(other.sck_mask),
+    mosi_mask(other.mosi_mask), miso_mask(other.miso_mask),
+    sample_on_rising(other.sample_on_rising),
+    leading_rising(other.leading_rising), in_window(other.in_window),
+    position(other.position), word(other.word), word_started(other.word_started)
+{
+}
+
+void SpiDecoder::enter_window(signaltime_t from)
+{
+    in_window = true;
+    position = from;
+    word_started = false;
+    word.bits = 0;
+}
+
+void SpiDecoder::add_bit(signals_t levels)
+{
+    uint32_t mosi = (levels & mosi_mask) ? 1 : 0;
+    uint32_t miso = (levels & miso_mask) ? 1 : 0;
+
+    if (config.lsb_first)
+    {
+        word.mosi |= mosi << word.bits;
+        word.miso |= miso << word.bits;
+    }
+    else
+    {
+        word.mosi = (word.mosi << 1) | mosi;
+        word.miso = (word.miso << 1) | miso;
+    }
+
+    word.bits++;
+}
+
+bool SpiDecoder::read_forwards(SpiEvent &result)
+{
+    SignalEvent event;
+
+    // Only the clock and the chip select split the periods, so the events
+    // where just the data lines change are skipped by the search.
+    SignalSearch edges = SignalSearch::edge(sck_mask | cs_mask);
+    edges.sample = mosi_mask | miso_mask;
+
+    for (;;)
+    {
+        if (!in_window)
+        {
+            SignalSearch search = SignalSearch::pattern(cs_mask, cs_active);
+            if (!stream->find_forwards(position - 1, search, event))
+                return false;
+
+            // Including a clock edge at the start of the chip select
+            enter_window(event.start - 1);
+        }
+
+        if (!stream->find_forwards(position, edges, event))
+            return false; // Wait for more data, the word may continue
+
+        signaltime_t previous = position;
+        position = event.start;
+
+        // Lost data is not returned by the search, but shows in the
+        // levels before the next period.
+        bool lost = event.old_levels & SIGNALS_LOST;
+        bool selected = (event.levels & cs_mask) == cs_active;
+        if (lost || !selected)
+        {
+            // End of the chip select, or data lost in the middle. After
+            // lost data the next word starts from here, if still selected.
+            in_window = selected;
+
+            if (word_started && word.bits > 0)
+            {
+                result = word;
+                result.end = lost ? previous : event.start;
+                result.incomplete = true;
+                word_started = false;
+                word.bits = 0;
+                return true;
+            }
+
+            word_started = false;
+            word.bits = 0;
+            continue;
+        }
+
+        if (!((event.old_levels ^ event.levels) & sck_mask))
+            continue; // No clock edge
+
+        bool rising = event.levels & sck_mask;
+
+        if (!word_started)
+        {
+            // Wait for the clock to leave its idle level
+            if (rising != leading_rising)
+                continue;
+
+            word_started = true;
+            word.start = event.start;
+            word.mosi = 0;
+            word.miso = 0;
+            word.bits = 0;
+            word.incomplete = false;
+        }
+
+        if (rising != sample_on_rising)
+            continue;
+
+        add_bit(event.levels);
+
+        if (word.bits == config.word_bits)
+        {
+            result = word;
+            result.end = event.start;
+            word_started = false;
+            word.bits = 0;
+            return true;
+        }
+    }
+}
+
+void SpiDecoder::seek(signaltime_t time)
+{
+    SignalEvent window;
+    SignalSearch search = SignalSearch::pattern(cs_mask, cs_active);
+
+    in_window = false;
+    position = time;
+    word_started = false;
+    word.bits = 0;
+
+    if (!stream->find_backwards(time + 1, search, window) || window.end <= time)
+        return;
+
+    // Skip the words in the window that end before time. Between words
+    // the state is just the position, so it can be restored.
+    enter_window(window.start - 1);
+    for (;;)
+    {
+        bool was_in_window = in_window;
+        signaltime_t previous = position;
+
+        SpiEvent event;
+        if (!read_forwards(event) || event.end > time)
+        {
+            if (was_in_window)
+            {
+                enter_window(previous);
+            }
+            else
+            {
+                in_window = false;
+                position = previous;
+            }
+            return;
+        }
+    }
+}
+
+SpiDecoder* SpiDecoder::clone() const
+{
+    return new SpiDecoder(*this);
+}
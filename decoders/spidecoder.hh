@@ -0,0 +1,86 @@
+/* Decoder for SPI buses.
+ *
+ * Produces an event for each word transferred while the chip select is
+ * active. The data lines are sampled on the clock edge given by the SPI
+ * mode: with CPHA = 0 on the first edge after the clock leaves its idle
+ * level (CPOL), with CPHA = 1 on the second. If the chip select ends in
+ * the middle of a word, the bits received so far are returned as an
+ * incomplete word.
+ *
+ * The stream is not read event by event: SignalStream::find_forwards()
+ * skips to the next chip select, and inside it to the next clock edge,
+ * sampling MOSI and MISO at the edge. So changes of the data lines between
+ * the edges and periods when the chip select is inactive cost only the
+ * search. Because the words are counted from the start of the chip select,
+ * seek() decodes from the start of the active period containing the time.
+ */
+
+#pragma once
+
+#include "signalstream.hh"
+
+struct spi_config_t
+{
+    uint8_t cs_channel;
+    uint8_t sck_channel;
+    uint8_t mosi_channel;
+    uint8_t miso_channel;
+    bool cs_active_high;
+    bool cpol; // Clock level when idle
+    bool cpha; // Sample on the second clock edge
+    bool lsb_first;
+    uint8_t word_bits; // 1 to 32
+};
+
+struct SpiEvent: public Event
+{
+    uint32_t mosi;
+    uint32_t miso;
+    uint8_t bits; // Number of bits received
+    bool incomplete; // Chip select ended in the middle of the word
+
+    // Formats as hex "MOSI/MISO", with a '?' appended for incomplete words
+    virtual void to_string(char *buf, size_t size) const;
+};
+
+static_assert(sizeof(SpiEvent) <= EventPool::block_size,
+              "SpiEvent must fit in an EventPool block");
+
+class SpiDecoder: public TypedEventStream<SpiEvent>
+{
+public:
+    SpiDecoder(const SignalStream &stream, const spi_config_t &config);
+    SpiDecoder(const SpiDecoder &other);
+    virtual ~SpiDecoder() {};
+
+    // After seek(), the next word read is the first one that ends after
+    // the given time.
+    virtual void seek(signaltime_t time);
+
+    // Decode the next word. Returns false at the end of the data.
+    virtual bool read_forwards(SpiEvent &result);
+
+    virtual SpiDecoder* clone() const;
+
+private:
+    std::unique_ptr<SignalStream> stream;
+    spi_config_t config;
+    signals_t cs_mask, cs_active, sck_mask, mosi_mask, miso_mask;
+    bool sample_on_rising;
+    bool leading_rising; // First edge of a word is rising
+
+    // When in_window, position is the time of the latest clock edge
+    // processed, and the next one is searched after it. Otherwise position
+    // is where to look for the next chip select.
+    bool in_window;
+    signaltime_t position;
+
+    // Word being received
+    SpiEvent word;
+    bool word_started;
+
+    void enter_window(signaltime_t from);
+    void add_bit(signals_t levels);
+
+    SpiDecoder &operator=(const SpiDecoder &other);
+};
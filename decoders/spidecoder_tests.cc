@@ -0,0 +1,380 @@
+#include "spidecoder.hh"
+#include "dsosignalstream.hh"
+#include "varint.hh"
+#include "unittests.h"
+#include <vector>
+#include <time.h>
+
+// Builds an SPI signal tick by tick. Channel A is the clock, B is MOSI,
+// C is MISO and D is the chip select, active low.
+class SpiBuilder
+{
+public:
+    SpiBuilder(bool cpol, bool cpha, bool lsb_first, int half_period):
+        cpol(cpol), cpha(cpha), lsb_first(lsb_first), half_period(half_period),
+        sck(cpol), mosi(0), miso(0), cs(1) {}
+
+    void hold(int ticks)
+    {
+        for (int i = 0; i < ticks; i++)
+            ticks_.push_back(sck | (mosi << 1) | (miso << 2) | (cs << 3));
+    }
+
+    void select(bool active, int ticks)
+    {
+        cs = !active;
+        hold(ticks);
+    }
+
+    // Samples lost by the capture
+    void lose(int ticks)
+    {
+        ticks_.insert(ticks_.end(), ticks, (uint8_t)lost);
+    }
+
+    void send(uint32_t mosi_data, uint32_t miso_data, int bits)
+    {
+        for (int i = 0; i < bits; i++)
+        {
+            int shift = lsb_first ? i : (bits - 1 - i);
+            if (!cpha)
+            {
+                mosi = (mosi_data >> shift) & 1;
+                miso = (miso_data >> shift) & 1;
+                hold(half_period);
+                sck = !cpol;
+                hold(half_period);
+                sck = cpol;
+            }
+            else
+            {
+                sck = !cpol;
+                mosi = (mosi_data >> shift) & 1;
+                miso = (miso_data >> shift) & 1;
+                hold(half_period);
+                sck = cpol;
+                hold(half_period);
+            }
+        }
+    }
+
+    void to_buffer(signal_buffer_t &buffer)
+    {
+        buffer.bytes = 0;
+        size_t i = 0;
+        while (i < ticks_.size())
+        {
+            size_t j = i;
+            while (j < ticks_.size() && ticks_[j] == ticks_[i])
+                j++;
+
+            if (ticks_[i] == lost)
+            {
+                buffer.storage[buffer.bytes++] = 0;
+                buffer.bytes += varint_encode(buffer.storage + buffer.bytes, j - i);
+            }
+            else
+            {
+                uint64_t value = ((uint64_t)(j - i) << 4) | ticks_[i];
+                buffer.bytes += varint_encode(buffer.storage + buffer.bytes, value);
+            }
+            i = j;
+        }
+        buffer.last_duration = 0;
+        buffer.last_value = 0;
+    }
+
+    static const uint8_t lost = 0x10;
+
+    bool cpol, cpha, lsb_first;
+    int half_period;
+    signals_t sck, mosi, miso, cs;
+    std::vector<uint8_t> ticks_;
+};
+
+static spi_config_t make_config(bool cpol, bool cpha, bool lsb_first = false,
+                                int word_bits = 8)
+{
+    spi_config_t config = {3, 0, 1, 2, false, cpol, cpha, lsb_first, (uint8_t)word_bits};
+    return config;
+}
+
+// Passes everything through and counts the events read one by one.
+class CountingStream: public SignalStream
+{
+public:
+    CountingStream(const SignalStream &source, int *reads):
+        source(source.clone()), reads(reads) {}
+
+    CountingStream(const CountingStream &other):
+        SignalStream(), source(other.source->clone()), reads(other.reads) {}
+
+    virtual void seek(signaltime_t time)
+    {
+        source->seek(time);
+    }
+
+    virtual bool read_forwards(SignalEvent &result)
+    {
+        (*reads)++;
+        return source->read_forwards(result);
+    }
+
+    virtual bool read_backwards(SignalEvent &result)
+    {
+        (*reads)++;
+        return source->read_backwards(result);
+    }
+
+    virtual bool find_forwards(signaltime_t from, const SignalSearch &search,
+                               SignalEvent &result)
+    {
+        return source->find_forwards(from, search, result);
+    }
+
+    virtual bool find_backwards(signaltime_t from, const SignalSearch &search,
+                                SignalEvent &result)
+    {
+        return source->find_backwards(from, search, result);
+    }
+
+    virtual frequency_t get_frequency() const
+    {
+        return source->get_frequency();
+    }
+
+    virtual CountingStream* clone() const
+    {
+        return new CountingStream(*this);
+    }
+
+private:
+    std::unique_ptr<SignalStream> source;
+    int *reads;
+};
+
+static signal_buffer_t buffer;
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test mode 0 words and an incomplete word");
+        SpiBuilder builder(false, false, false, 5);
+        builder.hold(20);
+        builder.select(true, 10);
+        builder.send(0xA5, 0x3C, 8);
+        builder.send(0x01, 0x80, 8);
+        builder.select(true, 10);
+        builder.select(false, 50);
+        builder.select(true, 10);
+        builder.send(0x0F, 0x05, 4);
+        builder.select(false, 20);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        SpiDecoder decoder(stream, make_config(false, false));
+        SpiEvent event;
+
+        TEST(decoder.read_forwards(event) && event.mosi == 0xA5 && event.miso == 0x3C &&
+             event.bits == 8 && !event.incomplete &&
+             event.start == 35 && event.end == 105);
+        TEST(decoder.read_forwards(event) && event.mosi == 0x01 && event.miso == 0x80 &&
+             event.start == 115 && event.end == 185);
+        TEST(decoder.read_forwards(event) && event.mosi == 0x0F && event.miso == 0x05 &&
+             event.bits == 4 && event.incomplete && event.end == 300);
+        TEST(!decoder.read_forwards(event));
+
+        char buf[16];
+        event.to_string(buf, sizeof(buf));
+        TEST(strcmp(buf, "F/5?") == 0);
+
+        std::unique_ptr<SpiEvent> allocated;
+        decoder.seek(0);
+        allocated.reset(decoder.read());
+        TEST(allocated && allocated->mosi == 0xA5);
+        allocated->to_string(buf, sizeof(buf));
+        TEST(strcmp(buf, "A5/3C") == 0);
+    }
+
+    {
+        COMMENT("Test all SPI modes");
+        bool all_ok = true;
+        for (int mode = 0; mode < 8; mode++)
+        {
+            bool cpol = mode & 2, cpha = mode & 1, lsb_first = mode & 4;
+            SpiBuilder builder(cpol, cpha, lsb_first, 3);
+            builder.hold(10);
+            for (int i = 0; i < 10; i++)
+            {
+                builder.select(true, 4);
+                builder.send(i * 0x1234, 0xFFFF - i, 16);
+                builder.select(true, 4);
+                builder.select(false, 7);
+            }
+            builder.to_buffer(buffer);
+
+            DSOSignalStream stream(&buffer);
+            SpiDecoder decoder(stream, make_config(cpol, cpha, lsb_first, 16));
+            SpiEvent event;
+            int count = 0;
+            while (decoder.read_forwards(event))
+            {
+                all_ok = all_ok && event.mosi == (uint32_t)(count * 0x1234) &&
+                         event.miso == (uint32_t)(0xFFFF - count) && !event.incomplete;
+                count++;
+            }
+            all_ok = all_ok && count == 10;
+        }
+        TEST(all_ok);
+    }
+
+    {
+        COMMENT("Test seeking");
+        SpiBuilder builder(true, true, false, 4);
+        builder.hold(10);
+        for (int i = 0; i < 100; i++)
+        {
+            builder.select(true, 5);
+            for (int j = 0; j <= i % 4; j++)
+                builder.send(i + j, 0, 8);
+            builder.select(true, 5);
+            builder.select(false, 30 + i);
+        }
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        SpiDecoder decoder(stream, make_config(true, true));
+        std::vector<SpiEvent> all;
+        SpiEvent event;
+        while (decoder.read_forwards(event))
+            all.push_back(event);
+        TEST(all.size() == 250);
+
+        bool all_ok = true;
+        signaltime_t last = all.back().end;
+        for (signaltime_t time = 0; time < last; time += 17)
+        {
+            size_t expected = 0;
+            while (all[expected].end <= time)
+                expected++;
+
+            decoder.seek(time);
+            all_ok = all_ok && decoder.read_forwards(event) &&
+                     event.start == all[expected].start &&
+                     event.mosi == all[expected].mosi;
+
+            all_ok = all_ok && decoder.read_forwards(event) == (expected + 1 < all.size());
+        }
+        TEST(all_ok);
+
+        decoder.seek(last);
+        TEST(!decoder.read_forwards(event));
+    }
+
+    {
+        COMMENT("Test a slow clock with the data lines changing between edges");
+        SpiBuilder builder(false, false, false, 50);
+        builder.hold(10);
+        builder.select(true, 10);
+        for (int i = 0; i < 16; i++)
+        {
+            uint8_t data = i * 37;
+            for (int bit = 7; bit >= 0; bit--)
+            {
+                // The data lines toggle until just before the sampling edge
+                for (int t = 0; t < 48; t++)
+                {
+                    builder.mosi = t & 1;
+                    builder.miso = (t >> 1) & 1;
+                    builder.hold(1);
+                }
+                builder.mosi = (data >> bit) & 1;
+                builder.miso = !builder.mosi;
+                builder.hold(2);
+                builder.sck = 1;
+                builder.hold(50);
+                builder.sck = 0;
+            }
+        }
+        builder.select(false, 10);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream source(&buffer);
+        int reads = 0;
+        CountingStream stream(source, &reads);
+        SpiDecoder decoder(stream, make_config(false, false));
+        SpiEvent event;
+
+        clock_t start = clock();
+        bool all_ok = true;
+        int count = 0;
+        while (decoder.read_forwards(event))
+        {
+            uint8_t data = count * 37;
+            all_ok = all_ok && event.mosi == data && event.miso == (uint8_t)~data &&
+                     !event.incomplete;
+            count++;
+        }
+        clock_t end = clock();
+
+        TEST(all_ok && count == 16);
+        TEST(reads == 0); // The events are not read one by one
+        printf("Decoded %d words from %d bytes in %ld ms\n",
+               count, (int)buffer.bytes, (long)((end - start) * 1000 / CLOCKS_PER_SEC));
+    }
+
+    {
+        COMMENT("Test data lost in the middle of a word");
+        SpiBuilder builder(false, false, false, 5);
+        builder.hold(20);
+        builder.select(true, 10);
+        builder.send(0x0A, 0x05, 4);
+        builder.lose(30);
+        builder.send(0xC3, 0x3C, 8);
+        builder.select(false, 20);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        SpiDecoder decoder(stream, make_config(false, false));
+        SpiEvent event;
+
+        TEST(decoder.read_forwards(event) && event.mosi == 0x0A && event.miso == 0x05 &&
+             event.bits == 4 && event.incomplete && event.end == 65);
+        TEST(decoder.read_forwards(event) && event.mosi == 0xC3 && event.miso == 0x3C &&
+             event.bits == 8 && !event.incomplete && event.start == 105);
+        TEST(!decoder.read_forwards(event));
+    }
+
+    {
+        COMMENT("Test decoding speed");
+        SpiBuilder builder(false, false, false, 1);
+        builder.hold(10);
+        int words = 0;
+        while (words < 1000) // Fits in the buffer
+        {
+            builder.select(true, 1);
+            builder.send(words, ~words, 8);
+            builder.select(false, 100);
+            words++;
+        }
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        SpiDecoder decoder(stream, make_config(false, false));
+        SpiEvent event;
+
+        clock_t start = clock();
+        int count = 0;
+        while (decoder.read_forwards(event))
+            count++;
+        clock_t end = clock();
+
+        TEST(count == words);
+        printf("Decoded %d words from %d bytes in %ld ms\n",
+               count, (int)buffer.bytes, (long)((end - start) * 1000 / CLOCKS_PER_SEC));
+    }
+
+    return status;
+}
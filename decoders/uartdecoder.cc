@@ -0,0 +1,210 @@
+#include "uartdecoder.hh"
+#include <stdio.h>
+
+void UartEvent::to_string(char *buf, size_t size) const
+{
+    const char *error = (parity_error || framing_error) ? "!" : "";
+
+    if (data >= 0x20 && data < 0x7F)
+        snprintf(buf, size, "'%c'%s", (char)data, error);
+    else
+        snprintf(buf, size, "0x%02X%s", (unsigned)data, error);
+}
+
+UartDecoder::UartDecoder(const SignalStream &stream, const uart_config_t &config):
+    stream(stream, 1 << config.channel), config(config),
+    mask(1 << config.channel), current(), have_current(false), search_from(0)
+{
+    bit_ticks = ((uint64_t)config.frequency << 16) / config.baudrate;
+    frame_bits = 1 + config.data_bits + (config.parity != UART_PARITY_NONE) + config.stop_bits;
+    restart(0);
+}
+
+signaltime_t UartDecoder::bit_center(signaltime_t start, int bit) const
+{
+    return start + (((2 * bit + 1) * (uint64_t)bit_ticks) >> 17);
+}
+
+signaltime_t UartDecoder::frame_ticks() const
+{
+    return (frame_bits * (uint64_t)bit_ticks) >> 16;
+}
+
+void UartDecoder::restart(signaltime_t time)
+{
+    stream.seek(time);
+    have_current = stream.read_forwards(current);
+    search_from = time;
+}
+
+// Get the level of the channel at the given time, which must not be
+// before the previously sampled time.
+bool UartDecoder::sample(signaltime_t time, signals_t &level)
+{
+    while (have_current && current.end <= time)
+        have_current = stream.read_forwards(current);
+
+    level = current.levels;
+    return have_current;
+}
+
+// Find the next falling edge at or after search_from.
+bool UartDecoder::find_start_bit(signaltime_t &start)
+{
+    signals_t level;
+    if (!sample(search_from, level))
+        return false;
+
+    while (current.start < search_from || current.levels != 0 ||
+           current.old_levels != mask)
+    {
+        if (!(have_current = stream.read_forwards(current)))
+            return false;
+    }
+
+    start = current.start;
+    return true;
+}
+
+// Sample the rest of the character after the start bit.
+bool UartDecoder::decode(signaltime_t start, UartEvent &result)
+{
+    signals_t level;
+    int bit = 1;
+    int ones = 0;
+    bool lost = false;
+
+    result.data = 0;
+    for (int i = 0; i < config.data_bits; i++, bit++)
+    {
+        if (!sample(bit_center(start, bit), level))
+            return false;
+
+        if (level == mask)
+        {
+            result.data |= 1 << i;
+            ones++;
+        }
+
+        lost = lost || (level & SIGNALS_LOST);
+    }
+
+    result.parity_error = false;
+    if (config.parity != UART_PARITY_NONE)
+    {
+        if (!sample(bit_center(start, bit++), level))
+            return false;
+
+        if (level == mask)
+            ones++;
+
+        bool odd = ones & 1;
+        result.parity_error = (config.parity == UART_PARITY_EVEN) ? odd : !odd;
+    }
+
+    result.framing_error = lost;
+    for (int i = 0; i < config.stop_bits; i++, bit++)
+    {
+        if (!sample(bit_center(start, bit), level))
+            return false;
+
+        if (level != mask)
+            result.framing_error = true;
+    }
+
+    result.start = start;
+    result.end = start + frame_ticks();
+
+    // The next start bit may come right after the middle of the stop bit
+    search_from = bit_center(start, bit - 1);
+    return true;
+}
+
+bool UartDecoder::read_forwards(UartEvent &result)
+{
+    for (;;)
+    {
+        signaltime_t start;
+        if (!find_start_bit(start))
+            return false;
+
+        // The start bit must still be low at its middle, otherwise it
+        // was a glitch.
+        signals_t level;
+        if (!sample(bit_center(start, 0), level))
+            return false;
+
+        if (level == 0)
+            return decode(start, result);
+
+        search_from = bit_center(start, 0);
+    }
+}
+
+// Find a time after which the next falling edge is a start bit.
+signaltime_t UartDecoder::find_sync_point(signaltime_t time)
+{
+    signaltime_t limit = time - resync_chars * frame_ticks();
+    if (limit < 0)
+        limit = 0;
+
+    // A high period longer than a character can only be an idle line.
+    SignalEvent event;
+    stream.seek(time);
+    stream.read_forwards(event);
+
+    while (stream.read_backwards(event))
+    {
+        if (event.levels == mask &&
+            (event.end - event.start >= frame_ticks() || event.start == 0))
+        {
+            return event.start;
+        }
+
+        if (event.start <= limit)
+            break;
+    }
+
+    // The line is busy, try each falling edge as a start bit until the
+    // following characters have no framing errors.
+    restart(limit);
+    signaltime_t candidate;
+    while (find_start_bit(candidate) && candidate < time)
+    {
+        restart(candidate);
+
+        UartEvent result;
+        int good = 0;
+        while (good < resync_check && read_forwards(result) && !result.framing_error)
+            good++;
+
+        if (good == resync_check || !have_current)
+            return candidate;
+
+        restart(candidate + 1);
+    }
+
+    return limit;
+}
+
+void UartDecoder::seek(signaltime_t time)
+{
+    restart(find_sync_point(time));
+
+    // Skip the characters that end before time
+    for (;;)
+    {
+        signaltime_t position = search_from;
+        UartEvent event;
+        if (!read_forwards(event) || event.end > time)
+        {
+            restart(position);
+            return;
+        }
+    }
+}
+
+UartDecoder* UartDecoder::clone() const
+{
+    return new UartDecoder(*this);
+}
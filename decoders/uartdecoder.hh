@@ -0,0 +1,91 @@
+/* Decoder for asynchronous serial data, such as from a UART.
+ *
+ * Reads the signal of one channel from a SignalStream and produces an
+ * event for each character. The line is high when idle, and each
+ * character begins with a low start bit. The bits are sampled at their
+ * centers, timed from the falling edge of the start bit.
+ *
+ * Seeking doesn't decode from the start of the capture. Instead, the
+ * decoder looks backwards for an idle period of at least one character,
+ * after which the next falling edge must be a start bit. If the line has
+ * been busy all the time, it tries the falling edges until the following
+ * characters decode without framing errors.
+ */
+
+#pragma once
+
+#include "signalstream.hh"
+#include "projectedsignalstream.hh"
+
+enum uart_parity_t
+{
+    UART_PARITY_NONE = 0,
+    UART_PARITY_EVEN = 1,
+    UART_PARITY_ODD = 2
+};
+
+struct uart_config_t
+{
+    frequency_t frequency; // Ticks per second of the signal stream
+    uint32_t baudrate;
+    uint8_t data_bits; // 5 to 9
+    uart_parity_t parity;
+    uint8_t stop_bits; // 1 or 2
+    uint8_t channel; // 0 = ch A etc.
+};
+
+struct UartEvent: public Event
+{
+    uint16_t data;
+    bool parity_error;
+    bool framing_error; // Stop bit was low
+
+    // Formats printable characters as 'A' and others as hex, with a '!'
+    // appended if there was an error.
+    virtual void to_string(char *buf, size_t size) const;
+};
+
+static_assert(sizeof(UartEvent) <= EventPool::block_size,
+              "UartEvent must fit in an EventPool block");
+
+class UartDecoder: public TypedEventStream<UartEvent>
+{
+public:
+    UartDecoder(const SignalStream &stream, const uart_config_t &config);
+    virtual ~UartDecoder() {};
+
+    // After seek(), the next character read is the first one that ends
+    // after the given time.
+    virtual void seek(signaltime_t time);
+
+    // Decode the next character. Returns false at the end of the data.
+    virtual bool read_forwards(UartEvent &result);
+
+    virtual UartDecoder* clone() const;
+
+    // Number of characters to look back for an idle line when seeking.
+    static const int resync_chars = 32;
+
+    // Number of characters that must decode correctly when synchronizing
+    // to a busy line.
+    static const int resync_check = 4;
+
+private:
+    ProjectedSignalStream stream;
+    uart_config_t config;
+    signals_t mask;
+    uint32_t bit_ticks; // Length of one bit in ticks, 16.16 fixed point
+    int frame_bits; // Start, data, parity and stop bits
+
+    SignalEvent current; // Event covering the latest sampled time
+    bool have_current;
+    signaltime_t search_from; // Where to look for the next start bit
+
+    signaltime_t bit_center(signaltime_t start, int bit) const;
+    signaltime_t frame_ticks() const;
+    void restart(signaltime_t time);
+    bool sample(signaltime_t time, signals_t &level);
+    bool find_start_bit(signaltime_t &start);
+    bool decode(signaltime_t start, UartEvent &result);
+    signaltime_t find_sync_point(signaltime_t time);
+};
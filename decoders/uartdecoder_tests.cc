@@ -0,0 +1,263 @@
+#include "uartdecoder.hh"
+#include "dsosignalstream.hh"
+#include "varint.hh"
+#include "unittests.h"
+#include <vector>
+#include <time.h>
+
+// Builds a signal tick by tick. The UART is on channel B and channel A
+// can have a clock on it.
+class SignalBuilder
+{
+public:
+    SignalBuilder(double bit_ticks): bit_ticks(bit_ticks), clock_period(0) {}
+
+    void level(bool high, int ticks)
+    {
+        for (int i = 0; i < ticks; i++)
+        {
+            signals_t a = clock_period ? ((ticks_.size() / clock_period) & 1) : 0;
+            ticks_.push_back((high ? 2 : 0) | a);
+        }
+    }
+
+    void idle(int bits)
+    {
+        level(true, bits * bit_ticks);
+    }
+
+    // Send a character, with the parity bit already in data if needed.
+    void send(uint32_t data, int bits, int stop_bits = 1)
+    {
+        size_t start = ticks_.size();
+        int total = 1 + bits + stop_bits;
+        for (int i = 0; i < total; i++)
+        {
+            bool high = (i == 0) ? false : (i > bits) ? true : ((data >> (i - 1)) & 1);
+            size_t end = start + (size_t)((i + 1) * bit_ticks + 0.5);
+            level(high, end - ticks_.size());
+        }
+    }
+
+    void to_buffer(signal_buffer_t &buffer)
+    {
+        buffer.bytes = 0;
+        size_t i = 0;
+        while (i < ticks_.size())
+        {
+            size_t j = i;
+            while (j < ticks_.size() && ticks_[j] == ticks_[i])
+                j++;
+
+            uint64_t value = ((uint64_t)(j - i) << 4) | ticks_[i];
+            buffer.bytes += varint_encode(buffer.storage + buffer.bytes, value);
+            i = j;
+        }
+        buffer.last_duration = 0;
+        buffer.last_value = 0;
+    }
+
+    double bit_ticks;
+    int clock_period; // Ticks between the edges on channel A, 0 for none
+    std::vector<uint8_t> ticks_;
+};
+
+static uart_config_t make_config(frequency_t frequency, uint32_t baudrate,
+                                 int data_bits = 8, uart_parity_t parity = UART_PARITY_NONE,
+                                 int stop_bits = 1)
+{
+    uart_config_t config = {frequency, baudrate, (uint8_t)data_bits, parity,
+                            (uint8_t)stop_bits, 1};
+    return config;
+}
+
+static signal_buffer_t buffer;
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test 8N1 characters");
+        SignalBuilder builder(100);
+        builder.idle(5);
+        const char *text = "Hello";
+        for (const char *p = text; *p; p++)
+            builder.send(*p, 8);
+        builder.idle(3);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder decoder(stream, make_config(1000000, 10000));
+        UartEvent event;
+
+        TEST(decoder.read_forwards(event) && event.data == 'H' &&
+             event.start == 500 && event.end == 1500 &&
+             !event.parity_error && !event.framing_error);
+        TEST(decoder.read_forwards(event) && event.data == 'e' && event.start == 1500);
+        TEST(decoder.read_forwards(event) && event.data == 'l');
+        TEST(decoder.read_forwards(event) && event.data == 'l');
+        TEST(decoder.read_forwards(event) && event.data == 'o' && event.end == 5500);
+        TEST(!decoder.read_forwards(event));
+
+        char buf[16];
+        event.to_string(buf, sizeof(buf));
+        TEST(strcmp(buf, "'o'") == 0);
+
+        std::unique_ptr<UartEvent> allocated;
+        decoder.seek(0);
+        allocated.reset(decoder.read());
+        TEST(allocated && allocated->data == 'H');
+    }
+
+    {
+        COMMENT("Test parity, framing errors and glitches");
+        SignalBuilder builder(100);
+        builder.idle(2);
+        builder.send(0x41, 8, 2); // 7E2, correct parity
+        builder.send(0x43, 8, 2); // 7E2, parity should be 1
+        builder.idle(1);
+        builder.level(false, 10); // Glitch
+        builder.idle(1);
+        builder.send(0x00, 8, 0); // Break, stop bit is low
+        builder.level(false, 300);
+        builder.idle(2);
+        builder.send(0x42, 8, 2);
+        builder.idle(2);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder decoder(stream, make_config(1000000, 10000, 7, UART_PARITY_EVEN, 2));
+        UartEvent event;
+
+        TEST(decoder.read_forwards(event) && event.data == 0x41 &&
+             !event.parity_error && !event.framing_error);
+        TEST(decoder.read_forwards(event) && event.data == 0x43 && event.parity_error);
+        TEST(decoder.read_forwards(event) && event.data == 0x00 && event.framing_error);
+        TEST(decoder.read_forwards(event) && event.data == 0x42 && !event.parity_error &&
+             !event.framing_error);
+        TEST(!decoder.read_forwards(event));
+
+        char buf[16];
+        event.data = 0x03;
+        event.framing_error = true;
+        event.to_string(buf, sizeof(buf));
+        TEST(strcmp(buf, "0x03!") == 0);
+    }
+
+    {
+        COMMENT("Test baudrate that is not a multiple of the tick rate");
+        SignalBuilder builder(500000.0 / 115200);
+        builder.clock_period = 3;
+        builder.idle(20);
+        for (int i = 0; i < 200; i++)
+            builder.send((i * 37) & 0xFF, 8);
+        builder.idle(20);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder decoder(stream, make_config(500000, 115200));
+        UartEvent event;
+        bool all_ok = true;
+        int count = 0;
+        while (decoder.read_forwards(event))
+        {
+            all_ok = all_ok && event.data == ((count * 37) & 0xFF) && !event.framing_error;
+            count++;
+        }
+        TEST(all_ok && count == 200);
+    }
+
+    {
+        COMMENT("Test seeking on a busy line");
+        SignalBuilder builder(100);
+        builder.clock_period = 40;
+        builder.idle(3);
+        const char *text = "The quick brown fox jumps over the lazy dog. ";
+        for (int i = 0; i < 300; i++)
+            builder.send(text[i % 45], 8);
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder decoder(stream, make_config(1000000, 10000));
+        std::vector<UartEvent> all;
+        UartEvent event;
+        while (decoder.read_forwards(event))
+            all.push_back(event);
+        TEST(all.size() == 300);
+
+        bool all_ok = true;
+        for (signaltime_t time = 0; time < 300000; time += 4567)
+        {
+            decoder.seek(time);
+            size_t expected = (time - 300) / 1000;
+            if (time < 300)
+                expected = 0;
+
+            all_ok = all_ok && decoder.read_forwards(event) &&
+                     event.start == all[expected].start &&
+                     event.data == all[expected].data;
+        }
+        TEST(all_ok);
+
+        COMMENT("Test seeking after an idle period");
+        SignalBuilder builder2(100);
+        for (int i = 0; i < 50; i++)
+        {
+            builder2.idle(12);
+            builder2.send(0xFF, 8); // Looks like a glitch of start bit only
+            builder2.send(text[i % 45], 8);
+        }
+        builder2.to_buffer(buffer);
+
+        decoder.seek(0);
+        all.clear();
+        while (decoder.read_forwards(event))
+            all.push_back(event);
+        TEST(all.size() == 100);
+
+        all_ok = true;
+        for (size_t i = 1; i < all.size(); i++)
+        {
+            decoder.seek(all[i].start + 10);
+            all_ok = all_ok && decoder.read_forwards(event) &&
+                     event.start == all[i].start && event.data == all[i].data;
+
+            // Either the previous character, or this one after an idle line
+            size_t expected = (all[i - 1].end > all[i].start - 1) ? i - 1 : i;
+            decoder.seek(all[i].start - 1);
+            all_ok = all_ok && decoder.read_forwards(event) &&
+                     event.start == all[expected].start;
+        }
+        TEST(all_ok);
+    }
+
+    {
+        COMMENT("Test decoding speed");
+        SignalBuilder builder(500000.0 / 115200);
+        builder.idle(10);
+        int chars = 0;
+        while (chars < 2400) // Fits in the buffer
+        {
+            builder.send(chars & 0xFF, 8);
+            chars++;
+        }
+        builder.to_buffer(buffer);
+
+        DSOSignalStream stream(&buffer);
+        UartDecoder decoder(stream, make_config(500000, 115200));
+        UartEvent event;
+
+        clock_t start = clock();
+        int count = 0;
+        while (decoder.read_forwards(event))
+            count++;
+        clock_t end = clock();
+
+        TEST(count == chars);
+        printf("Decoded %d characters from %d bytes in %ld ms\n",
+               count, (int)buffer.bytes, (long)((end - start) * 1000 / CLOCKS_PER_SEC));
+    }
+
+    return status;
+}
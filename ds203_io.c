@@ -237,6 +237,16 @@ static uint32_t secbuff_pos;
 static uint32_t sector_count;
 static bool file_ok = false;
 
+// State for reading files, see _fread_sector().
+#define READ_SNAPSHOT_INTERVAL 8
+#define READ_SNAPSHOT_COUNT 64
+static u8 read_filename[11];
+static bool read_open = false; // A file has been opened with _fopen_rd()
+static bool read_valid = false; // pCluster contains the read position
+static u32 read_sector; // Next sector that __ReadFileSec() returns
+static u16 read_snapshots[READ_SNAPSHOT_COUNT][3];
+static u32 read_snapshot_count;
+
 // The BIOS doesn't want the dot to be included in the name.
 // I think it is more natural to type "foo.csv" than "foo     csv", therefore
 // this function makes the conversion.
@@ -266,12 +276,14 @@ bool _fexists(const char *filename)
 {
     // There is no need to close the file, as OpenFileRd doesn't write anything
     // to disc.
+    read_valid = false;
     return (__OpenFileRd(SecBuff, fix_filename(filename), pCluster, pDirAddr) == 0);
 }
 
 // Open a file for writing, creating it if it doesn't already exist.
 bool _fopen_wr(const char *filename)
 {
+    read_valid = false;
     int status = __OpenFileWr(SecBuff, fix_filename(filename), pCluster, pDirAddr);    
     file_ok = (status == 0);
     file_length = 0;
@@ -320,6 +332,26 @@ static const struct File_methods file_methods = {
 static const struct File _current_file = {&file_methods};
 FILE* const current_file = (FILE*)&_current_file;
 
+u8 *_fsector_buffer()
+{
+    return SecBuff;
+}
+
+// Write the whole SecBuff to disc as the next sector of the file.
+bool _fwrite_sector()
+{
+    if (!file_ok) return false;
+    
+    file_length += 512;
+    sector_count++;
+    if (__ProgFileSec(SecBuff, pCluster) != 0)
+    {
+        file_ok = false; // Write error
+    }
+    
+    return file_ok;
+}
+
 // Close the currently open file. Checks the error status and returns false
 // if any error has occurred since opening the file.
 bool _fclose()
@@ -347,6 +379,74 @@ int _fprintf(const char *fmt, ...)
     return file_length - first_length;
 }
 
+static bool reopen_rd()
+{
+    read_valid = false;
+    if (__OpenFileRd(SecBuff, read_filename, pCluster, pDirAddr) != 0)
+        return false;
+    
+    read_sector = 0;
+    read_valid = true;
+    return true;
+}
+
+// Open a file for reading with _fread_sector().
+bool _fopen_rd(const char *filename)
+{
+    memcpy(read_filename, fix_filename(filename), sizeof(read_filename));
+    read_snapshot_count = 0;
+    read_open = reopen_rd();
+    return read_open;
+}
+
+// The BIOS can only read the sectors of a file in order. To allow seeking,
+// the cluster chain position is saved every READ_SNAPSHOT_INTERVAL sectors
+// and restored when going backwards. The BIOS calls share pCluster with
+// the other file functions, so the file is reopened if something else has
+// been done in between.
+bool _fread_sector(u32 sector, u8 *buffer)
+{
+    if (!read_open || file_ok) return false;
+    if (!read_valid && !reopen_rd()) return false;
+    
+    if (sector < read_sector || sector >= read_sector + READ_SNAPSHOT_INTERVAL)
+    {
+        // Restart from the closest saved position, if that is closer
+        u32 index = sector / READ_SNAPSHOT_INTERVAL;
+        if (index >= read_snapshot_count)
+            index = read_snapshot_count - 1;
+        
+        u32 snapshot_sector = index * READ_SNAPSHOT_INTERVAL;
+        if (read_snapshot_count > 0 &&
+            (sector < read_sector || snapshot_sector > read_sector))
+        {
+            memcpy(pCluster, read_snapshots[index], sizeof(pCluster));
+            read_sector = snapshot_sector;
+        }
+    }
+    
+    while (read_sector <= sector)
+    {
+        if (read_sector % READ_SNAPSHOT_INTERVAL == 0 &&
+            read_sector / READ_SNAPSHOT_INTERVAL == read_snapshot_count &&
+            read_snapshot_count < READ_SNAPSHOT_COUNT)
+        {
+            memcpy(read_snapshots[read_snapshot_count++], pCluster, sizeof(pCluster));
+        }
+        
+        if (__ReadFileSec(SecBuff, pCluster) != 0)
+        {
+            read_valid = false; // Read error or end of file
+            return false;
+        }
+        
+        read_sector++;
+    }
+    
+    memcpy(buffer, SecBuff, 512);
+    return true;
+}
+
 // Find a filename that is not in use. Format is a printf format string.
 char *select_filename(const char *format)
 {
@@ -44,7 +44,7 @@ void vertdots(int x, int y1, int y2, u16 color);
 
 // These functions allow writing to files.
 // Current limitations (only in ds203_io.c, BIOS supports these):
-// 1) No file reading
+// 1) Files can only be read a sector at a time
 // 2) Only one open file at a time
 //
 // To simplify error handling, all errors are queued and further actions are
@@ -62,6 +62,19 @@ void _fputc(char c);
 int _fprintf(const char *fmt, ...);
 bool _fclose();
 
+// Direct access to the sector buffer, for writing a whole sector at a time.
+// Fill all 512 bytes of the buffer and call _fwrite_sector(). Do not mix
+// with _fputc() within the same file.
+u8 *_fsector_buffer();
+bool _fwrite_sector();
+
+// Open a file for reading, and read the 512-byte sector with the given
+// index into buffer. Reading is slow when going backwards, so callers
+// should cache the sectors. Writing other files in between is allowed,
+// the file is reopened automatically.
+bool _fopen_rd(const char *filename);
+bool _fread_sector(u32 sector, u8 *buffer);
+
 // Select a free filename using a printf-style template.
 // Goes through parameters 0 to 999 until a non-existent filename is found.
 // Returns pointer to a static array, so next call will overwrite the value.
@@ -0,0 +1,38 @@
+/* Event mask shared between the interrupts and the main loop */
+
+#include "events.h"
+#include "buttons.h"
+#include <stm32f10x.h>
+
+static volatile uint32_t EVENTS_PENDING = 0;
+
+void post_event(uint32_t events)
+{
+    __sync_fetch_and_or(&EVENTS_PENDING, events);
+}
+
+uint32_t take_events(uint32_t mask)
+{
+    return __sync_fetch_and_and(&EVENTS_PENDING, ~mask) & mask;
+}
+
+uint32_t wait_events(uint32_t mask, uint32_t timeout_ms)
+{
+    uint32_t start = get_time();
+    
+    for (;;)
+    {
+        // WFI wakes up on a pending interrupt even while they are disabled,
+        // so an event posted after the check cannot be missed. The 1 ms
+        // tick interrupt wakes us up for the timeout check.
+        __disable_irq();
+        uint32_t events = EVENTS_PENDING & mask;
+        if (events || get_time() - start >= timeout_ms)
+        {
+            __enable_irq();
+            return events;
+        }
+        __WFI();
+        __enable_irq();
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Events for waking up the main loop. Interrupt routines post events by
+ * setting bits in a pending mask, so several events of the same kind are
+ * coalesced into one. The main loop takes the pending events and sleeps
+ * with WFI while there is nothing to do.
+ */
+
+#define EVENT_KEYS     0x0001 // Key was pressed, posted by the tick interrupt
+#define EVENT_TIMER    0x0002 // Once per second, for status updates
+#define EVENT_CAPTURE  0x0004 // New data in the signal buffer
+#define EVENT_STREAM   0x0008 // USART transmit queue is empty
+
+#define ANY_EVENT      0xFFFF
+
+// Mark events as pending. Can be called from interrupts.
+void post_event(uint32_t events);
+
+// Return the pending events in mask and clear them.
+uint32_t take_events(uint32_t mask);
+
+// Sleep until some of the events in mask are pending or timeout_ms has
+// passed. Returns the pending events without clearing them.
+uint32_t wait_events(uint32_t mask, uint32_t timeout_ms);
@@ -0,0 +1,135 @@
+#include "capturefile.hh"
+#include "varint.hh"
+
+// Go through the records and compute the checkpoints. If output is not
+// NULL, the checkpoints are written to it. Returns the number of
+// checkpoints.
+static uint64_t build_index(const uint8_t *storage, size_t bytes,
+                            signaltime_t last_duration, uint32_t interval,
+                            SectorWriter *output, uint64_t &total_time)
+{
+    uint64_t count = 0;
+    size_t pos = 0;
+    size_t next = 0;
+    signaltime_t time = 0;
+    signals_t levels = 0;
+
+    // The real-time last event is handled as one more record after
+    // the storage.
+    while (pos < bytes || (pos == bytes && last_duration > 0))
+    {
+        if (pos >= next)
+        {
+            if (output)
+            {
+                capture_checkpoint_t checkpoint = {};
+                checkpoint.offset = pos;
+                checkpoint.time = time;
+                checkpoint.levels = levels;
+                output->put_bytes(&checkpoint, sizeof(checkpoint));
+            }
+
+            count++;
+            next = (pos / interval + 1) * interval;
+        }
+
+        if (pos == bytes)
+        {
+            time += last_duration;
+            break;
+        }
+
+        signaltime_t duration;
+        pos = varint_read_record(storage, pos, duration, levels);
+        time += duration;
+    }
+
+    total_time = time;
+    return count;
+}
+
+bool capturefile_write(SectorWriter *output, const signal_buffer_t *buffer,
+                       const capture_info_t &info)
+{
+    // The capture interrupt may still be appending to the buffer, so take
+    // a consistent snapshot of the length and the last event.
+    size_t bytes;
+    signaltime_t last_duration;
+    signals_t last_value;
+    do {
+        bytes = buffer->bytes;
+        last_duration = buffer->last_duration;
+        last_value = buffer->last_value;
+    } while (bytes != buffer->bytes);
+
+    return capturefile_write_data(output, buffer->storage, bytes,
+                                  last_duration, last_value, info);
+}
+
+bool capturefile_write_data(SectorWriter *output, const uint8_t *storage,
+                            size_t bytes, signaltime_t last_duration,
+                            signals_t last_value, const capture_info_t &info)
+{
+    uint8_t last[VARINT_MAX_BYTES];
+    int last_bytes = 0;
+    if (last_duration > 0)
+        last_bytes = varint_encode(last, (last_duration << 4) | last_value);
+
+    uint32_t interval = info.index_interval ? info.index_interval : 1024;
+
+    capture_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTUREFILE_MAGIC, sizeof(header.magic));
+    header.version = CAPTUREFILE_VERSION;
+    header.frequency = info.frequency;
+    header.start_timestamp = info.start_timestamp;
+    header.data_offset = SectorWriter::sector_size;
+    header.data_bytes = bytes + last_bytes;
+    header.index_offset = header.data_offset
+        + (header.data_bytes + SectorWriter::sector_size - 1)
+        / SectorWriter::sector_size * SectorWriter::sector_size;
+    header.index_count = build_index(storage, bytes, last_duration,
+                                     interval, NULL, header.total_time);
+    header.index_interval = interval;
+    header.channels = CAPTUREFILE_CHANNELS;
+
+    for (int i = 0; i < CAPTUREFILE_CHANNELS; i++)
+    {
+        if (info.channel_names[i])
+        {
+            strncpy(header.channel_names[i], info.channel_names[i],
+                    CAPTUREFILE_NAME_LENGTH);
+        }
+    }
+
+    output->put_bytes(&header, sizeof(header));
+    output->align(0);
+
+    output->put_bytes(storage, bytes);
+    output->put_bytes(last, last_bytes);
+    output->align(0);
+
+    uint64_t dummy;
+    build_index(storage, bytes, last_duration, interval,
+                output, dummy);
+
+    return output->finish(0);
+}
+
+bool capturefile_read_header(const uint8_t *sector, capture_header_t &header)
+{
+    memcpy(&header, sector, sizeof(header));
+
+    if (memcmp(header.magic, CAPTUREFILE_MAGIC, sizeof(header.magic)) != 0)
+        return false;
+
+    if (header.version != CAPTUREFILE_VERSION ||
+        header.channels != CAPTUREFILE_CHANNELS)
+        return false;
+
+    if (header.data_offset < sizeof(header) ||
+        header.index_offset < header.data_offset + header.data_bytes)
+        return false;
+
+    return true;
+}
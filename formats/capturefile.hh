@@ -0,0 +1,111 @@
+/* Native binary format for saved captures.
+ *
+ * The file contains the varint-encoded storage of signal_buffer_t almost
+ * verbatim, so saving is mostly a matter of copying the memory to disc.
+ * All integers are little-endian, and all sections begin at a multiple
+ * of 512 bytes:
+ *
+ * Sector 0:     capture_header_t, padded with zeros.
+ * data_offset:  data_bytes of varint data, as in dsosignalstream.hh. The
+ *               real-time last event of the buffer is appended as a normal
+ *               varint.
+ * index_offset: index_count entries of capture_checkpoint_t, sorted by
+ *               time. A checkpoint is stored at the first record that
+ *               begins after each index_interval bytes of data, so that
+ *               readers can binary search the index and then decode only
+ *               a short stretch of data. The entries are 32 bytes so that
+ *               they never cross a sector boundary.
+ */
+
+#pragma once
+
+#include "sectorwriter.hh"
+#include "dsosignalstream.hh"
+
+#define CAPTUREFILE_MAGIC "DSOLOGIC"
+
+const uint32_t CAPTUREFILE_VERSION = 1;
+const int CAPTUREFILE_CHANNELS = 4;
+const int CAPTUREFILE_NAME_LENGTH = 16;
+
+struct capture_header_t
+{
+    char magic[8]; // CAPTUREFILE_MAGIC, not null-terminated
+    uint32_t version; // CAPTUREFILE_VERSION
+    uint32_t frequency; // Ticks per second
+
+    // Wall-clock time of the start of the capture, seconds since 1970,
+    // or 0 if unknown.
+    uint64_t start_timestamp;
+
+    uint64_t total_time; // Length of the capture in ticks
+
+    uint64_t data_offset;
+    uint64_t data_bytes;
+
+    uint64_t index_offset;
+    uint64_t index_count;
+    uint32_t index_interval;
+
+    uint32_t channels; // CAPTUREFILE_CHANNELS
+
+    // Null-padded channel names
+    char channel_names[CAPTUREFILE_CHANNELS][CAPTUREFILE_NAME_LENGTH];
+};
+
+struct capture_checkpoint_t
+{
+    uint64_t offset; // Position of the record, relative to data_offset
+    uint64_t time; // Start time of the record
+    uint32_t levels; // Levels before the record, i.e. old_levels
+    uint32_t reserved[3];
+};
+
+static_assert(sizeof(capture_header_t) == 136, "capture_header_t layout");
+static_assert(sizeof(capture_checkpoint_t) == 32, "capture_checkpoint_t layout");
+
+struct capture_info_t
+{
+    frequency_t frequency;
+    uint64_t start_timestamp; // 0 if unknown
+    const char *channel_names[CAPTUREFILE_CHANNELS];
+    uint32_t index_interval; // Default when 0: 1024 bytes
+};
+
+// Write the contents of the signal buffer as a capture file.
+// Returns true if all writes succeeded.
+bool capturefile_write(SectorWriter *output, const signal_buffer_t *buffer,
+                       const capture_info_t &info);
+
+// Same for varint data from any other source. Last_duration and
+// last_value have the same meaning as in signal_buffer_t.
+bool capturefile_write_data(SectorWriter *output, const uint8_t *storage,
+                            size_t bytes, signaltime_t last_duration,
+                            signals_t last_value, const capture_info_t &info);
+
+// Check that the first sector of a file is a valid header and copy it
+// to header. Returns false if the file is not a capture file.
+bool capturefile_read_header(const uint8_t *sector, capture_header_t &header);
+
+// Find the last checkpoint that begins at or before time. Returns the
+// index to the array, or 0 if time is before all the checkpoints.
+// Index can be a pointer or any object with operator[] that returns
+// capture_checkpoint_t.
+template <typename Index>
+size_t capturefile_find_checkpoint(const Index &index, size_t count,
+                                   signaltime_t time)
+{
+    // Find the first checkpoint after time
+    size_t low = 0;
+    size_t high = count;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if ((signaltime_t)index[mid].time <= time)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return (low > 0) ? low - 1 : 0;
+}
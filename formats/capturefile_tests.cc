@@ -0,0 +1,126 @@
+#include "capturefile.hh"
+#include "varint.hh"
+#include "unittests.h"
+#include <string>
+
+static bool store_sector(const uint8_t *sector, void *context)
+{
+    std::string *output = (std::string*)context;
+    output->append((const char*)sector, SectorWriter::sector_size);
+    return true;
+}
+
+static signal_buffer_t buffer;
+
+int main()
+{
+    int status = 0;
+
+    // Fill the buffer with events of varying length and a lost data marker
+    signaltime_t expected_time = 0;
+    for (int i = 0; i < 3000; i++)
+    {
+        signaltime_t duration = (i % 50) * 37 + 1;
+        buffer.bytes += varint_encode(buffer.storage + buffer.bytes,
+                                      (duration << 4) | (i % 16));
+        expected_time += duration;
+
+        if (i == 1000)
+        {
+            buffer.bytes += varint_encode(buffer.storage + buffer.bytes, 0);
+            buffer.bytes += varint_encode(buffer.storage + buffer.bytes, 12345);
+            expected_time += 12345;
+        }
+    }
+    buffer.last_duration = 77;
+    buffer.last_value = 5;
+    expected_time += 77;
+
+    std::string file;
+    uint8_t sector[SectorWriter::sector_size];
+    SectorWriter output(sector, store_sector, &file);
+
+    capture_info_t info = {500000, 1234567890, {"CLK", "DATA", NULL, "A very long channel name"}, 256};
+    TEST(capturefile_write(&output, &buffer, info));
+    TEST((file.size() & 511) == 0);
+
+    {
+        COMMENT("Test header");
+        capture_header_t header;
+        TEST(capturefile_read_header((const uint8_t*)file.data(), header));
+        TEST(header.frequency == 500000);
+        TEST(header.start_timestamp == 1234567890);
+        TEST(header.total_time == (uint64_t)expected_time);
+        TEST(header.data_offset == 512);
+        TEST(header.data_bytes == buffer.bytes + 2);
+        TEST((header.index_offset & 511) == 0);
+        TEST(header.index_offset >= header.data_offset + header.data_bytes);
+        TEST(file.size() == header.index_offset + ((header.index_count * 32 + 511) / 512) * 512);
+        TEST(strcmp(header.channel_names[0], "CLK") == 0);
+        TEST(strcmp(header.channel_names[1], "DATA") == 0);
+        TEST(header.channel_names[2][0] == 0);
+        TEST(strncmp(header.channel_names[3], "A very long chan", 16) == 0);
+
+        COMMENT("Test invalid header");
+        std::string broken = file.substr(0, 512);
+        broken[0] = 'X';
+        TEST(!capturefile_read_header((const uint8_t*)broken.data(), header));
+    }
+
+    {
+        COMMENT("Test data");
+        capture_header_t header;
+        capturefile_read_header((const uint8_t*)file.data(), header);
+        const uint8_t *data = (const uint8_t*)file.data() + header.data_offset;
+        TEST(memcmp(data, buffer.storage, buffer.bytes) == 0);
+
+        signaltime_t duration;
+        signals_t levels;
+        varint_read_record(data, (size_t)buffer.bytes, duration, levels);
+        TEST(duration == 77 && levels == 5);
+    }
+
+    {
+        COMMENT("Test index");
+        capture_header_t header;
+        capturefile_read_header((const uint8_t*)file.data(), header);
+        const uint8_t *data = (const uint8_t*)file.data() + header.data_offset;
+        const capture_checkpoint_t *index =
+            (const capture_checkpoint_t*)(file.data() + header.index_offset);
+        TEST(header.index_count > buffer.bytes / 256);
+        TEST(index[0].offset == 0 && index[0].time == 0 && index[0].levels == 0);
+
+        // Decode the whole data and compare with the checkpoints
+        size_t pos = 0;
+        size_t next = 0;
+        signaltime_t time = 0;
+        signals_t levels = 0;
+        bool all_ok = true;
+        while (pos < header.data_bytes)
+        {
+            if (next < header.index_count && index[next].offset == pos)
+            {
+                if (index[next].time != (uint64_t)time || index[next].levels != levels)
+                    all_ok = false;
+                next++;
+            }
+
+            signaltime_t duration;
+            pos = varint_read_record(data, pos, duration, levels);
+            time += duration;
+        }
+        TEST(all_ok);
+        TEST(next == header.index_count);
+        TEST(time == expected_time);
+
+        COMMENT("Test checkpoint search");
+        size_t count = header.index_count;
+        TEST(capturefile_find_checkpoint(index, count, 0) == 0);
+        TEST(capturefile_find_checkpoint(index, count, index[5].time) == 5);
+        TEST(capturefile_find_checkpoint(index, count, index[5].time - 1) == 4);
+        TEST(capturefile_find_checkpoint(index, count, expected_time * 2) == count - 1);
+        TEST(capturefile_find_checkpoint(index, 0, 100) == 0);
+    }
+
+    return status;
+}
@@ -0,0 +1,208 @@
+/* SignalStream that reads a saved capture file, see capturefile.hh.
+ *
+ * Source provides read access to the file, using file offsets:
+ *   uint8_t operator[](uint64_t offset) const;
+ *   void read(uint64_t offset, void *dest, size_t length) const;
+ *   bool ok() const; // False after a read error
+ * For example SectorCache on the device, or a memory mapped file on the PC.
+ * The stream itself only keeps the current position, and seeks using the
+ * checkpoint index of the file, so the memory usage doesn't depend on the
+ * file size.
+ */
+
+#pragma once
+
+#include "capturefile.hh"
+#include "activityhistogram.hh"
+#include "varint.hh"
+
+template <typename Source>
+class CaptureFileStream: public SignalStream
+{
+public:
+    // The header must have been checked with capturefile_read_header().
+    CaptureFileStream(const Source *source, const capture_header_t &header):
+        data(source, header.data_offset), index(source, header.index_offset),
+        data_bytes(header.data_bytes), index_count(header.index_count),
+        frequency(header.frequency), read_pos(0), previous_event()
+    {
+    }
+
+    virtual ~CaptureFileStream() {};
+
+    virtual void seek(signaltime_t time)
+    {
+        SignalEvent dummy;
+
+        if (index_count > 0)
+        {
+            // Jump to a checkpoint if it is closer than current position
+            capture_checkpoint_t checkpoint =
+                index[capturefile_find_checkpoint(index, index_count, time)];
+            signaltime_t checkpoint_time = checkpoint.time;
+
+            if (time < previous_event.end || checkpoint_time > previous_event.end)
+            {
+                read_pos = checkpoint.offset;
+                previous_event = SignalEvent();
+                previous_event.start = checkpoint_time;
+                previous_event.end = checkpoint_time;
+                previous_event.levels = checkpoint.levels;
+            }
+        }
+
+        while (previous_event.end < time && read_forwards(dummy));
+
+        while (previous_event.end > time && read_backwards(dummy));
+    }
+
+    virtual bool read_forwards(SignalEvent &result)
+    {
+        if (read_pos >= data_bytes || !ok())
+            return false;
+
+        signaltime_t duration;
+        signals_t levels;
+        read_pos = varint_read_record(data, read_pos, duration, levels);
+
+        // The failed bytes read as zeros, which would decode as lost data
+        if (!ok())
+            return false;
+
+        result.start = previous_event.end;
+        result.end = result.start + duration;
+        result.old_levels = previous_event.levels;
+        result.levels = levels;
+
+        previous_event = result;
+        return true;
+    }
+
+    virtual bool read_backwards(SignalEvent &result)
+    {
+        if (read_pos == 0 || !ok())
+            return false;
+
+        signaltime_t duration;
+        signals_t levels;
+        read_pos = varint_read_record_backwards(data, read_pos, duration, levels);
+
+        if (!ok())
+            return false;
+
+        result.end = previous_event.end;
+        result.start = result.end - duration;
+        result.levels = levels;
+
+        // And read the event before that
+        if (read_pos == 0)
+        {
+            previous_event = SignalEvent();
+        }
+        else
+        {
+            varint_read_record_backwards(data, read_pos, duration, levels);
+            previous_event.end = result.start;
+            previous_event.start = result.start - duration;
+            previous_event.levels = levels;
+
+            // Note: the old_levels will not be valid, but it is not used anywhere.
+            previous_event.old_levels = -1;
+        }
+
+        result.old_levels = previous_event.levels;
+        return true;
+    }
+
+    virtual CaptureFileStream* clone() const
+    {
+        return new CaptureFileStream(*this);
+    }
+
+    // Sample rate from the file header
+    virtual frequency_t get_frequency() const { return frequency; }
+
+    // False after a read error, the stream then ends at the failed data.
+    bool ok() const { return data.source->ok(); }
+
+private:
+    // Byte access to the varint data
+    struct DataView
+    {
+        DataView(const Source *source, uint64_t base): source(source), base(base) {}
+
+        uint8_t operator[](uint64_t pos) const { return (*source)[base + pos]; }
+
+        const Source *source;
+        uint64_t base;
+    };
+
+    // Access to the checkpoints
+    struct IndexView
+    {
+        IndexView(const Source *source, uint64_t base): source(source), base(base) {}
+
+        capture_checkpoint_t operator[](size_t i) const
+        {
+            capture_checkpoint_t result;
+            source->read(base + i * sizeof(result), &result, sizeof(result));
+            return result;
+        }
+
+        const Source *source;
+        uint64_t base;
+    };
+
+    DataView data;
+    IndexView index;
+    uint64_t data_bytes;
+    uint64_t index_count;
+    frequency_t frequency;
+
+    uint64_t read_pos; // Next position to be read
+    SignalEvent previous_event; // Event immediately before read_pos
+};
+
+// Fill the histogram with an estimate of the activity in a capture file,
+// without reading through the data. Each event takes about one byte, and
+// the checkpoints are about index_interval bytes apart, so the bytes
+// between checkpoints are spread over the time between them. At most
+// ActivityHistogram::buckets checkpoints are read, whatever the file size.
+template <typename Source>
+void capturefile_estimate_activity(const Source *source,
+                                   const capture_header_t &header,
+                                   ActivityHistogram &histogram)
+{
+    histogram.reset();
+
+    uint64_t points = header.index_count;
+    if (points > ActivityHistogram::buckets)
+        points = ActivityHistogram::buckets;
+
+    capture_checkpoint_t previous = {};
+    for (uint64_t i = 0; i <= points; i++)
+    {
+        capture_checkpoint_t checkpoint = {};
+        if (i < points)
+        {
+            uint64_t index = i * header.index_count / points;
+            source->read(header.index_offset + index * sizeof(checkpoint),
+                         &checkpoint, sizeof(checkpoint));
+        }
+        else
+        {
+            checkpoint.time = header.total_time;
+            checkpoint.offset = header.data_bytes;
+        }
+
+        // Checkpoints at the same time are counted with the next range
+        if (checkpoint.time > previous.time)
+        {
+            histogram.add_range(previous.time, checkpoint.time,
+                                checkpoint.offset - previous.offset);
+            previous = checkpoint;
+        }
+    }
+
+    histogram.set_end(header.total_time);
+}
@@ -0,0 +1,218 @@
+#include "capturestream.hh"
+#include "sectorcache.hh"
+#include "unittests.h"
+#include <string>
+
+static bool store_sector(const uint8_t *sector, void *context)
+{
+    std::string *output = (std::string*)context;
+    output->append((const char*)sector, SectorWriter::sector_size);
+    return true;
+}
+
+static int sector_reads = 0;
+
+static bool read_sector(uint32_t sector, uint8_t *buffer, void *context)
+{
+    const std::string *file = (const std::string*)context;
+    if ((sector + 1) * SectorCache::sector_size > file->size())
+        return false;
+
+    memcpy(buffer, file->data() + sector * SectorCache::sector_size,
+           SectorCache::sector_size);
+    sector_reads++;
+    return true;
+}
+
+static bool same_event(const SignalEvent &a, const SignalEvent &b)
+{
+    return a.start == b.start && a.end == b.end && a.levels == b.levels;
+}
+
+static signal_buffer_t buffer;
+
+int main()
+{
+    int status = 0;
+
+    // Fill the buffer with events of varying length and a lost data marker
+    for (int i = 0; i < 5000; i++)
+    {
+        signaltime_t duration = (i % 50) * 37 + 1;
+        buffer.bytes += varint_encode(buffer.storage + buffer.bytes,
+                                      (duration << 4) | (i % 16));
+        if (i == 1000)
+        {
+            buffer.bytes += varint_encode(buffer.storage + buffer.bytes, 0);
+            buffer.bytes += varint_encode(buffer.storage + buffer.bytes, 12345);
+        }
+    }
+    buffer.last_duration = 77;
+    buffer.last_value = 5;
+
+    std::string file;
+    uint8_t sector[SectorWriter::sector_size];
+    SectorWriter output(sector, store_sector, &file);
+    capture_info_t info = {1000000, 0, {"A", "B", "C", "D"}, 0};
+    capturefile_write(&output, &buffer, info);
+
+    SectorCache cache(read_sector, &file);
+    capture_header_t header;
+    cache.read(0, &header, sizeof(header));
+    TEST(capturefile_read_header((const uint8_t*)&header, header));
+
+    {
+        COMMENT("Test reading the whole file");
+        CaptureFileStream<SectorCache> stream(&cache, header);
+        DSOSignalStream reference(&buffer);
+        SignalEvent a, b;
+        int count = 0;
+        bool all_same = true;
+        while (reference.read_forwards(b))
+        {
+            if (!stream.read_forwards(a) || !same_event(a, b) ||
+                a.old_levels != b.old_levels)
+                all_same = false;
+            count++;
+        }
+        TEST(all_same);
+        TEST(count == 5002);
+        TEST(!stream.read_forwards(a));
+        TEST(a.end == (signaltime_t)header.total_time);
+        TEST(cache.ok());
+        TEST(stream.get_frequency() == 1000000);
+    }
+
+    {
+        COMMENT("Test seeking");
+        CaptureFileStream<SectorCache> stream(&cache, header);
+        DSOSignalStream reference(&buffer);
+        SignalEvent a, b;
+        bool all_same = true;
+        for (signaltime_t time = header.total_time - 1; time >= 0; time -= 9973)
+        {
+            stream.seek(time);
+            reference.seek(time);
+            if (!stream.read_forwards(a) || !reference.read_forwards(b) ||
+                !same_event(a, b) || a.start > time || a.end <= time)
+                all_same = false;
+        }
+        TEST(all_same);
+
+        COMMENT("Test seek to the end and beyond");
+        stream.seek(header.total_time - 1);
+        TEST(stream.read_forwards(a) && a.levels == 5 && a.end == (signaltime_t)header.total_time);
+        stream.seek(header.total_time + 100);
+        TEST(!stream.read_forwards(a));
+
+        COMMENT("Test seek to the beginning");
+        stream.seek(0);
+        TEST(stream.read_forwards(a) && a.start == 0 && a.end == 1 && a.levels == 0);
+    }
+
+    {
+        COMMENT("Test reading backwards");
+        CaptureFileStream<SectorCache> stream(&cache, header);
+        DSOSignalStream reference(&buffer);
+        SignalEvent a, b;
+        stream.seek(1000000);
+        reference.seek(1000000);
+        bool all_same = true;
+        for (int i = 0; i < 2000; i++)
+        {
+            bool ok_a = stream.read_backwards(a);
+            bool ok_b = reference.read_backwards(b);
+            if (ok_a != ok_b ||
+                (ok_b && (!same_event(a, b) || a.old_levels != b.old_levels)))
+                all_same = false;
+        }
+        TEST(all_same);
+
+        COMMENT("Test reading backwards over the lost data marker");
+        stream.seek(0);
+        for (int i = 0; i < 1003; i++)
+            stream.read_forwards(a);
+        // Events 0 to 1000, the marker and event 1001
+        const signals_t levels_999 = 999 & 15;
+        const signals_t levels_1000 = 1000 & 15;
+        const signals_t levels_1001 = 1001 & 15;
+        TEST(a.levels == levels_1001 && a.old_levels == SIGNALS_LOST);
+        TEST(stream.read_backwards(a) && a.levels == levels_1001);
+        TEST(stream.read_backwards(a) && a.levels == SIGNALS_LOST && a.end - a.start == 12345);
+        TEST(stream.read_backwards(a) && a.levels == levels_1000 && a.old_levels == levels_999);
+    }
+
+    {
+        COMMENT("Test cache efficiency");
+        CaptureFileStream<SectorCache> stream(&cache, header);
+        SignalEvent a;
+        sector_reads = 0;
+        cache.invalidate();
+        stream.seek(header.total_time / 2);
+        int seek_reads = sector_reads;
+        for (int i = 0; i < 100; i++)
+            stream.read_forwards(a);
+        printf("Sector reads for seek: %d, for 100 events: %d\n",
+               seek_reads, sector_reads - seek_reads);
+        TEST(seek_reads < 16);
+        TEST(sector_reads - seek_reads <= 2);
+    }
+
+    {
+        COMMENT("Test read error");
+        std::string truncated = file.substr(0, 1024);
+        SectorCache cache2(read_sector, &truncated);
+        CaptureFileStream<SectorCache> stream(&cache2, header);
+        stream.seek(header.total_time / 2);
+        TEST(!cache2.ok() && !stream.ok());
+
+        // The stream ends instead of returning the zeros as lost data
+        SignalEvent event;
+        TEST(!stream.read_forwards(event) && !stream.read_backwards(event));
+    }
+
+    {
+        COMMENT("Test estimating the activity from the index");
+        // Two bursts of short events with a long idle period between
+        static signal_buffer_t bursts;
+        for (int i = 0; i < 16000; i++)
+        {
+            signaltime_t duration = (i == 8000) ? 1000000 : 2;
+            bursts.bytes += varint_encode(bursts.storage + bursts.bytes,
+                                          (duration << 4) | (i & 1));
+        }
+
+        std::string burst_file;
+        SectorWriter output2(sector, store_sector, &burst_file);
+        capture_info_t info2 = {500000, 0, {"A", "B", "C", "D"}, 64};
+        capturefile_write(&output2, &bursts, info2);
+
+        SectorCache cache2(read_sector, &burst_file);
+        capture_header_t header2;
+        cache2.read(0, &header2, sizeof(header2));
+        TEST(capturefile_read_header((const uint8_t*)&header2, header2));
+
+        sector_reads = 0;
+        ActivityHistogram histogram;
+        capturefile_estimate_activity(&cache2, header2, histogram);
+        // Only the index is read, not the data
+        uint64_t index_sectors = (header2.index_count * sizeof(capture_checkpoint_t)
+                                  + SectorCache::sector_size - 1) / SectorCache::sector_size;
+        printf("Sector reads: %d, index: %d checkpoints in %d sectors\n",
+               sector_reads, (int)header2.index_count, (int)index_sectors);
+        TEST(header2.index_count > ActivityHistogram::buckets);
+        TEST(sector_reads <= (int)index_sectors);
+
+        signaltime_t end = header2.total_time;
+        signaltime_t width = histogram.bucket_width();
+        TEST(histogram.get_end() == end);
+        TEST(histogram.get_count(0) > 1000);
+        TEST(histogram.get_count((end - 1) / width) > 1000);
+        TEST(histogram.get_count(end / 2 / width) * 100 < histogram.get_count(0));
+
+        uint32_t sum = histogram.get_sum(0, end);
+        TEST(sum <= header2.data_bytes && sum > header2.data_bytes * 9 / 10);
+    }
+
+    return status;
+}
@@ -0,0 +1,142 @@
+#include "capturestreamer.hh"
+#include "crc32.hh"
+#include "varint.hh"
+
+// Start time in the DATA frames
+static const size_t data_header_size = 8;
+
+CaptureStreamer::CaptureStreamer(const signal_buffer_t *buffer):
+    buffer(buffer), head(0), tail(0), sent(0), time(0), sequence(0)
+{
+}
+
+size_t CaptureStreamer::space() const
+{
+    return (tail - head - 1) & (queue_size - 1);
+}
+
+void CaptureStreamer::put(uint8_t byte)
+{
+    queue[head] = byte;
+    head = (head + 1) & (queue_size - 1);
+}
+
+void CaptureStreamer::put_le(uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        put(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+static void write_le(uint8_t *p, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        p[i] = value & 0xFF;
+        value >>= 8;
+    }
+}
+
+void CaptureStreamer::put_frame(streamframe_type_t type,
+                                const uint8_t *header, size_t header_length,
+                                const uint8_t *data, size_t data_length)
+{
+    uint8_t frame_header[4];
+    frame_header[0] = type;
+    frame_header[1] = header_length + data_length;
+    write_le(frame_header + 2, sequence++, 2);
+
+    uint32_t crc = crc32_update(0, frame_header, 4);
+    crc = crc32_update(crc, header, header_length);
+    crc = crc32_update(crc, data, data_length);
+
+    put(STREAMFRAME_SYNC1);
+    put(STREAMFRAME_SYNC2);
+    for (int i = 0; i < 4; i++)
+        put(frame_header[i]);
+    for (size_t i = 0; i < header_length; i++)
+        put(header[i]);
+    for (size_t i = 0; i < data_length; i++)
+        put(data[i]);
+    put_le(crc, 4);
+}
+
+void CaptureStreamer::start(frequency_t frequency)
+{
+    sent = 0;
+    time = 0;
+
+    uint8_t payload[4];
+    write_le(payload, frequency, 4);
+    put_frame(STREAMFRAME_START, payload, sizeof(payload), NULL, 0);
+}
+
+bool CaptureStreamer::poll()
+{
+    const size_t overhead = STREAMFRAME_HEADER_SIZE + data_header_size + STREAMFRAME_CRC_SIZE;
+    size_t room = space();
+    if (room <= overhead)
+        return false;
+
+    size_t limit = room - overhead;
+    if (limit > STREAMFRAME_MAX_PAYLOAD - data_header_size)
+        limit = STREAMFRAME_MAX_PAYLOAD - data_header_size;
+
+    // Take only complete records, so that the receiver can continue
+    // after a lost frame.
+    size_t end = buffer->bytes;
+    size_t pos = sent;
+    signaltime_t end_time = time;
+    while (pos < end)
+    {
+        uint64_t value;
+        size_t next = varint_decode_forwards(buffer->storage, pos, value);
+        signaltime_t duration = value >> 4;
+        if (value == 0)
+        {
+            // The interrupt may not have written the length of the
+            // lost data marker yet.
+            if (next >= end)
+                break;
+            next = varint_decode_forwards(buffer->storage, next, value);
+            duration = value;
+        }
+
+        if (next - sent > limit)
+            break;
+
+        pos = next;
+        end_time += duration;
+    }
+
+    if (pos == sent)
+        return false;
+
+    uint8_t header[data_header_size];
+    write_le(header, time, data_header_size);
+    put_frame(STREAMFRAME_DATA, header, sizeof(header),
+              buffer->storage + sent, pos - sent);
+
+    sent = pos;
+    time = end_time;
+    return true;
+}
+
+bool CaptureStreamer::finish()
+{
+    while (poll());
+
+    const size_t payload_size = 8 + 8 + 2;
+    if (sent != buffer->bytes ||
+        space() < STREAMFRAME_HEADER_SIZE + payload_size + STREAMFRAME_CRC_SIZE)
+        return false;
+
+    uint8_t payload[payload_size];
+    write_le(payload, time, 8);
+    write_le(payload + 8, buffer->last_duration, 8);
+    write_le(payload + 16, buffer->last_value, 2);
+    put_frame(STREAMFRAME_END, payload, sizeof(payload), NULL, 0);
+    return true;
+}
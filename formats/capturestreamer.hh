@@ -0,0 +1,70 @@
+/* Sends the live capture over a serial port while the capture continues.
+ *
+ * The main loop calls poll(), which packs the bytes appended to the
+ * signal_buffer since the previous call into frames (see streamframe.hh)
+ * and puts them in a transmit queue. The transmit interrupt takes the
+ * bytes with get_byte(). Once the data has been sent, it can be removed
+ * from the signal_buffer with capture_discard(), so the length of the
+ * capture is not limited by the size of the buffer.
+ */
+
+#pragma once
+
+#include "dsosignalstream.hh"
+#include "streamframe.hh"
+
+class CaptureStreamer
+{
+public:
+    static const size_t queue_size = 1024; // Power of 2
+
+    CaptureStreamer(const signal_buffer_t *buffer);
+
+    // Begin a new stream from the start of the buffer. Must be called
+    // when idle() returns true.
+    void start(frequency_t frequency);
+
+    // Queue a frame of new data if there is room for it.
+    // Returns true if a frame was queued.
+    bool poll();
+
+    // Queue the end frame once all the data is queued. The capture
+    // interrupt must not run during the call. Returns false if it has
+    // to be called again later.
+    bool finish();
+
+    // Get the next byte to transmit. Called from the interrupt.
+    bool get_byte(uint8_t &byte)
+    {
+        if (tail == head)
+            return false;
+
+        byte = queue[tail];
+        tail = (tail + 1) & (queue_size - 1);
+        return true;
+    }
+
+    bool idle() const { return tail == head; }
+
+    // Number of bytes from the start of the buffer that have been queued.
+    size_t bytes_queued() const { return sent; }
+
+    // Tell that the first bytes were removed from the buffer.
+    void discard(size_t bytes) { sent -= bytes; }
+
+private:
+    const signal_buffer_t *buffer;
+    uint8_t queue[queue_size];
+    volatile size_t head; // Written by poll()
+    volatile size_t tail; // Written by get_byte()
+
+    size_t sent;
+    signaltime_t time; // Time at the position 'sent'
+    uint16_t sequence;
+
+    size_t space() const;
+    void put(uint8_t byte);
+    void put_le(uint64_t value, int bytes);
+    void put_frame(streamframe_type_t type, const uint8_t *header, size_t header_length,
+                   const uint8_t *data, size_t data_length);
+};
@@ -0,0 +1,92 @@
+#include "crc32.hh"
+
+// 4 bits at a time, to keep the table small in flash
+static const uint32_t crc_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+static inline uint32_t crc_byte(uint32_t c, uint8_t byte)
+{
+    c ^= byte;
+    c = (c >> 4) ^ crc_table[c & 15];
+    c = (c >> 4) ^ crc_table[c & 15];
+    return c;
+}
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    uint32_t c = ~crc;
+    while (length--)
+        c = crc_byte(c, *p++);
+    return ~c;
+}
+
+// The CRC register is a 32-bit vector over GF(2), and processing a zero
+// byte is a linear map L. A 32x32 matrix is stored as its columns.
+static uint32_t matrix_times(const uint32_t *matrix, uint32_t vector)
+{
+    uint32_t result = 0;
+    for (int i = 0; vector; i++, vector >>= 1)
+    {
+        if (vector & 1)
+            result ^= matrix[i];
+    }
+    return result;
+}
+
+static void matrix_multiply(uint32_t *result, const uint32_t *a, const uint32_t *b)
+{
+    for (int i = 0; i < 32; i++)
+        result[i] = matrix_times(a, b[i]);
+}
+
+// Below this, the plain loop is faster than the matrix squarings.
+static const uint64_t repeat_threshold = 2048;
+
+uint32_t crc32_repeat(uint32_t crc, uint8_t byte, uint64_t count)
+{
+    uint32_t c = ~crc;
+
+    if (count < repeat_threshold)
+    {
+        while (count--)
+            c = crc_byte(c, byte);
+        return ~c;
+    }
+
+    // Processing byte b is R' = L(R) ^ L(b), so after n bytes
+    // R = L^n(R) ^ G_n(L(b)), where G_n = I + L + ... + L^(n-1).
+    // Powers = L^(2^k) and sums = G_(2^k) are found by squaring:
+    // L^2m = L^m L^m, G_2m = G_m + L^m G_m.
+    uint32_t power[32], sum[32], temp[32];
+    for (int i = 0; i < 32; i++)
+    {
+        power[i] = crc_byte(1UL << i, 0);
+        sum[i] = 1UL << i;
+    }
+
+    uint32_t v = crc_byte(byte, 0);
+    for (;;)
+    {
+        if (count & 1)
+            c = matrix_times(power, c) ^ matrix_times(sum, v);
+
+        count >>= 1;
+        if (!count)
+            break;
+
+        matrix_multiply(temp, power, sum);
+        for (int i = 0; i < 32; i++)
+            sum[i] ^= temp[i];
+
+        matrix_multiply(temp, power, power);
+        for (int i = 0; i < 32; i++)
+            power[i] = temp[i];
+    }
+
+    return ~c;
+}
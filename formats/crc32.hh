@@ -0,0 +1,18 @@
+/* CRC-32 as used by ZIP and zlib (polynomial 0xEDB88320, reflected).
+ *
+ * The functions take the CRC of the previous data, so that a file can be
+ * processed in pieces: start from 0, and the result of the last call is
+ * the CRC of the whole file.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t length);
+
+// CRC of count copies of the same byte. Long runs are computed in
+// O(log count) time, which matters when expanding long idle periods of
+// the capture to one byte per sample.
+uint32_t crc32_repeat(uint32_t crc, uint8_t byte, uint64_t count);
@@ -0,0 +1,41 @@
+#include "crc32.hh"
+#include "unittests.h"
+#include <string>
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test the standard check value");
+        TEST(crc32_update(0, "123456789", 9) == 0xCBF43926);
+        TEST(crc32_update(0, "", 0) == 0);
+    }
+
+    {
+        COMMENT("Test processing in pieces");
+        uint32_t crc = crc32_update(0, "1234", 4);
+        crc = crc32_update(crc, "56789", 5);
+        TEST(crc == 0xCBF43926);
+    }
+
+    {
+        COMMENT("Test repeated bytes against the plain loop");
+        static const uint64_t counts[] = {0, 1, 5, 2047, 2048, 2049, 65536, 1000003};
+        bool all_ok = true;
+        for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+        {
+            std::string data(counts[i], (char)0xA5);
+            uint32_t prefix = crc32_update(0, "abc", 3);
+            uint32_t expected = crc32_update(prefix, data.data(), data.size());
+            if (crc32_repeat(prefix, 0xA5, counts[i]) != expected)
+                all_ok = false;
+        }
+        TEST(all_ok);
+
+        std::string zeros(100000, 0);
+        TEST(crc32_repeat(0, 0, 100000) == crc32_update(0, zeros.data(), zeros.size()));
+    }
+
+    return status;
+}
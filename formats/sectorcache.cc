@@ -0,0 +1,71 @@
+#include "sectorcache.hh"
+
+SectorCache::SectorCache(read_t read, void *context)
+{
+    this->read_cb = read;
+    this->context = context;
+    invalidate();
+}
+
+void SectorCache::invalidate()
+{
+    for (int i = 0; i < slots; i++)
+        cache[i].valid = false;
+
+    counter = 0;
+    status = true;
+    last_sector = 0xFFFFFFFF;
+    last_data = NULL;
+}
+
+const uint8_t *SectorCache::get(uint32_t sector) const
+{
+    slot_t *victim = &cache[0];
+    for (int i = 0; i < slots; i++)
+    {
+        slot_t *slot = &cache[i];
+        if (slot->valid && slot->sector == sector)
+        {
+            slot->last_used = ++counter;
+            last_sector = sector;
+            last_data = slot->data;
+            return slot->data;
+        }
+
+        if (!slot->valid || (victim->valid && slot->last_used < victim->last_used))
+            victim = slot;
+    }
+
+    if (!read_cb(sector, victim->data, context))
+    {
+        status = false;
+        memset(victim->data, 0, sector_size);
+        victim->valid = false;
+        return victim->data;
+    }
+
+    victim->sector = sector;
+    victim->valid = true;
+    victim->last_used = ++counter;
+    last_sector = sector;
+    last_data = victim->data;
+    return victim->data;
+}
+
+void SectorCache::read(uint64_t offset, void *dest, size_t length) const
+{
+    uint8_t *p = (uint8_t*)dest;
+    while (length > 0)
+    {
+        uint32_t sector = offset / sector_size;
+        size_t start = offset % sector_size;
+        size_t count = sector_size - start;
+        if (count > length)
+            count = length;
+
+        memcpy(p, get(sector) + start, count);
+        p += count;
+        offset += count;
+        length -= count;
+    }
+}
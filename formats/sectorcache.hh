@@ -0,0 +1,62 @@
+/* Small LRU cache of file sectors, for random access to files that can
+ * only be read a sector at a time. The memory usage is fixed, so files
+ * much larger than the RAM can be browsed.
+ *
+ * Read errors are sticky: the failed bytes read as 0 and ok() returns
+ * false.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+
+class SectorCache
+{
+public:
+    static const size_t sector_size = 512;
+    static const int slots = 4;
+
+    // Read the sector with the given index. Return false on error.
+    typedef bool (*read_t)(uint32_t sector, uint8_t *buffer, void *context);
+
+    SectorCache(read_t read, void *context = NULL);
+
+    // Byte access with file offsets
+    uint8_t operator[](uint64_t offset) const
+    {
+        uint32_t sector = offset / sector_size;
+        const uint8_t *data = (sector == last_sector) ? last_data : get(sector);
+        return data[offset % sector_size];
+    }
+
+    // Copy bytes from the file
+    void read(uint64_t offset, void *dest, size_t length) const;
+
+    // Drop all cached sectors and clear the error status, e.g. after
+    // opening another file.
+    void invalidate();
+
+    bool ok() const { return status; }
+
+private:
+    struct slot_t
+    {
+        uint32_t sector;
+        uint32_t last_used;
+        bool valid;
+        uint8_t data[sector_size];
+    };
+
+    read_t read_cb;
+    void *context;
+
+    // The cache is filled from the const accessors
+    mutable slot_t cache[slots];
+    mutable uint32_t counter;
+    mutable uint32_t last_sector;
+    mutable const uint8_t *last_data;
+    mutable bool status;
+
+    const uint8_t *get(uint32_t sector) const;
+};
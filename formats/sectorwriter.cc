@@ -0,0 +1,83 @@
+#include "sectorwriter.hh"
+
+SectorWriter::SectorWriter(uint8_t *buffer, flush_t flush, void *context)
+{
+    this->buffer = buffer;
+    this->flush_cb = flush;
+    this->context = context;
+    pos = 0;
+    sectors = 0;
+    status = true;
+}
+
+void SectorWriter::flush()
+{
+    if (status && !flush_cb(buffer, context))
+        status = false;
+
+    sectors++;
+    pos = 0;
+}
+
+void SectorWriter::put_string(const char *str)
+{
+    while (*str)
+        put(*str++);
+}
+
+void SectorWriter::put_uint(uint64_t value)
+{
+    char digits[20];
+    int count = 0;
+
+    // 64-bit division is a library call on Cortex-M3, so use it only
+    // for the digits that don't fit in 32 bits.
+    while (value > 0xFFFFFFFF)
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    }
+
+    uint32_t value32 = value;
+    do {
+        digits[count++] = '0' + value32 % 10;
+        value32 /= 10;
+    } while (value32);
+
+    while (count > 0)
+        put(digits[--count]);
+}
+
+void SectorWriter::put_bytes(const void *data, size_t length)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    while (length > 0)
+    {
+        size_t count = sector_size - pos;
+        if (count > length)
+            count = length;
+
+        memcpy(buffer + pos, p, count);
+        pos += count;
+        p += count;
+        length -= count;
+
+        if (pos == sector_size)
+            flush();
+    }
+}
+
+void SectorWriter::align(char padding)
+{
+    if (pos != 0)
+    {
+        memset(buffer + pos, padding, sector_size - pos);
+        flush();
+    }
+}
+
+bool SectorWriter::finish(char padding)
+{
+    align(padding);
+    return status;
+}
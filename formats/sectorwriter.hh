@@ -0,0 +1,65 @@
+/* Output buffer for writing files one sector at a time.
+ *
+ * The file formats write directly into the sector buffer, which on the
+ * device is the same buffer that the BIOS file functions use. When the
+ * sector is full, it is passed to the flush callback. This avoids the
+ * per-character overhead of _fputc() and the printf machinery.
+ *
+ * Errors are sticky: after a failed flush, further writes are ignored and
+ * ok() returns false.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+
+class SectorWriter
+{
+public:
+    static const size_t sector_size = 512;
+
+    // Write a complete sector to the file. Return false on error.
+    typedef bool (*flush_t)(const uint8_t *sector, void *context);
+
+    // Buffer must have room for sector_size bytes.
+    SectorWriter(uint8_t *buffer, flush_t flush, void *context = NULL);
+
+    void put(char c)
+    {
+        buffer[pos++] = c;
+        if (pos == sector_size)
+            flush();
+    }
+
+    void put_string(const char *str);
+
+    void put_bytes(const void *data, size_t length);
+
+    // Pad the current sector with given character, so that the next write
+    // begins at a sector boundary.
+    void align(char padding);
+
+    // Write unsigned integer in decimal.
+    void put_uint(uint64_t value);
+
+    // Pad the last sector with given character and write it out.
+    // Returns true if all the writes succeeded.
+    bool finish(char padding = ' ');
+
+    bool ok() const { return status; }
+    uint32_t sectors_written() const { return sectors; }
+
+    // Number of bytes written so far, including the current sector.
+    uint64_t position() const { return (uint64_t)sectors * sector_size + pos; }
+
+private:
+    uint8_t *buffer;
+    flush_t flush_cb;
+    void *context;
+    size_t pos;
+    uint32_t sectors;
+    bool status;
+
+    void flush();
+};
@@ -0,0 +1,355 @@
+#include "sigrokwriter.hh"
+#include "crc32.hh"
+#include <stdio.h>
+
+// DOS date of 1980-01-01, as the device has no clock
+static const uint16_t zip_date = (1 << 5) | 1;
+
+static const uint16_t ZIP_DATA_DESCRIPTOR = 0x08;
+static const uint16_t ZIP_STORED = 0;
+static const uint16_t ZIP_DEFLATED = 8;
+
+// Longest deflate match, and the maximum chunk size once all chunks are used.
+static const int max_match = 258;
+static const uint32_t max_chunk_samples = 0xFFFF0000;
+
+SigrokWriter::SigrokWriter(SectorWriter *output, uint32_t chunk_samples):
+    output(output), chunk_samples(chunk_samples), overflow(false),
+    entry_count(0), chunk_open(false), data_start(0), samples(0),
+    previous(-1), bitbuf(0), bitcount(0)
+{
+}
+
+void SigrokWriter::put_le16(uint16_t value)
+{
+    output->put(value & 0xFF);
+    output->put(value >> 8);
+}
+
+void SigrokWriter::put_le32(uint32_t value)
+{
+    put_le16(value & 0xFFFF);
+    put_le16(value >> 16);
+}
+
+void SigrokWriter::entry_name(char *buffer, int index)
+{
+    if (index == 0)
+        strcpy(buffer, "version");
+    else if (index == 1)
+        strcpy(buffer, "metadata");
+    else
+        sprintf(buffer, "logic-1-%d", index - 1);
+}
+
+void SigrokWriter::write_local_header(int index)
+{
+    const entry_t &entry = entries[index];
+    char name[16];
+    entry_name(name, index);
+
+    put_le32(0x04034b50);
+    put_le16(20); // Version needed: 2.0
+    put_le16(entry.flags);
+    put_le16(entry.method);
+    put_le16(0); // Time
+    put_le16(zip_date);
+    put_le32(entry.crc);
+    put_le32(entry.compressed);
+    put_le32(entry.size);
+    put_le16(strlen(name));
+    put_le16(0); // Extra field length
+    output->put_string(name);
+}
+
+void SigrokWriter::write_stored(const char *text, size_t length)
+{
+    entry_t &entry = entries[entry_count];
+    entry.offset = output->position();
+    entry.crc = crc32_update(0, text, length);
+    entry.compressed = length;
+    entry.size = length;
+    entry.flags = 0;
+    entry.method = ZIP_STORED;
+
+    write_local_header(entry_count++);
+    output->put_bytes(text, length);
+}
+
+void SigrokWriter::write_header(frequency_t samplerate, const char *const *channel_names)
+{
+    static const char *const default_names[channels] = {
+        "ChannelA", "ChannelB", "ChannelC", "ChannelD"
+    };
+
+    const char *names[channels];
+    for (int i = 0; i < channels; i++)
+    {
+        if (channel_names && channel_names[i] && channel_names[i][0])
+            names[i] = channel_names[i];
+        else
+            names[i] = default_names[i];
+    }
+
+    write_stored("2", 1);
+
+    char metadata[256];
+    const char *unit = "Hz";
+    if (samplerate % 1000000 == 0)
+    {
+        samplerate /= 1000000;
+        unit = "MHz";
+    }
+    else if (samplerate % 1000 == 0)
+    {
+        samplerate /= 1000;
+        unit = "kHz";
+    }
+
+    int length = snprintf(metadata, sizeof(metadata),
+        "[global]\n"
+        "sigrok version=0.5.1\n"
+        "\n"
+        "[device 1]\n"
+        "capturefile=logic-1\n"
+        "total probes=%d\n"
+        "samplerate=%lu %s\n"
+        "total analog=0\n"
+        "probe1=%s\n"
+        "probe2=%s\n"
+        "probe3=%s\n"
+        "probe4=%s\n"
+        "unitsize=1\n",
+        channels, (unsigned long)samplerate, unit,
+        names[0], names[1], names[2], names[3]);
+
+    if (length >= (int)sizeof(metadata))
+        length = sizeof(metadata) - 1;
+
+    write_stored(metadata, length);
+}
+
+void SigrokWriter::begin_chunk()
+{
+    entry_t &entry = entries[entry_count];
+    entry.offset = output->position();
+    entry.crc = 0;
+    entry.compressed = 0;
+    entry.size = 0;
+    entry.flags = ZIP_DATA_DESCRIPTOR;
+    entry.method = ZIP_DEFLATED;
+
+    // The sizes and the CRC are in the data descriptor after the data
+    write_local_header(entry_count++);
+
+    data_start = output->position();
+    samples = 0;
+    previous = -1;
+    chunk_open = true;
+
+    // One final block with fixed Huffman codes
+    put_bits(1, 1);
+    put_bits(1, 2);
+}
+
+void SigrokWriter::end_chunk()
+{
+    put_symbol(256); // End of block
+    if (bitcount > 0)
+        put_bits(0, 8 - bitcount);
+
+    entry_t &entry = entries[entry_count - 1];
+    entry.compressed = output->position() - data_start;
+    entry.size = samples;
+
+    put_le32(0x08074b50);
+    put_le32(entry.crc);
+    put_le32(entry.compressed);
+    put_le32(entry.size);
+
+    chunk_open = false;
+}
+
+// Deflate packs the bits starting from the least significant bit.
+void SigrokWriter::put_bits(uint32_t value, int count)
+{
+    bitbuf |= value << bitcount;
+    bitcount += count;
+    while (bitcount >= 8)
+    {
+        output->put(bitbuf & 0xFF);
+        bitbuf >>= 8;
+        bitcount -= 8;
+    }
+}
+
+// Write a literal/length symbol using the fixed Huffman code.
+// Huffman codes are stored starting from the most significant bit.
+void SigrokWriter::put_symbol(int symbol)
+{
+    uint32_t code;
+    int length;
+    if (symbol < 144)
+    {
+        code = 0x30 + symbol;
+        length = 8;
+    }
+    else if (symbol < 256)
+    {
+        code = 0x190 + symbol - 144;
+        length = 9;
+    }
+    else if (symbol < 280)
+    {
+        code = symbol - 256;
+        length = 7;
+    }
+    else
+    {
+        code = 0xC0 + symbol - 280;
+        length = 8;
+    }
+
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++)
+    {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+
+    put_bits(reversed, length);
+}
+
+// Repeat the previous byte, length is 3 to 258.
+void SigrokWriter::put_match(int length)
+{
+    static const uint16_t base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+
+    int i = 28;
+    while (base[i] > length)
+        i--;
+
+    put_symbol(257 + i);
+    if (i >= 8 && i < 28)
+        put_bits(length - base[i], (i - 4) / 4);
+
+    put_bits(0, 5); // Distance code 0 = 1 byte back
+}
+
+void SigrokWriter::write_samples(signals_t levels, uint64_t count)
+{
+    uint8_t sample = (levels == SIGNALS_LOST) ? 0 : (levels & 0x0F);
+
+    while (count > 0 && !overflow)
+    {
+        if (!chunk_open)
+            begin_chunk();
+
+        uint32_t limit = chunk_samples;
+        if (entry_count == max_chunks + 2)
+            limit = max_chunk_samples;
+
+        if (samples >= limit)
+        {
+            if (entry_count == max_chunks + 2)
+                overflow = true;
+            else
+                end_chunk();
+            continue;
+        }
+
+        uint32_t n = limit - samples;
+        if (n > count)
+            n = count;
+
+        entry_t &entry = entries[entry_count - 1];
+        entry.crc = crc32_repeat(entry.crc, sample, n);
+        samples += n;
+        count -= n;
+
+        if (previous != sample)
+        {
+            put_symbol(sample);
+            previous = sample;
+            n--;
+        }
+
+        while (n >= 3)
+        {
+            int length = (n > (uint32_t)max_match) ? max_match : n;
+            put_match(length);
+            n -= length;
+        }
+
+        while (n--)
+            put_symbol(sample);
+    }
+}
+
+bool SigrokWriter::finish()
+{
+    if (chunk_open)
+        end_chunk();
+
+    uint64_t directory_start = output->position();
+    for (int i = 0; i < entry_count; i++)
+    {
+        const entry_t &entry = entries[i];
+        char name[16];
+        entry_name(name, i);
+
+        put_le32(0x02014b50);
+        put_le16(20); // Version made by
+        put_le16(20); // Version needed
+        put_le16(entry.flags);
+        put_le16(entry.method);
+        put_le16(0); // Time
+        put_le16(zip_date);
+        put_le32(entry.crc);
+        put_le32(entry.compressed);
+        put_le32(entry.size);
+        put_le16(strlen(name));
+        put_le16(0); // Extra field length
+        put_le16(0); // Comment length
+        put_le16(0); // Disk number
+        put_le16(0); // Internal attributes
+        put_le32(0); // External attributes
+        put_le32(entry.offset);
+        output->put_string(name);
+    }
+
+    uint64_t directory_end = output->position();
+
+    // The comment covers the padding of the last sector
+    const size_t end_record_size = 22;
+    size_t padding = (SectorWriter::sector_size -
+        (directory_end + end_record_size) % SectorWriter::sector_size)
+        % SectorWriter::sector_size;
+
+    put_le32(0x06054b50);
+    put_le16(0); // Disk number
+    put_le16(0); // Disk with the directory
+    put_le16(entry_count);
+    put_le16(entry_count);
+    put_le32(directory_end - directory_start);
+    put_le32(directory_start);
+    put_le16(padding);
+
+    bool status = output->finish(' ');
+    return status && !overflow && directory_end <= 0xFFFFFFFF;
+}
+
+bool SigrokWriter::write_stream(SignalStream &stream, frequency_t samplerate,
+                                const char *const *channel_names)
+{
+    write_header(samplerate, channel_names);
+
+    SignalEvent event;
+    while (stream.read_forwards(event) && output->ok())
+        write_samples(event.levels, event.end - event.start);
+
+    return finish();
+}
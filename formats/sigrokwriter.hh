@@ -0,0 +1,88 @@
+/* Writer for sigrok session files (.sr), which PulseView can open directly.
+ *
+ * A session file is a ZIP archive with a "version" file, an INI-style
+ * "metadata" file and the samples in files logic-1-1, logic-1-2, ...
+ * Each sample is one byte with the 4 channels in the low bits.
+ *
+ * The samples are expanded from the events as they are written. Each
+ * chunk is compressed with deflate, using only the fixed Huffman codes and
+ * matches at distance 1, which is a run-length encoding of the samples.
+ * A long idle period costs 13 bits per 258 samples, and the samples
+ * never exist in memory.
+ *
+ * Lost data is written as all channels low, as sigrok has no way to mark
+ * it. The ZIP comment is used to fill the rest of the last sector, so
+ * that the padding is part of a valid archive.
+ */
+
+#pragma once
+
+#include "sectorwriter.hh"
+#include "signalstream.hh"
+
+class SigrokWriter
+{
+public:
+    static const int channels = 4;
+    static const int max_chunks = 16;
+
+    // Chunk_samples is the number of samples in each logic-1-N file.
+    // After max_chunks, the last chunk grows up to the 4 GB ZIP limit.
+    SigrokWriter(SectorWriter *output, uint32_t chunk_samples = 1UL << 26);
+
+    // Write the version and metadata files. Channel_names or any of the
+    // names may be NULL or empty for the default names.
+    void write_header(frequency_t samplerate, const char *const *channel_names);
+
+    // Append count samples with the given levels.
+    void write_samples(signals_t levels, uint64_t count);
+
+    // Write the ZIP central directory and the last sector.
+    // Returns true if all writes succeeded and all samples fit.
+    bool finish();
+
+    // Write all events from the current position of the stream.
+    bool write_stream(SignalStream &stream, frequency_t samplerate,
+                      const char *const *channel_names = NULL);
+
+private:
+    struct entry_t
+    {
+        uint32_t offset; // Position of the local header
+        uint32_t crc;
+        uint32_t compressed;
+        uint32_t size;
+        uint16_t flags;
+        uint16_t method;
+    };
+
+    SectorWriter *output;
+    uint32_t chunk_samples;
+    bool overflow; // Too many samples
+
+    entry_t entries[max_chunks + 2];
+    int entry_count;
+
+    // State of the current chunk
+    bool chunk_open;
+    uint64_t data_start;
+    uint32_t samples;
+    int previous; // Last sample written, -1 at the start of the chunk
+
+    // Deflate bit buffer
+    uint32_t bitbuf;
+    int bitcount;
+
+    void entry_name(char *buffer, int index);
+    void write_local_header(int index);
+    void write_stored(const char *text, size_t length);
+
+    void begin_chunk();
+    void end_chunk();
+    void put_bits(uint32_t value, int count);
+    void put_symbol(int symbol);
+    void put_match(int length);
+
+    void put_le16(uint16_t value);
+    void put_le32(uint32_t value);
+};
@@ -0,0 +1,290 @@
+#include "sigrokwriter.hh"
+#include "crc32.hh"
+#include "testsignalstream.hh"
+#include "unittests.h"
+#include <string>
+#include <vector>
+
+static bool store_sector(const uint8_t *sector, void *context)
+{
+    std::string *output = (std::string*)context;
+    output->append((const char*)sector, SectorWriter::sector_size);
+    return true;
+}
+
+static uint32_t le16(const std::string &s, size_t pos)
+{
+    return (uint8_t)s[pos] | ((uint8_t)s[pos + 1] << 8);
+}
+
+static uint32_t le32(const std::string &s, size_t pos)
+{
+    return le16(s, pos) | (le16(s, pos + 2) << 16);
+}
+
+// Minimal inflate for blocks with fixed Huffman codes
+class Inflater
+{
+public:
+    Inflater(const std::string &data): data(data), bitpos(0) {}
+
+    bool inflate(std::string &result)
+    {
+        if (bits(1) != 1 || bits(2) != 1)
+            return false;
+
+        for (;;)
+        {
+            int symbol = read_symbol();
+            if (symbol < 256)
+            {
+                result += (char)symbol;
+            }
+            else if (symbol == 256)
+            {
+                return true;
+            }
+            else
+            {
+                static const int base[29] = {
+                    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+                };
+                int i = symbol - 257;
+                int length = base[i];
+                if (i >= 8 && i < 28)
+                    length += bits((i - 4) / 4);
+
+                int distance_code = reverse(bits(5), 5);
+                if (distance_code != 0 || result.empty())
+                    return false; // Only distance 1 is used
+
+                while (length--)
+                    result += result[result.size() - 1];
+            }
+
+            if (bitpos > data.size() * 8)
+                return false;
+        }
+    }
+
+    size_t bytes_used() const { return (bitpos + 7) / 8; }
+
+private:
+    const std::string &data;
+    size_t bitpos;
+
+    uint32_t bits(int count)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++, bitpos++)
+        {
+            if ((uint8_t)data[bitpos / 8] & (1 << (bitpos & 7)))
+                value |= 1 << i;
+        }
+        return value;
+    }
+
+    static uint32_t reverse(uint32_t value, int count)
+    {
+        uint32_t result = 0;
+        for (int i = 0; i < count; i++)
+        {
+            result = (result << 1) | (value & 1);
+            value >>= 1;
+        }
+        return result;
+    }
+
+    int read_symbol()
+    {
+        uint32_t code = reverse(bits(7), 7);
+        if (code <= 0x17)
+            return 256 + code;
+
+        code = (code << 1) | bits(1);
+        if (code >= 0x30 && code <= 0xBF)
+            return code - 0x30;
+        if (code >= 0xC0 && code <= 0xC7)
+            return 280 + code - 0xC0;
+
+        code = (code << 1) | bits(1);
+        return 144 + code - 0x190;
+    }
+};
+
+struct zip_file_t
+{
+    std::string name;
+    std::string contents;
+    bool ok;
+};
+
+// Read the files listed in the central directory, and check that the
+// local headers, data descriptors and CRCs agree with it.
+static std::vector<zip_file_t> read_zip(const std::string &zip, bool &ok)
+{
+    std::vector<zip_file_t> files;
+    ok = false;
+
+    // The comment fills the rest of the sector
+    size_t end = zip.rfind(std::string("PK\x05\x06", 4));
+    if (end == std::string::npos || end + 22 + le16(zip, end + 20) != zip.size())
+        return files;
+
+    size_t count = le16(zip, end + 10);
+    size_t pos = le32(zip, end + 16);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (le32(zip, pos) != 0x02014b50)
+            return files;
+
+        zip_file_t file;
+        int method = le16(zip, pos + 10);
+        uint32_t crc = le32(zip, pos + 16);
+        uint32_t compressed = le32(zip, pos + 20);
+        uint32_t size = le32(zip, pos + 24);
+        size_t name_length = le16(zip, pos + 28);
+        size_t local = le32(zip, pos + 42);
+        file.name = zip.substr(pos + 46, name_length);
+        pos += 46 + name_length;
+
+        if (le32(zip, local) != 0x04034b50 || zip.compare(local + 30, name_length, file.name) != 0)
+            return files;
+
+        size_t data = local + 30 + name_length;
+        if (method == 0)
+        {
+            file.contents = zip.substr(data, size);
+        }
+        else
+        {
+            std::string compressed_data = zip.substr(data, compressed);
+            Inflater inflater(compressed_data);
+            if (!inflater.inflate(file.contents) || inflater.bytes_used() != compressed)
+                return files;
+
+            size_t descriptor = data + compressed;
+            if (le32(zip, descriptor) != 0x08074b50 || le32(zip, descriptor + 4) != crc ||
+                le32(zip, descriptor + 12) != size)
+                return files;
+        }
+
+        file.ok = file.contents.size() == size &&
+                  crc32_update(0, file.contents.data(), size) == crc;
+        if (!file.ok)
+            return files;
+
+        files.push_back(file);
+    }
+
+    ok = true;
+    return files;
+}
+
+static std::string samples_of(SignalStream &stream)
+{
+    std::string result;
+    SignalEvent event;
+    stream.seek(0);
+    while (stream.read_forwards(event))
+        result.append(event.end - event.start, (char)event.levels);
+    return result;
+}
+
+int main()
+{
+    int status = 0;
+    uint8_t buffer[SectorWriter::sector_size];
+
+    {
+        COMMENT("Test session file contents");
+        std::string result;
+        SectorWriter output(buffer, store_sector, &result);
+        SigrokWriter writer(&output);
+        TestSignalStream stream("__--__--________-", "___---", "-", "");
+        const char *names[] = {"CLK", "DATA", "CS", "IRQ"};
+        TEST(writer.write_stream(stream, 500000, names));
+        TEST((result.size() & 511) == 0);
+
+        bool ok;
+        std::vector<zip_file_t> files = read_zip(result, ok);
+        TEST(ok);
+        TEST(files.size() == 3);
+        TEST(files[0].name == "version" && files[0].contents == "2");
+        TEST(files[1].name == "metadata");
+        TEST(files[1].contents.find("samplerate=500 kHz\n") != std::string::npos);
+        TEST(files[1].contents.find("capturefile=logic-1\n") != std::string::npos);
+        TEST(files[1].contents.find("probe2=DATA\n") != std::string::npos);
+        TEST(files[1].contents.find("unitsize=1\n") != std::string::npos);
+        TEST(files[2].name == "logic-1-1");
+        TEST(files[2].contents == samples_of(stream));
+    }
+
+    {
+        COMMENT("Test long runs and lost data");
+        std::string result;
+        SectorWriter output(buffer, store_sector, &result);
+        SigrokWriter writer(&output);
+        writer.write_header(72000000, NULL);
+        writer.write_samples(0x05, 1);
+        writer.write_samples(0x05, 259);
+        writer.write_samples(0x0A, 1000000);
+        writer.write_samples(SIGNALS_LOST, 4);
+        writer.write_samples(0x01, 2);
+        TEST(writer.finish());
+
+        bool ok;
+        std::vector<zip_file_t> files = read_zip(result, ok);
+        TEST(ok);
+        TEST(files.size() == 3);
+        TEST(files[1].contents.find("samplerate=72 MHz\n") != std::string::npos);
+        TEST(files[1].contents.find("probe1=ChannelA\n") != std::string::npos);
+
+        std::string expected = std::string(260, 0x05) + std::string(1000000, 0x0A) +
+                               std::string(4, 0x00) + std::string(2, 0x01);
+        TEST(files[2].contents == expected);
+
+        // A million samples take only a few kilobytes
+        TEST(result.size() < 8192);
+    }
+
+    {
+        COMMENT("Test splitting to chunks");
+        std::string result;
+        SectorWriter output(buffer, store_sector, &result);
+        SigrokWriter writer(&output, 1000);
+        writer.write_header(1000, NULL);
+        writer.write_samples(0x03, 2500);
+        writer.write_samples(0x0C, 500);
+        TEST(writer.finish());
+
+        bool ok;
+        std::vector<zip_file_t> files = read_zip(result, ok);
+        TEST(ok);
+        TEST(files.size() == 5);
+        TEST(files[1].contents.find("samplerate=1 kHz\n") != std::string::npos);
+        TEST(files[2].name == "logic-1-1" && files[2].contents == std::string(1000, 3));
+        TEST(files[3].name == "logic-1-2" && files[3].contents == std::string(1000, 3));
+        TEST(files[4].name == "logic-1-3" &&
+             files[4].contents == std::string(500, 3) + std::string(500, 12));
+    }
+
+    {
+        COMMENT("Test that the last chunk grows when all are used");
+        std::string result;
+        SectorWriter output(buffer, store_sector, &result);
+        SigrokWriter writer(&output, 10);
+        writer.write_header(1000, NULL);
+        writer.write_samples(0x01, 10 * SigrokWriter::max_chunks + 95);
+        TEST(writer.finish());
+
+        bool ok;
+        std::vector<zip_file_t> files = read_zip(result, ok);
+        TEST(ok);
+        TEST(files.size() == SigrokWriter::max_chunks + 2);
+        TEST(files.back().contents.size() == 105);
+    }
+
+    return status;
+}
@@ -0,0 +1,40 @@
+/* Framing of the live capture stream sent over the serial port.
+ *
+ * Each frame is:
+ *   2 bytes  sync, 0xA5 0x5A
+ *   1 byte   frame type
+ *   1 byte   payload length
+ *   2 bytes  sequence number, incremented for every frame
+ *   N bytes  payload
+ *   4 bytes  CRC-32 of the type, length, sequence and payload
+ * All multi-byte values are little endian.
+ *
+ * Payloads:
+ *   START: uint32 frequency. Starts a new capture at time 0.
+ *   DATA:  uint64 start time of the first event, followed by complete
+ *          records of the varint format of signal_buffer_t.
+ *   END:   uint64 time after the last DATA frame, uint64 last_duration,
+ *          uint16 last_value.
+ *
+ * Any other bytes between the frames, such as debug messages, are skipped
+ * by the receiver. A missing frame is detected from the sequence number,
+ * and the start time of the next DATA frame tells how long the gap was.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+const uint8_t STREAMFRAME_SYNC1 = 0xA5;
+const uint8_t STREAMFRAME_SYNC2 = 0x5A;
+
+enum streamframe_type_t
+{
+    STREAMFRAME_START = 1,
+    STREAMFRAME_DATA = 2,
+    STREAMFRAME_END = 3
+};
+
+const int STREAMFRAME_HEADER_SIZE = 6;
+const int STREAMFRAME_CRC_SIZE = 4;
+const int STREAMFRAME_MAX_PAYLOAD = 128;
@@ -0,0 +1,408 @@
+#include "vcdreader.hh"
+#include "varint.hh"
+#include <stdlib.h>
+#include <string.h>
+
+VcdReader::VcdReader():
+    state(HEADER), skip_return(HEADER), names_given(false), vars_found(0),
+    frequency(0), scale_num(1), scale_den(1),
+    levels(0), unknown(0), vector_value(0), have_time(false), time(0),
+    event_levels(0), event_start(0), end_tick(0),
+    last_duration(0), last_value(0)
+{
+}
+
+void VcdReader::set_channel(int channel, const char *name)
+{
+    channel_names[channel] = name;
+    names_given = true;
+}
+
+void VcdReader::set_frequency(frequency_t frequency)
+{
+    this->frequency = frequency;
+}
+
+bool VcdReader::fail(const char *message)
+{
+    if (error.empty())
+        error = message;
+
+    return false;
+}
+
+bool VcdReader::parse(const char *data, size_t length)
+{
+    if (!error.empty())
+        return false;
+
+    const char *end = data + length;
+    for (const char *p = data; p < end; p++)
+    {
+        char c = *p;
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+        {
+            if (!token.empty())
+            {
+                if (!process_token(token))
+                    return false;
+
+                token.clear();
+            }
+        }
+        else
+        {
+            token += c;
+        }
+    }
+
+    return true;
+}
+
+bool VcdReader::parse_file(FILE *file)
+{
+    char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        if (!parse(buffer, count))
+            return false;
+    }
+
+    if (ferror(file))
+        return fail("Read error");
+
+    return finish();
+}
+
+bool VcdReader::process_token(const std::string &token)
+{
+    switch (state)
+    {
+        case HEADER:
+            if (token == "$timescale")
+            {
+                timescale.clear();
+                state = TIMESCALE;
+            }
+            else if (token == "$var")
+            {
+                var_tokens.clear();
+                state = VAR;
+            }
+            else if (token == "$enddefinitions")
+            {
+                state = SKIP;
+                skip_return = BODY;
+                return start_body();
+            }
+            else if (token[0] == '$')
+            {
+                // $scope, $upscope, $version, $date, $comment
+                state = SKIP;
+                skip_return = HEADER;
+            }
+            else
+            {
+                return fail("Unexpected text in header");
+            }
+            return true;
+
+        case SKIP:
+            if (token == "$end")
+                state = skip_return;
+            return true;
+
+        case TIMESCALE:
+            if (token == "$end")
+                state = HEADER;
+            else
+                timescale += token;
+            return true;
+
+        case VAR:
+            if (token == "$end")
+            {
+                state = HEADER;
+                return process_var();
+            }
+            var_tokens.push_back(token);
+            return true;
+
+        case BODY:
+            switch (token[0])
+            {
+                case '#':
+                {
+                    char *end;
+                    uint64_t new_time = strtoull(token.c_str() + 1, &end, 10);
+                    if (*end != 0 || token.size() == 1)
+                        return fail("Invalid timestamp");
+
+                    if (have_time && new_time < time)
+                        return fail("Timestamps are not in order");
+
+                    // The changes at the previous timestamp are complete
+                    commit();
+                    time = new_time;
+                    have_time = true;
+                    return true;
+                }
+
+                case '$':
+                    // $dumpvars etc. contain normal value changes
+                    if (token == "$comment")
+                    {
+                        state = SKIP;
+                        skip_return = BODY;
+                    }
+                    return true;
+
+                case '0': case '1':
+                case 'x': case 'X': case 'z': case 'Z':
+                    change(token.substr(1), token[0]);
+                    return true;
+
+                case 'b': case 'B':
+                    vector_value = token[token.size() - 1];
+                    state = VECTOR_ID;
+                    return true;
+
+                case 'r': case 'R':
+                    vector_value = 0; // Real values are ignored
+                    state = VECTOR_ID;
+                    return true;
+
+                default:
+                    return fail("Unexpected text in value changes");
+            }
+
+        case VECTOR_ID:
+            if (vector_value)
+                change(token, vector_value);
+            state = BODY;
+            return true;
+    }
+
+    return true;
+}
+
+// $var type size identifier reference [range] $end
+bool VcdReader::process_var()
+{
+    if (var_tokens.size() < 4)
+        return fail("Invalid $var");
+
+    if (var_tokens[1] != "1")
+        return true; // Only single bits are supported
+
+    const std::string &id = var_tokens[2];
+    const std::string &name = var_tokens[3];
+
+    if (names_given)
+    {
+        for (int i = 0; i < channels; i++)
+        {
+            if (channel_names[i] == name && channel_ids[i].empty())
+                channel_ids[i] = id;
+        }
+    }
+    else if (vars_found < channels)
+    {
+        channel_ids[vars_found] = id;
+        channel_names[vars_found] = name;
+        vars_found++;
+    }
+
+    return true;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+    while (b)
+    {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+bool VcdReader::start_body()
+{
+    // Timescale is e.g. "1ns" or "10us"
+    if (timescale.empty())
+        timescale = "1s";
+
+    char *unit;
+    uint64_t multiplier = strtoull(timescale.c_str(), &unit, 10);
+    static const char *units[] = {"s", "ms", "us", "ns", "ps", "fs"};
+    uint64_t divider = 1;
+    bool found = false;
+    for (int i = 0; i < 6; i++)
+    {
+        if (strcmp(unit, units[i]) == 0)
+        {
+            found = true;
+            break;
+        }
+        divider *= 1000;
+    }
+
+    if (!found || multiplier == 0)
+        return fail("Invalid timescale");
+
+    if (frequency == 0)
+    {
+        if (divider % multiplier != 0 || divider / multiplier > 0xFFFFFFFF)
+            return fail("Timescale is too fine, the frequency must be given");
+
+        frequency = divider / multiplier;
+    }
+
+    // One VCD time unit is multiplier / divider seconds
+    scale_num = multiplier * frequency;
+    scale_den = divider;
+    uint64_t common = gcd(scale_num, scale_den);
+    scale_num /= common;
+    scale_den /= common;
+
+    for (int i = 0; i < channels; i++)
+    {
+        if (!channel_ids[i].empty())
+            return true;
+    }
+
+    return fail("No 1-bit signals found");
+}
+
+signaltime_t VcdReader::to_ticks(uint64_t time) const
+{
+    if (scale_den == 1)
+        return time * scale_num;
+
+    unsigned __int128 ticks = (unsigned __int128)time * scale_num + scale_den / 2;
+    return ticks / scale_den;
+}
+
+void VcdReader::change(const std::string &id, char value)
+{
+    for (int i = 0; i < channels; i++)
+    {
+        if (channel_ids[i] == id)
+        {
+            signals_t bit = 1 << i;
+            if (value == '1')
+            {
+                levels |= bit;
+                unknown &= ~bit;
+            }
+            else if (value == '0')
+            {
+                levels &= ~bit;
+                unknown &= ~bit;
+            }
+            else
+            {
+                levels &= ~bit;
+                unknown |= bit;
+            }
+        }
+    }
+}
+
+void VcdReader::write_varint(uint64_t value)
+{
+    uint8_t bytes[VARINT_MAX_BYTES];
+    int count = varint_encode(bytes, value);
+    storage.insert(storage.end(), bytes, bytes + count);
+}
+
+// Store the event that ends at the current time, if the levels changed.
+void VcdReader::commit()
+{
+    signals_t mask = 0;
+    for (int i = 0; i < channels; i++)
+    {
+        if (!channel_ids[i].empty())
+            mask |= 1 << i;
+    }
+
+    signals_t new_levels = levels;
+    if ((unknown & mask) == mask)
+        new_levels = SIGNALS_LOST;
+
+    if (new_levels == event_levels)
+        return;
+
+    signaltime_t tick = to_ticks(time);
+    if (tick > event_start)
+    {
+        signaltime_t duration = tick - event_start;
+        if (event_levels == SIGNALS_LOST)
+        {
+            write_varint(0);
+            write_varint(duration);
+        }
+        else
+        {
+            write_varint((duration << 4) | event_levels);
+        }
+
+        event_start = tick;
+    }
+
+    event_levels = new_levels;
+}
+
+bool VcdReader::finish()
+{
+    if (!token.empty())
+    {
+        if (!process_token(token))
+            return false;
+
+        token.clear();
+    }
+
+    if (!error.empty())
+        return false;
+
+    if (state != BODY)
+        return fail("Unexpected end of file");
+
+    commit();
+    end_tick = to_ticks(time);
+
+    signaltime_t duration = end_tick - event_start;
+    if (event_levels == SIGNALS_LOST)
+    {
+        // Lost data can't be stored as the last event
+        if (duration > 0)
+        {
+            write_varint(0);
+            write_varint(duration);
+        }
+        last_duration = 0;
+        last_value = 0;
+    }
+    else
+    {
+        last_duration = duration;
+        last_value = event_levels;
+    }
+
+    return true;
+}
+
+bool VcdReader::to_signal_buffer(signal_buffer_t *buffer) const
+{
+    if (storage.size() > sizeof(buffer->storage))
+        return false;
+
+    memcpy(buffer->storage, storage.data(), storage.size());
+    buffer->bytes = storage.size();
+    buffer->last_duration = last_duration;
+    buffer->last_value = last_value;
+    return true;
+}
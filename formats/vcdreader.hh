@@ -0,0 +1,115 @@
+/* Streaming parser for Value Change Dump files.
+ *
+ * Converts up to 4 single-bit signals of a VCD file to the varint format
+ * of signal_buffer_t, so that captures from other tools and files exported
+ * by VcdWriter can be used as test data for the streams and the GUI.
+ *
+ * The input can be given in chunks of any size. Periods where all the
+ * selected signals are 'x' or 'z' are stored as lost data markers; if only
+ * some of them are unknown, those read as 0.
+ *
+ * By default the tick frequency is the inverse of the VCD timescale. If a
+ * different frequency is given, the times are rounded to the nearest tick
+ * and pulses shorter than a tick disappear.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "dsosignalstream.hh"
+
+class VcdReader
+{
+public:
+    static const int channels = 4;
+
+    VcdReader();
+
+    // Select the signal for a channel by its reference name. By default
+    // the first four 1-bit variables are used.
+    void set_channel(int channel, const char *name);
+
+    // Set the tick frequency of the output. 0 = use the VCD timescale.
+    void set_frequency(frequency_t frequency);
+
+    // Parse a chunk of the file. Returns false on a syntax error.
+    bool parse(const char *data, size_t length);
+
+    // Parse the whole file, then call finish().
+    bool parse_file(FILE *file);
+
+    // Process the end of the file. The last timestamp is the end time.
+    bool finish();
+
+    // Description of the first error
+    const char *get_error() const { return error.c_str(); }
+
+    frequency_t get_frequency() const { return frequency; }
+    const char *get_channel_name(int channel) const { return channel_names[channel].c_str(); }
+
+    // The result, in the same format as signal_buffer_t
+    const std::vector<uint8_t> &get_storage() const { return storage; }
+    signaltime_t get_last_duration() const { return last_duration; }
+    signals_t get_last_value() const { return last_value; }
+
+    // Total length in ticks
+    signaltime_t get_end_time() const { return end_tick; }
+
+    // Copy the result to a signal buffer. Returns false if it doesn't fit.
+    bool to_signal_buffer(signal_buffer_t *buffer) const;
+
+private:
+    enum state_t
+    {
+        HEADER, // Waiting for a keyword
+        SKIP, // Skipping until $end
+        TIMESCALE, // Inside $timescale
+        VAR, // Inside $var
+        BODY, // Value changes
+        VECTOR_ID // Identifier after a vector value
+    };
+
+    state_t state;
+    state_t skip_return; // State after $end when skipping
+    std::string token;
+    std::string error;
+
+    // Header information
+    std::string timescale;
+    std::vector<std::string> var_tokens;
+    std::string channel_names[channels];
+    std::string channel_ids[channels];
+    bool names_given;
+    int vars_found;
+
+    // Conversion from VCD time to ticks: tick = time * scale_num / scale_den
+    frequency_t frequency;
+    uint64_t scale_num;
+    uint64_t scale_den;
+
+    // Value state
+    signals_t levels; // Current values of the channels
+    signals_t unknown; // Channels that are 'x' or 'z'
+    signals_t vector_value; // Value of the pending vector change
+    bool have_time;
+    uint64_t time; // Current VCD time
+
+    // Output state
+    signals_t event_levels; // Levels of the event being built
+    signaltime_t event_start; // Start tick of the event
+    signaltime_t end_tick;
+    std::vector<uint8_t> storage;
+    signaltime_t last_duration;
+    signals_t last_value;
+
+    bool process_token(const std::string &token);
+    bool process_var();
+    bool start_body();
+    void change(const std::string &id, char value);
+    void commit();
+    signaltime_t to_ticks(uint64_t time) const;
+    void write_varint(uint64_t value);
+    bool fail(const char *message);
+};
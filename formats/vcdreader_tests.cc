@@ -0,0 +1,261 @@
+#include "vcdreader.hh"
+#include "vcdwriter.hh"
+#include "varint.hh"
+#include "testsignalstream.hh"
+#include "unittests.h"
+#include <string>
+#include <time.h>
+
+static bool store_sector(const uint8_t *sector, void *context)
+{
+    std::string *output = (std::string*)context;
+    output->append((const char*)sector, SectorWriter::sector_size);
+    return true;
+}
+
+static std::string export_vcd(SignalStream &stream)
+{
+    std::string result;
+    uint8_t buffer[SectorWriter::sector_size];
+    SectorWriter output(buffer, store_sector, &result);
+    VcdWriter vcd(&output);
+    vcd.write_stream(stream, "2us");
+    return result;
+}
+
+static bool parse_string(VcdReader &reader, const std::string &text)
+{
+    return reader.parse(text.data(), text.size()) && reader.finish();
+}
+
+// Check that the streams give the same events
+static bool streams_equal(SignalStream &a, SignalStream &b)
+{
+    SignalEvent ea, eb;
+    a.seek(0);
+    b.seek(0);
+    for (;;)
+    {
+        bool ra = a.read_forwards(ea);
+        bool rb = b.read_forwards(eb);
+        if (ra != rb)
+            return false;
+        if (!ra)
+            return true;
+        if (ea.start != eb.start || ea.end != eb.end || ea.levels != eb.levels)
+            return false;
+    }
+}
+
+// Lost data in the middle of the stream
+class LostDataStream: public TestSignalStream
+{
+public:
+    LostDataStream(): TestSignalStream("__--__", "_-_-_-", "", "") {}
+
+    virtual bool read_forwards(SignalEvent &result)
+    {
+        if (!TestSignalStream::read_forwards(result))
+            return false;
+
+        if (result.start == 2)
+            result.levels = SIGNALS_LOST;
+        return true;
+    }
+};
+
+int main()
+{
+    int status = 0;
+    static signal_buffer_t buffer;
+
+    {
+        COMMENT("Test reading a file written by VcdWriter");
+        TestSignalStream original("__--__--___", "___---_", "-_-_-", "");
+        std::string text = export_vcd(original);
+
+        VcdReader reader;
+        TEST(parse_string(reader, text));
+        TEST(reader.get_frequency() == 500000);
+        TEST(strcmp(reader.get_channel_name(1), "ChannelB") == 0);
+        TEST(reader.to_signal_buffer(&buffer));
+
+        DSOSignalStream stream(&buffer);
+        TEST(streams_equal(original, stream));
+    }
+
+    {
+        COMMENT("Test lost data");
+        LostDataStream original;
+        std::string text = export_vcd(original);
+
+        VcdReader reader;
+        TEST(parse_string(reader, text));
+        TEST(reader.to_signal_buffer(&buffer));
+
+        SignalEvent event;
+        DSOSignalStream stream(&buffer);
+        stream.seek(0);
+        TEST(stream.read_forwards(event) && event.levels == 0x00);
+        TEST(stream.read_forwards(event) && event.levels == 0x02);
+        TEST(stream.read_forwards(event) && event.levels == SIGNALS_LOST);
+        TEST(event.start == 2 && event.end == 3);
+        TEST(stream.read_forwards(event) && event.levels == 0x03);
+        TEST(event.start == 3);
+    }
+
+    {
+        COMMENT("Test a file from another tool");
+        const char *text =
+            "$date today $end\n"
+            "$comment multiple\nlines $end\n"
+            "$timescale\n  10 ns\n$end\n"
+            "$scope module top $end\n"
+            "$var wire 8 ! data [7:0] $end\n"
+            "$var wire 1 \" clk $end\n"
+            "$scope module sub $end\n"
+            "$var reg 1 # en $end\n"
+            "$var real 1 $ voltage $end\n"
+            "$upscope $end $upscope $end\n"
+            "$enddefinitions $end\n"
+            "#0\n$dumpvars b00000000 ! 0\" x# r1.5 $ $end\n"
+            "#5\nb101 !\n1\"\n"
+            "#10\n0\"\n1#\n$comment 1\" $end\n"
+            "#15 1\"\n"
+            "#20 0\"\nz#\n"
+            "#25 1\"\n"
+            "#30\n";
+
+        VcdReader reader;
+        TEST(parse_string(reader, text));
+        TEST(reader.get_frequency() == 100000000);
+        TEST(strcmp(reader.get_channel_name(0), "clk") == 0);
+        TEST(strcmp(reader.get_channel_name(1), "en") == 0);
+        TEST(strcmp(reader.get_channel_name(2), "voltage") == 0);
+        TEST(reader.get_end_time() == 30);
+        TEST(reader.to_signal_buffer(&buffer));
+
+        // The real values of voltage are ignored, 'x' alone reads as 0
+        TestSignalStream expected("_____-----_____-----_____-----",
+                                  "__________----------__________", "", "");
+        DSOSignalStream stream(&buffer, reader.get_frequency());
+        TEST(streams_equal(expected, stream));
+        TEST(stream.get_frequency() == 100000000);
+    }
+
+    {
+        COMMENT("Test frequency conversion and channel selection");
+        const char *text =
+            "$timescale 1ns $end\n"
+            "$var wire 1 a first $end\n"
+            "$var wire 1 b second $end\n"
+            "$enddefinitions $end\n"
+            "#0 0a 0b\n"
+            "#1000 1b\n"
+            "#1100 1a 0b\n"
+            "#1101 0a 1b\n"
+            "#3000 0b\n"
+            "#4000 1b\n"
+            "#5000\n";
+
+        VcdReader reader;
+        reader.set_channel(0, "second");
+        reader.set_frequency(1000000);
+        TEST(parse_string(reader, text));
+        TEST(reader.get_end_time() == 5);
+        TEST(reader.to_signal_buffer(&buffer));
+
+        // Only 'second' is read, and its 1 ns pulse is too short to be seen
+        TestSignalStream expected("_--_-", "", "", "");
+        DSOSignalStream stream(&buffer);
+        TEST(streams_equal(expected, stream));
+    }
+
+    {
+        COMMENT("Test parsing one byte at a time");
+        TestSignalStream original("_-_--_---_----", "-_", "", "--__--");
+        std::string text = export_vcd(original);
+
+        VcdReader whole, bytes;
+        TEST(parse_string(whole, text));
+        for (size_t i = 0; i < text.size(); i++)
+            bytes.parse(&text[i], 1);
+        TEST(bytes.finish());
+        TEST(whole.get_storage() == bytes.get_storage());
+        TEST(whole.get_last_duration() == bytes.get_last_duration());
+        TEST(whole.get_last_value() == bytes.get_last_value());
+    }
+
+    {
+        COMMENT("Test errors");
+        VcdReader r1;
+        TEST(!parse_string(r1, "$timescale 1 ns $end $enddefinitions $end #0"));
+        TEST(strcmp(r1.get_error(), "No 1-bit signals found") == 0);
+
+        VcdReader r2;
+        TEST(!parse_string(r2, "$timescale 1ps $end $var wire 1 a x $end "
+                               "$enddefinitions $end #0"));
+        TEST(strcmp(r2.get_error(), "Timescale is too fine, the frequency must be given") == 0);
+
+        VcdReader r3;
+        TEST(!parse_string(r3, "$var wire 1 a x $end $enddefinitions $end #5 1a #4"));
+        TEST(strcmp(r3.get_error(), "Timestamps are not in order") == 0);
+
+        VcdReader r4;
+        TEST(!parse_string(r4, "$var wire 1 a x $end"));
+        TEST(strcmp(r4.get_error(), "Unexpected end of file") == 0);
+
+        VcdReader r5;
+        TEST(!parse_string(r5, "$var wire 1 a x $end $enddefinitions $end #0 ?a"));
+    }
+
+    {
+        COMMENT("Measure decoding throughput");
+        std::string text = "$timescale 1us $end\n"
+                           "$var wire 1 ! a $end\n$var wire 1 \" b $end\n"
+                           "$enddefinitions $end\n";
+        char line[64];
+        const int changes = 200000;
+        for (int i = 0; i < changes; i++)
+        {
+            snprintf(line, sizeof(line), "#%d\n%d!\n", i * 3, (i >> 1) & 1);
+            text += line;
+            if ((i & 7) == 0)
+            {
+                snprintf(line, sizeof(line), "%d\"\n", (i >> 3) & 1);
+                text += line;
+            }
+        }
+
+        clock_t start = clock();
+        VcdReader reader;
+        TEST(parse_string(reader, text));
+        clock_t parsed = clock();
+
+        // Walk through the result the same way as the GUI does when drawing
+        const std::vector<uint8_t> &storage = reader.get_storage();
+        size_t pos = 0;
+        int events = 0;
+        signaltime_t total = 0;
+        while (pos < storage.size())
+        {
+            signaltime_t duration;
+            signals_t levels;
+            pos = varint_read_record(storage.data(), pos, duration, levels);
+            total += duration;
+            events++;
+        }
+        clock_t decoded = clock();
+
+        TEST(total + reader.get_last_duration() == reader.get_end_time());
+        TEST(events + 1 == changes / 2);
+
+        double parse_s = (double)(parsed - start) / CLOCKS_PER_SEC;
+        double decode_s = (double)(decoded - parsed) / CLOCKS_PER_SEC;
+        printf("Parsed %lu bytes in %.3f s (%.1f MB/s), %d events decoded in %.3f s\n",
+               (unsigned long)text.size(), parse_s, text.size() / 1e6 / (parse_s + 1e-9),
+               events, decode_s);
+    }
+
+    return status;
+}
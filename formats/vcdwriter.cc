@@ -0,0 +1,91 @@
+#include "vcdwriter.hh"
+
+// Identifier characters of the channels
+static const char channel_ids[VcdWriter::channels] = {'A', 'B', 'C', 'D'};
+
+VcdWriter::VcdWriter(SectorWriter *output)
+{
+    this->output = output;
+    previous = 0;
+}
+
+void VcdWriter::write_header(const char *timescale)
+{
+    output->put_string("$version DSO Quad Logic Analyzer $end\n");
+    output->put_string("$timescale ");
+    output->put_string(timescale);
+    output->put_string(" $end\n");
+    output->put_string("$scope module logic $end\n");
+
+    for (int i = 0; i < channels; i++)
+    {
+        output->put_string("$var wire 1 ");
+        output->put(channel_ids[i]);
+        output->put_string(" Channel");
+        output->put(channel_ids[i]);
+        output->put_string(" $end\n");
+    }
+
+    output->put_string("$upscope $end\n");
+    output->put_string("$enddefinitions $end\n");
+    output->put_string("$dumpvars 0A 0B 0C 0D $end\n");
+    previous = 0;
+}
+
+void VcdWriter::write_event(const SignalEvent &event)
+{
+    if (event.levels & SIGNALS_LOST)
+    {
+        if (previous == -1)
+            return;
+
+        output->put('#');
+        output->put_uint(event.start);
+        for (int i = 0; i < channels; i++)
+        {
+            output->put_string(" x");
+            output->put(channel_ids[i]);
+        }
+        output->put('\n');
+        previous = -1;
+        return;
+    }
+
+    int changed = (previous == -1) ? 0x0F : (event.levels ^ previous) & 0x0F;
+    if (!changed)
+        return;
+
+    output->put('#');
+    output->put_uint(event.start);
+    for (int i = 0; i < channels; i++)
+    {
+        if (changed & (1 << i))
+        {
+            output->put(' ');
+            output->put((event.levels & (1 << i)) ? '1' : '0');
+            output->put(channel_ids[i]);
+        }
+    }
+    output->put('\n');
+    previous = event.levels & 0x0F;
+}
+
+bool VcdWriter::finish(signaltime_t end_time)
+{
+    output->put('#');
+    output->put_uint(end_time);
+    output->put('\n');
+    return output->finish();
+}
+
+bool VcdWriter::write_stream(SignalStream &stream, const char *timescale)
+{
+    write_header(timescale);
+
+    SignalEvent event;
+    event.end = 0;
+    while (stream.read_forwards(event) && output->ok())
+        write_event(event);
+
+    return finish(event.end);
+}
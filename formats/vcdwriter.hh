@@ -0,0 +1,38 @@
+/* Streaming writer for Value Change Dump files.
+ *
+ * Formats the events directly into a SectorWriter. Only the channels that
+ * changed are written for each timestamp, as allowed by the VCD format.
+ * Periods of lost data are written as 'x' on all channels.
+ */
+
+#pragma once
+
+#include "sectorwriter.hh"
+#include "signalstream.hh"
+
+class VcdWriter
+{
+public:
+    static const int channels = 4;
+
+    VcdWriter(SectorWriter *output);
+
+    // Write the declarations and the initial values. Timescale is the
+    // length of one tick, e.g. "2us".
+    void write_header(const char *timescale);
+
+    void write_event(const SignalEvent &event);
+
+    // Write the end time and the last sector.
+    // Returns true if all writes succeeded.
+    bool finish(signaltime_t end_time);
+
+    // Write all events from the current position of the stream.
+    bool write_stream(SignalStream &stream, const char *timescale);
+
+private:
+    SectorWriter *output;
+
+    // Levels written previously, or -1 if unknown (after lost data).
+    int previous;
+};
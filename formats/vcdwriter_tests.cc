@@ -0,0 +1,125 @@
+#include "vcdwriter.hh"
+#include "testsignalstream.hh"
+#include "unittests.h"
+#include <string>
+
+// Collects the written sectors to a string
+static bool store_sector(const uint8_t *sector, void *context)
+{
+    std::string *output = (std::string*)context;
+    output->append((const char*)sector, SectorWriter::sector_size);
+    return true;
+}
+
+static bool fail_sector(const uint8_t *sector, void *context)
+{
+    return false;
+}
+
+// Lost data in the middle of the stream
+class LostDataStream: public TestSignalStream
+{
+public:
+    LostDataStream(): TestSignalStream("__--__", "", "", "") {}
+
+    virtual bool read_forwards(SignalEvent &result)
+    {
+        if (!lost_done && TestSignalStream::read_forwards(result))
+        {
+            if (result.start == 2)
+            {
+                result.levels = SIGNALS_LOST;
+                lost_done = true;
+            }
+            return true;
+        }
+        return TestSignalStream::read_forwards(result);
+    }
+
+    bool lost_done = false;
+};
+
+int main()
+{
+    int status = 0;
+    uint8_t buffer[SectorWriter::sector_size];
+
+    {
+        COMMENT("Test integer formatting");
+        std::string result;
+        SectorWriter output(buffer, store_sector, &result);
+        output.put_uint(0);
+        output.put(' ');
+        output.put_uint(1234567890);
+        output.put(' ');
+        output.put_uint(4294967296ULL);
+        output.put(' ');
+        output.put_uint(18446744073709551615ULL);
+        TEST(output.finish());
+        TEST(result.size() == 512);
+        TEST(result.compare(0, 47, "0 1234567890 4294967296 18446744073709551615   ") == 0);
+    }
+
+    {
+        COMMENT("Test writing only changed channels");
+        std::string result;
+        SectorWriter output(buffer, store_sector, &result);
+        VcdWriter vcd(&output);
+        TestSignalStream stream("__--__", "___---", "", "");
+        TEST(vcd.write_stream(stream, "2us"));
+
+        const char *expected =
+            "$version DSO Quad Logic Analyzer $end\n"
+            "$timescale 2us $end\n"
+            "$scope module logic $end\n"
+            "$var wire 1 A ChannelA $end\n"
+            "$var wire 1 B ChannelB $end\n"
+            "$var wire 1 C ChannelC $end\n"
+            "$var wire 1 D ChannelD $end\n"
+            "$upscope $end\n"
+            "$enddefinitions $end\n"
+            "$dumpvars 0A 0B 0C 0D $end\n"
+            "#2 1A\n"
+            "#3 1B\n"
+            "#4 0A\n"
+            "#6\n";
+        TEST(result.compare(0, strlen(expected), expected) == 0);
+        TEST(result.size() == 512);
+        TEST(result.find_first_not_of(' ', strlen(expected)) == std::string::npos);
+    }
+
+    {
+        COMMENT("Test lost data");
+        std::string result;
+        SectorWriter output(buffer, store_sector, &result);
+        VcdWriter vcd(&output);
+        LostDataStream stream;
+        TEST(vcd.write_stream(stream, "2us"));
+        TEST(result.find("#2 xA xB xC xD\n#4 0A 0B 0C 0D\n#7\n") != std::string::npos);
+    }
+
+    {
+        COMMENT("Test multiple sectors");
+        std::string result;
+        SectorWriter output(buffer, store_sector, &result);
+        for (int i = 0; i < 1000; i++)
+            output.put_string("0123456789");
+        TEST(output.sectors_written() == 19);
+        TEST(output.finish());
+        TEST(output.sectors_written() == 20);
+        TEST(result.size() == 20 * 512);
+        TEST(result.compare(510, 4, "0123") == 0);
+        TEST(result.compare(9990, 10, "0123456789") == 0);
+    }
+
+    {
+        COMMENT("Test write error");
+        SectorWriter output(buffer, fail_sector);
+        for (int i = 0; i < 100; i++)
+            output.put_string("0123456789");
+        TEST(!output.ok());
+        TEST(!output.finish());
+    }
+
+    return status;
+}
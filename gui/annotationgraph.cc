@@ -0,0 +1,132 @@
+#include "annotationgraph.hh"
+
+#ifdef __arm__
+extern "C" {
+#include "BIOS.h"
+}
+#else
+// The unit tests on the PC provide the font.
+#define FONT_WIDTH 8
+#define FONT_HEIGHT 14
+uint16_t __Get_TAB_8x14(uint8_t code, uint16_t row);
+#endif
+
+#include "../profiler.hh"
+
+AnnotationGraph::AnnotationGraph(const EventStream &stream, const XPosHandler *xpos):
+    y0(0), height(16), color(0xFFFF),
+    stream(stream.clone()), xpos(xpos),
+    annotations(new annotation_t[max_annotations]), count(0), current(0)
+{
+}
+
+void AnnotationGraph::layout(annotation_t &annotation, signaltime_t start,
+                             signaltime_t end)
+{
+    annotation.x0 = xpos->get_x(start);
+    annotation.x1 = xpos->get_x(end);
+
+    // Leave a pixel between the text and the box edges
+    int room = (annotation.x1 - annotation.x0 - 3) / FONT_WIDTH;
+    if (room >= annotation.length)
+        annotation.visible_chars = annotation.length;
+    else if (room >= 2)
+        annotation.visible_chars = room; // Last one is replaced by '~'
+    else
+        annotation.visible_chars = 0;
+
+    int width = annotation.visible_chars * FONT_WIDTH;
+    annotation.text_x = (annotation.x0 + annotation.x1 + 1 - width) / 2;
+}
+
+void AnnotationGraph::Prepare(int xstart, int xend)
+{
+    PROFILE_SCOPE("AnnotationGraph::Prepare");
+
+    // Whole graph area, like in Grid::Prepare().
+    signaltime_t start = xpos->get_time(0);
+    signaltime_t end = xpos->get_time(400);
+
+    count = 0;
+    current = 0;
+    stream->seek(start);
+    while (count < max_annotations)
+    {
+        std::unique_ptr<Event> event(stream->read());
+
+        if (!event || event->start >= end)
+            break;
+
+        if (event->end <= start)
+            continue;
+
+        annotation_t &annotation = annotations[count++];
+        event->to_string(annotation.text, max_text);
+        annotation.length = strlen(annotation.text);
+        layout(annotation, event->start, event->end);
+    }
+}
+
+void AnnotationGraph::Draw(uint16_t buffer[], int screenheight, int x)
+{
+    PROFILE_SCOPE("AnnotationGraph::Draw");
+
+    while (current < count && annotations[current].x1 < x)
+        current++;
+
+    if (current >= count || y0 + height > screenheight)
+        return;
+
+    const annotation_t &first = annotations[current];
+    if (first.x0 > x)
+        return;
+
+    int i = current;
+    bool edge = false;
+    bool narrow = false;
+    while (i < count && annotations[i].x0 <= x)
+    {
+        const annotation_t &a = annotations[i];
+        if (a.x0 == x || a.x1 == x)
+            edge = true;
+        if (a.x1 - a.x0 < 3)
+            narrow = true;
+        i++;
+    }
+
+    // Boxes that are only a few pixels wide are filled.
+    int y1 = y0 + height - 1;
+    if (edge || narrow)
+    {
+        for (int y = y0; y <= y1; y++)
+            buffer[y] = color;
+        return;
+    }
+
+    buffer[y0] = color;
+    buffer[y1] = color;
+
+    // Text of the box covering x
+    int offset = x - first.text_x;
+    int width = first.visible_chars * FONT_WIDTH;
+    if (offset < 0 || offset >= width)
+        return;
+
+    int index = offset / FONT_WIDTH;
+    char character = first.text[index];
+    if (first.visible_chars < first.length && index == first.visible_chars - 1)
+        character = '~';
+
+    if (character == ' ')
+        return;
+
+    uint16_t column = __Get_TAB_8x14(character, offset % FONT_WIDTH);
+    int bottom_edge_y = y0 + (height - FONT_HEIGHT) / 2;
+    for (int y = 0; y < FONT_HEIGHT; y++)
+    {
+        if (column & 4)
+            buffer[bottom_edge_y + y] = color;
+
+        column >>= 1;
+    }
+}
@@ -0,0 +1,67 @@
+/* A graph of decoded events, e.g. the bytes from a UART decoder.
+ *
+ * Each event is drawn as a box from its start to its end time, with the
+ * text from Event::to_string() in the middle. If the box is too narrow
+ * for the text, the text is cut and ends with '~', and very narrow boxes
+ * have no text at all.
+ *
+ * Prepare() reads and formats the events on the screen, and Draw() only
+ * steps through the boxes in x order. The graph doesn't keep the events
+ * between frames, so to avoid running the decoder on every frame, give it
+ * a CachedEventStream.
+ */
+
+#pragma once
+
+#include "xposhandler.hh"
+#include "drawable.hh"
+#include "eventstream.hh"
+#include <memory>
+
+class AnnotationGraph: public Drawable
+{
+public:
+    // The constructor clones the EventStream.
+    AnnotationGraph(const EventStream &stream, const XPosHandler *xpos);
+
+    virtual void Prepare(int xstart, int xend);
+    virtual void Draw(uint16_t buffer[], int screenheight, int x);
+
+    // Forget the events cached by the stream, e.g. when the data behind
+    // it has been replaced or more has been captured.
+    void invalidate() { stream->invalidate(); }
+    void invalidate_after(signaltime_t time) { stream->invalidate_after(time); }
+
+    int y0; // Default: 0
+    int height; // Default: 16
+    uint16_t color; // Default: White
+
+    // Maximum number of events drawn on the screen.
+    static const int max_annotations = 64;
+
+    // Maximum length of the text of an event
+    static const int max_text = 12;
+
+private:
+    struct annotation_t
+    {
+        char text[max_text];
+        uint8_t length;
+        uint8_t visible_chars; // How many characters of the text fit
+
+        // Position on screen
+        int x0;
+        int x1;
+        int text_x; // Left edge of the text
+    };
+
+    std::unique_ptr<EventStream> stream;
+    const XPosHandler *xpos;
+
+    std::unique_ptr<annotation_t[]> annotations;
+    int count;
+
+    int current; // First annotation that may be at the x being drawn
+
+    void layout(annotation_t &annotation, signaltime_t start, signaltime_t end);
+};
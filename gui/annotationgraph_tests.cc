@@ -0,0 +1,317 @@
+#include "annotationgraph.hh"
+#include "cachedeventstream.hh"
+#include "signalgraph.hh"
+#include "testsignalstream.hh"
+#include "unittests.h"
+#include "../profiler.hh"
+#include <string>
+#include <vector>
+
+// Font where the first column of each character has the character code in
+// its lowest 8 rows, so that the text can be read back from the screen.
+uint16_t __Get_TAB_8x14(uint8_t code, uint16_t row)
+{
+    return (row == 0) ? code << 2 : 0;
+}
+
+struct TextEvent: public Event
+{
+    const char *text;
+
+    virtual void to_string(char *buf, size_t size) const
+    {
+        snprintf(buf, size, "%s", text);
+    }
+};
+
+// Returns a fixed list of events and counts how many are read.
+class ListStream: public TypedEventStream<TextEvent>
+{
+public:
+    ListStream(const std::vector<TextEvent> &events, int *reads):
+        events(events), reads(reads), index(0) {}
+
+    virtual void seek(signaltime_t time)
+    {
+        index = 0;
+        while (index < events.size() && events[index].end <= time)
+            index++;
+    }
+
+    virtual bool read_forwards(TextEvent &result)
+    {
+        if (index >= events.size())
+            return false;
+
+        (*reads)++;
+        result = events[index++];
+        return true;
+    }
+
+    virtual ListStream* clone() const
+    {
+        return new ListStream(*this);
+    }
+
+private:
+    std::vector<TextEvent> events;
+    int *reads;
+    size_t index;
+};
+
+static std::vector<TextEvent> make_events(const signaltime_t *times,
+                                          const char **texts, int count)
+{
+    std::vector<TextEvent> events;
+    for (int i = 0; i < count; i++)
+    {
+        TextEvent event;
+        event.start = times[i];
+        event.end = times[i + 1];
+        event.text = texts[i];
+        events.push_back(event);
+    }
+    return events;
+}
+
+// Signal on channel A that changes level at each of the times.
+static std::string make_signal(const signaltime_t *times, int count)
+{
+    std::string signal;
+    bool high = false;
+    for (int i = 0; i < count; i++)
+    {
+        signal.append(times[i] - signal.size(), high ? '-' : '_');
+        high = !high;
+    }
+    signal.append(10, high ? '-' : '_');
+    return signal;
+}
+
+static const int screenheight = 40;
+static const int width = 400;
+static uint16_t screen[width][screenheight];
+
+static void draw(Drawable &drawable)
+{
+    memset(screen, 0, sizeof(screen));
+    drawable.Prepare(0, width);
+    for (int x = 0; x < width; x++)
+        drawable.Draw(screen[x], screenheight, x);
+}
+
+static bool full_column(int x, int y0, int height)
+{
+    for (int y = y0; y < y0 + height; y++)
+    {
+        if (!screen[x][y])
+            return false;
+    }
+    return true;
+}
+
+// Character drawn by the test font at x, or 0.
+static char read_char(int x, int y0)
+{
+    int code = 0;
+    for (int y = 0; y < 8; y++)
+    {
+        if (screen[x][y0 + 1 + y])
+            code |= 1 << y;
+    }
+    return code;
+}
+
+// Text inside the box between x0 and x1, and where it starts.
+static std::string read_text(int x0, int x1, int y0, int *text_x)
+{
+    std::string text;
+    *text_x = -1;
+    for (int x = x0 + 1; x < x1; x++)
+    {
+        char c = read_char(x, y0);
+        if (c && *text_x < 0)
+            *text_x = x;
+        if (c)
+            text += c;
+    }
+    return text;
+}
+
+static ProfileCounter *find_counter(const char *name)
+{
+    for (ProfileCounter *c = ProfileCounter::first(); c; c = c->next)
+    {
+        if (strcmp(c->name, name) == 0)
+            return c;
+    }
+    return NULL;
+}
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test that the boxes line up with the signal edges");
+        const signaltime_t times[] = {20, 60, 120, 122, 150, 160};
+        const char *texts[] = {"AB", "LONGTEXT123", "X", "toolong", "Q"};
+        std::string signal = make_signal(times, 6);
+        TestSignalStream stream(signal.c_str(), "", "", "");
+        XPosHandler xpos(width, stream);
+        xpos.set_xpos(width / 2);
+
+        int reads = 0;
+        ListStream list(make_events(times, texts, 5), &reads);
+        AnnotationGraph annotations(list, &xpos);
+        annotations.y0 = 20;
+        SignalGraph graph(stream, &xpos, 0);
+        graph.y0 = 0;
+
+        draw(graph);
+        std::vector<int> edges;
+        for (int x = 0; x < width; x++)
+        {
+            if (full_column(x, 0, 16))
+                edges.push_back(x);
+        }
+
+        draw(annotations);
+        bool all_ok = edges.size() == 6;
+        for (int i = 0; i < 6; i++)
+        {
+            int x = xpos.get_x(times[i]);
+            all_ok = all_ok && edges[i] == x && full_column(x, 20, 16);
+        }
+        TEST(all_ok);
+
+        // The boxes are outlined, only the 2 pixel wide one is filled.
+        int x0 = xpos.get_x(20), x1 = xpos.get_x(60);
+        TEST(screen[x0 + 1][20] && screen[x0 + 1][35] && !screen[x0 + 1][28]);
+        TEST(full_column(xpos.get_x(121), 20, 16));
+        TEST(!full_column(xpos.get_x(123), 20, 16));
+
+        COMMENT("Test the text in the boxes");
+        int text_x;
+        std::string text = read_text(x0, x1, 20, &text_x);
+        TEST(text == "AB" && text_x == (x0 + x1 + 1 - 2 * 8) / 2);
+
+        // 60 pixels, room for 7 characters
+        x0 = xpos.get_x(60);
+        x1 = xpos.get_x(120);
+        text = read_text(x0, x1, 20, &text_x);
+        TEST(text == "LONGTE~" && text_x == (x0 + x1 + 1 - 7 * 8) / 2);
+
+        // 28 pixels, room for 3 characters
+        x0 = xpos.get_x(122);
+        x1 = xpos.get_x(150);
+        text = read_text(x0, x1, 20, &text_x);
+        TEST(text == "to~" && text_x == (x0 + x1 + 1 - 3 * 8) / 2);
+
+        // 10 pixels is too narrow for any text
+        text = read_text(xpos.get_x(150), xpos.get_x(160), 20, &text_x);
+        TEST(text == "" && text_x == -1);
+
+        COMMENT("Test zooming in, which moves the edges and fits more text");
+        xpos.set_zoom(1);
+        xpos.set_xpos(90);
+        draw(annotations);
+        x0 = xpos.get_x(60);
+        x1 = xpos.get_x(120);
+        text = read_text(x0, x1, 20, &text_x);
+        TEST(x1 - x0 == 120 && full_column(x0, 20, 16) && full_column(x1, 20, 16));
+        TEST(text == "LONGTEXT123" && text_x == (x0 + x1 + 1 - 11 * 8) / 2);
+    }
+
+    {
+        COMMENT("Test that panning inside the cached range doesn't decode again");
+        std::vector<signaltime_t> times;
+        std::vector<const char*> texts;
+        for (int i = 0; i <= 200; i++)
+        {
+            times.push_back(i * 40);
+            texts.push_back("0x55");
+        }
+        std::string signal = make_signal(times.data(), times.size());
+        TestSignalStream stream(signal.c_str(), "", "", "");
+        XPosHandler xpos(width, stream);
+        xpos.set_xpos(4000);
+
+        int reads = 0;
+        ListStream list(make_events(times.data(), texts.data(), 200), &reads);
+        AnnotationGraph annotations(CachedEventStream<TextEvent>(list, 64, 16), &xpos);
+
+        draw(annotations);
+        int first_reads = reads;
+        TEST(first_reads > 0 && first_reads <= 64 + 4);
+
+        xpos.set_xpos(4000 + 150);
+        draw(annotations);
+        xpos.set_xpos(4000);
+        draw(annotations);
+        TEST(reads == first_reads);
+
+        xpos.set_xpos(4000 + 600);
+        draw(annotations);
+        TEST(reads > first_reads);
+
+        COMMENT("Test that invalidating decodes again");
+        reads = 0;
+        annotations.invalidate_after(4000 + 700);
+        draw(annotations);
+        TEST(reads > 0 && reads <= 16 + 4);
+
+        reads = 0;
+        annotations.invalidate();
+        draw(annotations);
+        TEST(reads > 0);
+    }
+
+    {
+        COMMENT("Compare the drawing time to SignalGraph");
+        std::vector<signaltime_t> times;
+        std::vector<const char*> texts;
+        for (int i = 0; i <= 400; i++)
+        {
+            times.push_back(i * 25);
+            texts.push_back("0x55");
+        }
+        std::string signal = make_signal(times.data(), times.size());
+        TestSignalStream stream(signal.c_str(), "", "", "");
+        XPosHandler xpos(width, stream);
+        xpos.set_xpos(5000);
+
+        int reads = 0;
+        ListStream list(make_events(times.data(), texts.data(), 400), &reads);
+        AnnotationGraph annotations(list, &xpos);
+        SignalGraph graph(stream, &xpos, 0);
+
+        // The fastest of several frames, so that other processes on the PC
+        // don't disturb the comparison.
+        draw(graph);
+        draw(annotations);
+        ProfileCounter *signal_draw = find_counter("SignalGraph::Draw");
+        ProfileCounter *annotation_draw = find_counter("AnnotationGraph::Draw");
+        uint64_t signal_best = ~(uint64_t)0, annotation_best = ~(uint64_t)0;
+        for (int i = 0; i < 20 && signal_draw && annotation_draw; i++)
+        {
+            signal_draw->reset();
+            annotation_draw->reset();
+            draw(graph);
+            draw(annotations);
+
+            if (signal_draw->total < signal_best)
+                signal_best = signal_draw->total;
+            if (annotation_draw->total < annotation_best)
+                annotation_best = annotation_draw->total;
+        }
+
+        printf("Frame drawn in %lu us by SignalGraph, %lu us by AnnotationGraph\n",
+               (unsigned long)(signal_best / 1000),
+               (unsigned long)(annotation_best / 1000));
+        TEST(signal_draw && annotation_draw && annotation_draw->calls == width);
+        TEST(annotation_best < 4 * signal_best);
+    }
+
+    return status;
+}
@@ -1,54 +1,17 @@
 #include "breaklines.hh"
 #include <stdio.h>
+#include "../profiler.hh"
 
-BreakLines::BreakLines(const XPosHandler *xpos, signaltime_t tickfreq):
+BreakLines::BreakLines(const XPosHandler *xpos, frequency_t tickfreq):
     linecolor(0xFFFF), textcolor(0xFFFF), y0(20), y1(220),
-    tickfreq(tickfreq), breaks(), xpos(xpos)
+    timeformat(tickfreq), breaks(), xpos(xpos)
 {
 }
 
-void format_time(char *buf, size_t size, signaltime_t time, signaltime_t freq)
-{
-    signaltime_t nanoseconds = 1000000000 * time / freq;
-    
-    if (nanoseconds < 1000)
-    {
-        snprintf(buf, size, "%ld ns", (int32_t)nanoseconds);
-        return;
-    }
-    
-    signaltime_t divider = 1000;
-    while (nanoseconds >= 1000 * divider && divider < 1000000000)
-    {
-        divider *= 1000;
-    } 
-    
-    // Format the numeric part using 2 significant digits
-    size_t numlen;
-    int32_t integer = nanoseconds / divider;
-    if (integer < 10)
-    {
-        uint32_t fraction = (nanoseconds - integer * divider) * 10 / divider;
-        numlen = snprintf(buf, size, "%ld.%01lu", integer, fraction);
-    }
-    else
-    {
-        numlen = snprintf(buf, size, "%ld", integer);
-    }
-    
-    // Format the unit
-    buf += numlen;
-    size -= numlen;
-    if (divider == 1000)
-        snprintf(buf, size, " us");
-    else if (divider == 1000000)
-        snprintf(buf, size, " ms");
-    else
-        snprintf(buf, size, " s");
-}
-
 void BreakLines::Prepare(int xstart, int xend)
 {
+    PROFILE_SCOPE("BreakLines::Prepare");
+    
     xpos->get_breaks(breaks);
     texts.clear();
     texts.reserve(breaks.size());
@@ -64,7 +27,7 @@ void BreakLines::Prepare(int xstart, int xend)
         }
         
         char buffer[10];
-        format_time(buffer, sizeof(buffer), brk.right - brk.left, tickfreq);
+        timeformat.format(buffer, sizeof(buffer), brk.right - brk.left);
         
         texts.emplace_back(brk.x, y1, buffer);
         texts.back().halign = TextDrawable::CENTER;
@@ -76,6 +39,8 @@ void BreakLines::Prepare(int xstart, int xend)
 
 void BreakLines::Draw(uint16_t buffer[], int screenheight, int x)
 {
+    PROFILE_SCOPE("BreakLines::Draw");
+    
     const int halfwidth = separation / 2;
     
     for (auto &brk: breaks)
@@ -5,25 +5,28 @@
 #include "xposhandler.hh"
 #include "drawable.hh"
 #include "textdrawable.hh"
+#include "timeformat.hh"
 #include <vector>
 
 class BreakLines: public Drawable
 {
 public:
-    BreakLines(const XPosHandler *xpos, signaltime_t tickfreq);
+    BreakLines(const XPosHandler *xpos, frequency_t tickfreq);
     
     virtual void Prepare(int xstart, int xend);
     virtual void Draw(uint16_t buffer[], int screenheight, int x);
     
+    // Change the sample rate used for the lengths of the breaks.
+    void set_frequency(frequency_t tickfreq) { timeformat = TimeFormat(tickfreq); }
+    
     uint16_t linecolor; // Default: White
     uint16_t textcolor; // Default: White
     
     int y0; // Default: 20
     int y1; // Default: 220
     
-    signaltime_t tickfreq;
-    
 private:
+    TimeFormat timeformat;
     std::vector<XPosHandler::Break> breaks;
     std::vector<TextDrawable> texts;
     const XPosHandler *xpos;
@@ -1,4 +1,5 @@
 #include "cursor.hh"
+#include "../profiler.hh"
 
 Cursor::Cursor(const XPosHandler *xpos):
 y0(20), y1(220), linecolor(0xFFFF), xpos(xpos)
@@ -6,11 +7,15 @@ y0(20), y1(220), linecolor(0xFFFF), xpos(xpos)
 
 void Cursor::Prepare(int xstart, int xend)
 {
+    PROFILE_SCOPE("Cursor::Prepare");
+    
     middle_x = xpos->get_x(xpos->get_xpos());
 }
 
 void Cursor::Draw(uint16_t buffer[], int screenheight, int x)
 {
+    PROFILE_SCOPE("Cursor::Draw");
+    
     if (x != middle_x)
         return;
     
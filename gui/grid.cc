@@ -1,5 +1,6 @@
 #include "grid.hh"
 #include <stdio.h>
+#include "../profiler.hh"
 
 Grid::Grid(const SignalStream &stream, const XPosHandler* xpos):
     color(0xFFFF), y0(0), y1(240),
@@ -8,6 +9,8 @@ Grid::Grid(const SignalStream &stream, const XPosHandler* xpos):
 
 void Grid::Prepare(int xstart, int xend)
 {
+    PROFILE_SCOPE("Grid::Prepare");
+    
     // Note: should have some nice constant somewhere for the graph screen
     // area. Incidentally, xstart and xend would have the right values but
     // that is not how I intended them to be used. 
@@ -86,6 +89,8 @@ void Grid::Prepare(int xstart, int xend)
 
 void Grid::Draw(uint16_t buffer[], int screenheight, int x)
 {
+    PROFILE_SCOPE("Grid::Draw");
+    
     if (step == 0)
         return;
     
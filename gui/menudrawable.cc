@@ -6,6 +6,8 @@ extern "C" {
 #include "BIOS.h"
 }
 
+#include "../profiler.hh"
+
 const int borderVMargin = 5;
 const int borderHMargin = 7;
 const int spacing = 5;
@@ -63,6 +65,8 @@ void MenuDrawable::previous()
 
 void MenuDrawable::Prepare(int xstart, int xend)
 {
+    PROFILE_SCOPE("MenuDrawable::Prepare");
+    
     if (!visible)
         return;
     
@@ -92,6 +96,8 @@ void MenuDrawable::Prepare(int xstart, int xend)
 
 void MenuDrawable::Draw(uint16_t buffer[], int screenheight, int x)
 {   
+    PROFILE_SCOPE("MenuDrawable::Draw");
+    
     if (!visible)
         return;
     
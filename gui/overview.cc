@@ -0,0 +1,72 @@
+#include "overview.hh"
+#include "../profiler.hh"
+
+Overview::Overview(const ActivityHistogram *histogram, const XPosHandler *xpos,
+                   int screenwidth):
+    x0(0), x1(400), y0(0), y1(12), color(0xFFFF), viewcolor(0x4208),
+    histogram(histogram), xpos(xpos), screenwidth(screenwidth),
+    end(0), max_count(0), view_x0(0), view_x1(0)
+{
+}
+
+signaltime_t Overview::get_time(int x) const
+{
+    return (x - x0) * end / (x1 - x0);
+}
+
+void Overview::Prepare(int xstart, int xend)
+{
+    PROFILE_SCOPE("Overview::Prepare");
+    
+    end = histogram->get_end();
+    if (end < x1 - x0)
+        end = x1 - x0;
+
+    max_count = 0;
+    for (int x = x0; x < x1; x++)
+    {
+        uint32_t count = histogram->get_sum(get_time(x), get_time(x + 1));
+        if (count > max_count)
+            max_count = count;
+    }
+
+    view_x0 = x0 + xpos->get_time(0) * (x1 - x0) / end;
+    view_x1 = x0 + xpos->get_time(screenwidth) * (x1 - x0) / end;
+}
+
+void Overview::Draw(uint16_t buffer[], int screenheight, int x)
+{
+    PROFILE_SCOPE("Overview::Draw");
+    
+    if (x < x0 || x >= x1)
+        return;
+
+    int height = y1 - y0;
+    bool in_view = (x >= view_x0 && x <= view_x1);
+
+    if (in_view)
+    {
+        for (int y = y0; y < y1; y++)
+            buffer[y] = viewcolor;
+    }
+
+    if (x == view_x0 || x == view_x1)
+    {
+        for (int y = y0; y < y1; y++)
+            buffer[y] = color;
+        return;
+    }
+
+    if (max_count == 0)
+        return;
+
+    uint32_t count = histogram->get_sum(get_time(x), get_time(x + 1));
+    if (count == 0)
+        return;
+
+    // Draw at least one pixel for any activity, so that single events
+    // remain visible next to a busy burst.
+    int bar = 1 + count * (height - 1) / max_count;
+    for (int y = y0; y < y0 + bar; y++)
+        buffer[y] = color;
+}
@@ -0,0 +1,43 @@
+/* A thin strip showing the activity density over the whole capture, with
+ * the part currently visible on the screen highlighted.
+ *
+ * Drawing uses only the ActivityHistogram, so the cost is O(width)
+ * regardless of the capture size.
+ */
+
+#pragma once
+
+#include "drawable.hh"
+#include "xposhandler.hh"
+#include "activityhistogram.hh"
+
+class Overview: public Drawable
+{
+public:
+    // Screenwidth is the width of the area that xpos maps to.
+    Overview(const ActivityHistogram *histogram, const XPosHandler *xpos,
+             int screenwidth);
+
+    virtual void Prepare(int xstart, int xend);
+    virtual void Draw(uint16_t buffer[], int screenheight, int x);
+
+    // Time corresponding to a column of the strip
+    signaltime_t get_time(int x) const;
+
+    int x0; // Default: 0
+    int x1; // Default: 400
+    int y0; // Default: 0
+    int y1; // Default: 12
+    uint16_t color; // Default: White
+    uint16_t viewcolor; // Default: Dark grey
+
+private:
+    const ActivityHistogram *histogram;
+    const XPosHandler *xpos;
+    int screenwidth;
+
+    signaltime_t end;
+    uint32_t max_count;
+    int view_x0;
+    int view_x1;
+};
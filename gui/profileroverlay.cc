@@ -0,0 +1,71 @@
+#include "profileroverlay.hh"
+#include "../profiler.hh"
+#include <stdio.h>
+
+extern "C" {
+#include "BIOS.h"
+}
+
+ProfilerOverlay::ProfilerOverlay(int x0, int y0):
+    x0(x0), y0(y0), width(384), color(0xFFFF), backgroundcolor(0x0000),
+    visible(false), texts(), y1(y0)
+{
+}
+
+void ProfilerOverlay::Prepare(int xstart, int xend)
+{
+    if (!visible)
+        return;
+
+    uint32_t elapsed = profiler_now() - profiler_epoch();
+    uint32_t ticks_per_us = profiler_frequency / 1000000;
+
+    texts.clear();
+
+    char buffer[50];
+    snprintf(buffer, sizeof(buffer), "%-20s %5s %6s %6s %5s",
+             "", "calls", "avg us", "max us", "load");
+    texts.emplace_back(x0, y0, buffer);
+
+    for (ProfileCounter *c = ProfileCounter::first(); c; c = c->next)
+    {
+        uint32_t avg = c->calls ? (uint32_t)(c->total / c->calls) : 0;
+        uint32_t permille = elapsed ? (uint32_t)(c->total * 1000 / elapsed) : 0;
+        snprintf(buffer, sizeof(buffer), "%-20.20s %5lu %6lu %6lu %3lu.%lu",
+                 c->name, (unsigned long)c->calls,
+                 (unsigned long)(avg / ticks_per_us),
+                 (unsigned long)(c->max / ticks_per_us),
+                 (unsigned long)(permille / 10), (unsigned long)(permille % 10));
+
+        int y = y0 - FONT_HEIGHT * texts.size();
+        texts.emplace_back(x0, y, buffer);
+    }
+
+    for (TextDrawable &text: texts)
+    {
+        text.color = color;
+        text.Prepare(xstart, xend);
+    }
+
+    y1 = y0 - FONT_HEIGHT * texts.size();
+
+    if (elapsed > profiler_frequency)
+        profiler_reset();
+}
+
+void ProfilerOverlay::Draw(uint16_t buffer[], int screenheight, int x)
+{
+    if (!visible || x < x0 || x >= x0 + width)
+        return;
+
+    for (int y = y1; y < y0 && y < screenheight; y++)
+    {
+        if (y >= 0)
+            buffer[y] = backgroundcolor;
+    }
+
+    for (TextDrawable &text: texts)
+    {
+        text.Draw(buffer, screenheight, x);
+    }
+}
@@ -0,0 +1,30 @@
+/* A box listing the profiler counters, for seeing the frame budget and
+ * interrupt load on the device itself. The counters are reset once per
+ * second so that the numbers show the recent behaviour.
+ */
+
+#pragma once
+
+#include "drawable.hh"
+#include "textdrawable.hh"
+#include <vector>
+
+class ProfilerOverlay: public Drawable
+{
+public:
+    ProfilerOverlay(int x0, int y0);
+
+    virtual void Prepare(int xstart, int xend);
+    virtual void Draw(uint16_t buffer[], int screenheight, int x);
+
+    int x0; // Left edge
+    int y0; // Top edge
+    int width; // Default: 384
+    uint16_t color; // Default: White
+    uint16_t backgroundcolor; // Default: Black
+    bool visible; // Default: false
+
+private:
+    std::vector<TextDrawable> texts;
+    int y1; // Bottom edge, determined by the number of counters
+};
@@ -1,14 +1,19 @@
 #include "signalgraph.hh"
+#include "projectedsignalstream.hh"
+#include "../profiler.hh"
 
 SignalGraph::SignalGraph(const SignalStream &stream, const XPosHandler *xpos, int channel):
 y0(0), height(16), color(0xFFFF),
-stream(stream.clone()), channel_mask(1 << channel),
+stream(new ProjectedSignalStream(stream, 1 << channel, index_size)),
+channel_mask(1 << channel),
 current_event(), xpos(xpos)
 {
 }
 
 void SignalGraph::Prepare(int xstart, int xend)
 {
+    PROFILE_SCOPE("SignalGraph::Prepare");
+    
     signaltime_t start = xpos->get_time(xstart);
     stream->seek(start);
     stream->read_forwards(current_event);
@@ -16,18 +21,38 @@ void SignalGraph::Prepare(int xstart, int xend)
 
 void SignalGraph::Draw(uint16_t buffer[], int screenheight, int x)
 {
+    PROFILE_SCOPE("SignalGraph::Draw");
+    
     signaltime_t time = xpos->get_time(x);
     
     signals_t positive = 0, negative = 0;
+    bool lost = false;
     
     do {
-        positive |= current_event.levels;
-        negative |= ~current_event.levels;
+        if (current_event.levels & SIGNALS_LOST)
+        {
+            lost = true;
+        }
+        else
+        {
+            positive |= current_event.levels;
+            negative |= ~current_event.levels;
+        }
     } while (current_event.end <= time && stream->read_forwards(current_event));
     
     if (current_event.end <= time)
         return; // End of stream
     
+    if (lost)
+    {
+        // Samples were lost here, draw a diagonal hatch
+        for (int y = y0; y < y0 + height; y++)
+        {
+            if ((x + y) % 4 == 0)
+                buffer[y] = color;
+        }
+    }
+    
     positive &= channel_mask;
     negative &= channel_mask;
     
@@ -19,6 +19,9 @@ public:
     int height; // Default: 16
     uint16_t color; // Default: White
     
+    // Number of long events on the channel to remember for faster seeking
+    static const size_t index_size = 8;
+    
 private:
     std::unique_ptr<SignalStream> stream;
     signals_t channel_mask;
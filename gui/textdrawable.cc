@@ -6,6 +6,8 @@ extern "C" {
 #include "BIOS.h"
 }
 
+#include "../profiler.hh"
+
 TextDrawable::TextDrawable(int x0, int y0, const char *str):
     x0(x0), y0(y0), valign(TOP), halign(LEFT), color(0xFFFF), invert(false)
 {
@@ -27,6 +29,8 @@ int TextDrawable::text_width()
 
 void TextDrawable::Draw(uint16_t buffer[], int screenheight, int x)
 {
+    PROFILE_SCOPE("TextDrawable::Draw");
+    
     int width = len * FONT_WIDTH;
     int left_edge_x = x0;
     if (halign == CENTER)
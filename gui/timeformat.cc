@@ -0,0 +1,61 @@
+#include "timeformat.hh"
+#include <stdio.h>
+
+TimeFormat::TimeFormat(frequency_t tickfreq):
+    tickfreq(tickfreq),
+    units{
+        {Reciprocal(1000), Reciprocal(100), " us"},
+        {Reciprocal(1000000), Reciprocal(100000), " ms"},
+        {Reciprocal(1000000000), Reciprocal(100000000), " s"}
+    }
+{
+}
+
+uint64_t TimeFormat::to_nanoseconds(signaltime_t ticks) const
+{
+    return tickfreq.divide((uint64_t)ticks * 1000000000);
+}
+
+uint64_t TimeFormat::to_microseconds(signaltime_t ticks) const
+{
+    return tickfreq.divide((uint64_t)ticks * 1000000);
+}
+
+void TimeFormat::format(char *buf, size_t size, signaltime_t ticks) const
+{
+    if (ticks < 0)
+    {
+        // Rounded towards zero, like a signed division would do
+        snprintf(buf, size, "%ld ns", -(long)(int32_t)to_nanoseconds(-ticks));
+        return;
+    }
+
+    uint64_t nanoseconds = to_nanoseconds(ticks);
+    if (nanoseconds < 1000)
+    {
+        snprintf(buf, size, "%ld ns", (long)nanoseconds);
+        return;
+    }
+
+    const unit_t *unit = &units[0];
+    if (nanoseconds >= 1000000000)
+        unit = &units[2];
+    else if (nanoseconds >= 1000000)
+        unit = &units[1];
+
+    // Format the numeric part using 2 significant digits
+    size_t numlen;
+    int32_t integer = unit->whole.divide(nanoseconds);
+    if (integer < 10)
+    {
+        uint32_t fraction = unit->tenths.divide(nanoseconds) - integer * 10;
+        numlen = snprintf(buf, size, "%ld.%01lu", (long)integer, (unsigned long)fraction);
+    }
+    else
+    {
+        numlen = snprintf(buf, size, "%ld", (long)integer);
+    }
+
+    if (numlen < size)
+        snprintf(buf + numlen, size - numlen, "%s", unit->name);
+}
@@ -0,0 +1,80 @@
+/* Conversion of times in ticks to engineering units for display.
+ *
+ * A 64-bit division is a slow library call on the Cortex-M3, and the
+ * labels are formatted on every frame. So the divisions by the tick
+ * frequency and by the powers of 10 are done by multiplying with a
+ * reciprocal that is computed once in the constructor. The results are
+ * exactly the same as with division.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include "signalstream.hh"
+
+// Division of 64-bit numbers by a constant 32-bit divisor.
+class Reciprocal
+{
+public:
+    Reciprocal(uint32_t divisor):
+        divisor(divisor), reciprocal(~(uint64_t)0 / divisor)
+    {
+    }
+
+    // Returns x / divisor, rounded down.
+    uint64_t divide(uint64_t x) const
+    {
+        // The estimate is at most 2 too small, as the reciprocal is
+        // rounded down.
+        uint64_t quotient = multiply_high(x, reciprocal);
+        uint64_t remainder = x - quotient * divisor;
+        while (remainder >= divisor)
+        {
+            quotient++;
+            remainder -= divisor;
+        }
+        return quotient;
+    }
+
+private:
+    uint32_t divisor;
+    uint64_t reciprocal; // 2^64 / divisor, rounded down
+
+    // Upper 64 bits of the 128-bit product
+    static uint64_t multiply_high(uint64_t a, uint64_t b)
+    {
+        uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+        uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+        uint64_t lo_hi = a_lo * b_hi;
+        uint64_t hi_lo = a_hi * b_lo;
+        uint64_t middle = ((a_lo * b_lo) >> 32) + (uint32_t)lo_hi + (uint32_t)hi_lo;
+        return a_hi * b_hi + (lo_hi >> 32) + (hi_lo >> 32) + (middle >> 32);
+    }
+};
+
+class TimeFormat
+{
+public:
+    TimeFormat(frequency_t tickfreq);
+
+    // Format as e.g. "1.5 ms", with 2 significant digits for times below
+    // 10 units and whole units for longer times.
+    void format(char *buf, size_t size, signaltime_t ticks) const;
+
+    // Non-negative time in whole nanoseconds or microseconds, rounded down.
+    uint64_t to_nanoseconds(signaltime_t ticks) const;
+    uint64_t to_microseconds(signaltime_t ticks) const;
+
+private:
+    // Divisors from nanoseconds to a unit and to tenths of it
+    struct unit_t
+    {
+        Reciprocal whole;
+        Reciprocal tenths;
+        const char *name;
+    };
+
+    Reciprocal tickfreq;
+    unit_t units[3];
+};
@@ -0,0 +1,147 @@
+#include "timeformat.hh"
+#include "unittests.h"
+#include <stdio.h>
+
+// The previous implementation in breaklines.cc, using 64-bit division.
+static void reference_format_time(char *buf, size_t size, signaltime_t time,
+                                  signaltime_t freq)
+{
+    signaltime_t nanoseconds = 1000000000 * time / freq;
+
+    if (nanoseconds < 1000)
+    {
+        snprintf(buf, size, "%ld ns", (long)(int32_t)nanoseconds);
+        return;
+    }
+
+    signaltime_t divider = 1000;
+    while (nanoseconds >= 1000 * divider && divider < 1000000000)
+    {
+        divider *= 1000;
+    }
+
+    size_t numlen;
+    int32_t integer = nanoseconds / divider;
+    if (integer < 10)
+    {
+        uint32_t fraction = (nanoseconds - integer * divider) * 10 / divider;
+        numlen = snprintf(buf, size, "%ld.%01lu", (long)integer, (unsigned long)fraction);
+    }
+    else
+    {
+        numlen = snprintf(buf, size, "%ld", (long)integer);
+    }
+
+    buf += numlen;
+    size -= numlen;
+    if (divider == 1000)
+        snprintf(buf, size, " us");
+    else if (divider == 1000000)
+        snprintf(buf, size, " ms");
+    else
+        snprintf(buf, size, " s");
+}
+
+// Simple pseudorandom numbers with a fixed seed
+static uint64_t random_state = 12345;
+static uint64_t random_u64()
+{
+    random_state = random_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return random_state;
+}
+
+// Compare the formatting of times around powers of 10 and of random times.
+static bool compare_format(frequency_t freq, signaltime_t max_time)
+{
+    TimeFormat format(freq);
+    bool all_same = true;
+
+    for (signaltime_t power = 1; power <= max_time; power *= 10)
+    {
+        for (signaltime_t delta = -30; delta <= 30; delta++)
+        {
+            // Around the power of 10 in ticks, nanoseconds and microseconds
+            signaltime_t times[3] = {power + delta, power * freq / 1000000000 + delta,
+                                     power * freq / 1000000 + delta};
+            for (signaltime_t time: times)
+            {
+                if (time < 0 || time > max_time)
+                    continue;
+
+                char a[20], b[20];
+                reference_format_time(a, sizeof(a), time, freq);
+                format.format(b, sizeof(b), time);
+                if (strcmp(a, b) != 0)
+                {
+                    printf("%lld ticks at %lu Hz: '%s' != '%s'\n", (long long)time,
+                           (unsigned long)freq, a, b);
+                    all_same = false;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < 100000; i++)
+    {
+        signaltime_t time = random_u64() % (max_time >> (random_u64() % 30));
+        char a[20], b[20];
+        reference_format_time(a, sizeof(a), time, freq);
+        format.format(b, sizeof(b), time);
+        all_same = all_same && strcmp(a, b) == 0;
+    }
+
+    return all_same;
+}
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test division with a reciprocal");
+        uint32_t divisors[] = {1, 3, 10, 1000, 500000, 1000000000, 0x7FFFFFFF, 0xFFFFFFFF};
+        bool all_ok = true;
+        for (uint32_t divisor: divisors)
+        {
+            Reciprocal reciprocal(divisor);
+            uint64_t edges[] = {0, 1, divisor - 1ULL, divisor, divisor + 1ULL,
+                                ~(uint64_t)0, ~(uint64_t)0 - divisor};
+            for (uint64_t x: edges)
+                all_ok = all_ok && reciprocal.divide(x) == x / divisor;
+
+            for (int i = 0; i < 10000; i++)
+            {
+                uint64_t x = random_u64() >> (random_u64() % 64);
+                all_ok = all_ok && reciprocal.divide(x) == x / divisor;
+            }
+        }
+        TEST(all_ok);
+    }
+
+    {
+        COMMENT("Test formatting");
+        TimeFormat format(500000);
+        char buf[20];
+        format.format(buf, sizeof(buf), 0);
+        TEST(strcmp(buf, "0 ns") == 0);
+        format.format(buf, sizeof(buf), 3);
+        TEST(strcmp(buf, "6.0 us") == 0);
+        format.format(buf, sizeof(buf), 12345);
+        TEST(strcmp(buf, "24 ms") == 0);
+        format.format(buf, sizeof(buf), 750000);
+        TEST(strcmp(buf, "1.5 s") == 0);
+        TEST(format.to_microseconds(12345) == 24690);
+        TEST(format.to_nanoseconds(1) == 2000);
+    }
+
+    {
+        COMMENT("Compare with the 64-bit division");
+        TEST(compare_format(500000, 9000000000LL));
+        TEST(compare_format(1000000, 9000000000LL));
+        TEST(compare_format(72000000, 9000000000LL));
+        TEST(compare_format(32768, 9000000000LL));
+        TEST(compare_format(7, 9000000000LL));
+    }
+
+    return status;
+}
@@ -1,18 +1,104 @@
 #include <stdio.h>
 #include "timemeasure.hh"
-#include "dsosignalstream.hh"
 #include "../mathutils.h"
+#include "../profiler.hh"
 
-TimeMeasure::TimeMeasure(const XPosHandler *xpos):
-y0(20), y1(200), linecolor(0xFFFF), state(HIDDEN), xpos(xpos),
-text(0, 0, "")
+TimeMeasure::TimeMeasure(const SignalStream &stream, const XPosHandler *xpos):
+y0(20), y1(200), linecolor(0xFFFF), state(HIDDEN), stream(stream.clone()),
+xpos(xpos), text(0, 0, ""), tickfreq(stream.get_frequency()),
+timeformat(tickfreq), have_measurement(false), generation(0)
 {
     text.valign = TextDrawable::BOTTOM;
     text.halign = TextDrawable::CENTER;
+    
+    for (int i = 0; i < SignalMeasurement::channels; i++)
+    {
+        channel_y[i] = -1;
+        channel_color[i] = 0xFFFF;
+        
+        channel_texts.emplace_back(0, 0, "");
+        channel_texts.back().valign = TextDrawable::BOTTOM;
+        channel_texts.back().halign = TextDrawable::CENTER;
+    }
+}
+
+// Format the mean frequency of the periods, with 2 or 3 significant digits.
+static void format_frequency(char *buf, size_t size, const ChannelMeasurement &channel,
+                             signaltime_t freq)
+{
+    // A 64-bit division is a slow library call, so scale the operands down
+    // to 32 bits. The periods are at least a tick, so the frequency is at
+    // most freq and the divisor keeps at least 8 significant bits.
+    uint64_t numerator = (uint64_t)channel.periods * freq * 10;
+    uint64_t divisor = channel.period_sum;
+    while ((numerator | divisor) >> 32)
+    {
+        numerator >>= 1;
+        divisor >>= 1;
+    }
+    
+    uint32_t tenths = (uint32_t)numerator / (uint32_t)divisor;
+    
+    if (tenths < 100)
+        snprintf(buf, size, "%lu.%lu Hz", (unsigned long)tenths / 10,
+                 (unsigned long)tenths % 10);
+    else if (tenths < 10000)
+        snprintf(buf, size, "%lu Hz", (unsigned long)tenths / 10);
+    else if (tenths < 100000)
+        snprintf(buf, size, "%lu.%lu kHz", (unsigned long)tenths / 10000,
+                 (unsigned long)(tenths / 1000) % 10);
+    else if (tenths < 10000000)
+        snprintf(buf, size, "%lu kHz", (unsigned long)tenths / 10000);
+    else
+        snprintf(buf, size, "%lu.%lu MHz", (unsigned long)tenths / 10000000,
+                 (unsigned long)(tenths / 1000000) % 10);
+}
+
+void TimeMeasure::set_frequency(frequency_t tickfreq)
+{
+    this->tickfreq = tickfreq;
+    timeformat = TimeFormat(tickfreq);
+    have_measurement = false;
+}
+
+void TimeMeasure::Measure(signaltime_t start, signaltime_t end)
+{
+    PROFILE_SCOPE("TimeMeasure::Measure");
+    
+    stream->measure(start, end, measurement);
+    have_measurement = true;
+    generation = stream->get_generation();
+    
+    for (int i = 0; i < SignalMeasurement::channels; i++)
+    {
+        const ChannelMeasurement &channel = measurement.channel[i];
+        int duty = measurement.duty_cycle(i) / 10;
+        char buffer[48];
+        
+        if (channel.periods > 0)
+        {
+            char frequency[12], period_min[10], period_max[10];
+            format_frequency(frequency, sizeof(frequency), channel, tickfreq);
+            timeformat.format(period_min, sizeof(period_min), channel.period_min);
+            timeformat.format(period_max, sizeof(period_max), channel.period_max);
+            snprintf(buffer, sizeof(buffer), "%lu edges  %s  %d%%  T %s..%s",
+                     (unsigned long)channel.edges, frequency, duty,
+                     period_min, period_max);
+        }
+        else
+        {
+            snprintf(buffer, sizeof(buffer), "%lu edges  %d%%",
+                     (unsigned long)channel.edges, duty);
+        }
+        
+        channel_texts[i].set_text(buffer);
+    }
 }
 
 void TimeMeasure::Prepare(int xstart, int xend)
 {
+    PROFILE_SCOPE("TimeMeasure::Prepare");
+    
     if (state == HIDDEN)
         return;
     
@@ -33,16 +119,37 @@ void TimeMeasure::Prepare(int xstart, int xend)
     text.x0 = (x0 + x1) / 2;
     text.y0 = y1;
     
+    signaltime_t delta = (time2 > time1) ? time2 - time1 : time1 - time2;
     char buffer[20];
     snprintf(buffer, sizeof(buffer), "%d us",
-             (unsigned)(abs(time2 - time1) * 1000000 / DSOSignalStream::frequency));
+             (unsigned)timeformat.to_microseconds(delta));
     text.set_text(buffer);
     
     text.Prepare(xstart, xend);
+    
+    // Measure again if the range has changed, or if it extends past the
+    // data that was available last time.
+    signaltime_t start = MIN(time1, time2);
+    signaltime_t end = MAX(time1, time2);
+    if (!have_measurement || start != measurement.start || end != measurement.end ||
+        measurement.data_end < end || generation != stream->get_generation())
+    {
+        Measure(start, end);
+    }
+    
+    for (int i = 0; i < SignalMeasurement::channels; i++)
+    {
+        channel_texts[i].x0 = (x0 + x1) / 2;
+        channel_texts[i].y0 = channel_y[i];
+        channel_texts[i].color = channel_color[i];
+        channel_texts[i].Prepare(xstart, xend);
+    }
 }
 
 void TimeMeasure::Draw(uint16_t buffer[], int screenheight, int x)
 {
+    PROFILE_SCOPE("TimeMeasure::Draw");
+    
     if (state == HIDDEN)
         return;
     
@@ -70,6 +177,12 @@ void TimeMeasure::Draw(uint16_t buffer[], int screenheight, int x)
     }
     
     text.Draw(buffer, screenheight, x);
+    
+    for (int i = 0; i < SignalMeasurement::channels; i++)
+    {
+        if (channel_y[i] >= 0)
+            channel_texts[i].Draw(buffer, screenheight, x);
+    }
 }
 
 void TimeMeasure::Click()
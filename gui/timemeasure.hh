@@ -1,15 +1,25 @@
-/* A marker for measuring time between two events. */
+/* A marker for measuring time between two events.
+ *
+ * Also measures the channels over the marked range with
+ * SignalStream::measure(), and shows the edge count, frequency, duty cycle
+ * and the period range of each channel above its graph. The measurement
+ * is repeated only when the range or the data changes.
+ */
 
 #pragma once
 
+#include <memory>
+#include <vector>
 #include "drawable.hh"
+#include "signalstream.hh"
 #include "xposhandler.hh"
 #include "textdrawable.hh"
+#include "timeformat.hh"
 
 class TimeMeasure: public Drawable
 {
 public:
-    TimeMeasure(const XPosHandler *xpos);
+    TimeMeasure(const SignalStream &stream, const XPosHandler *xpos);
     
     virtual void Prepare(int xstart, int xend);
     virtual void Draw(uint16_t buffer[], int screenheight, int x);
@@ -22,6 +32,10 @@ public:
     int y1; // Default: 200
     int linecolor; // Default: White
     
+    // Bottom edge of the measurement text of each channel, -1 to hide it.
+    int channel_y[SignalMeasurement::channels]; // Default: -1
+    uint16_t channel_color[SignalMeasurement::channels]; // Default: White
+    
     // When being set using the buttons, the time measure
     // has three states: hidden, from start pos to cursor
     // and from start to end.
@@ -36,10 +50,27 @@ public:
     
     void Click();
     
+    // Change the sample rate, e.g. when a stream with another rate has
+    // been selected.
+    void set_frequency(frequency_t tickfreq);
+    
+    // Latest measurement of the range, valid when state != HIDDEN.
+    const SignalMeasurement &get_measurement() const { return measurement; }
+    
 private:
+    std::unique_ptr<SignalStream> stream;
     const XPosHandler *xpos;
     int x0;
     int x1;
     
     TextDrawable text;
+    frequency_t tickfreq;
+    TimeFormat timeformat;
+    
+    SignalMeasurement measurement;
+    bool have_measurement;
+    uint32_t generation;
+    std::vector<TextDrawable> channel_texts;
+    
+    void Measure(signaltime_t start, signaltime_t end);
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "window.hh"
+#include "../profiler.hh"
 
 Window::Window(int x0, int y0, int x1, int y1):
     items(), x0(x0), y0(y0), x1(x1), y1(y1)
@@ -7,6 +8,8 @@ Window::Window(int x0, int y0, int x1, int y1):
 
 void Window::Prepare(int xstart, int xend)
 {
+    PROFILE_SCOPE("Window::Prepare");
+    
     if (xend <= x0 || xstart >= x1)
         return;
     
@@ -27,6 +30,8 @@ void Window::Prepare(int xstart, int xend)
 
 void Window::Draw(uint16_t buffer[], int screenheight, int x)
 {
+    PROFILE_SCOPE("Window::Draw");
+    
     if (x < x0 || x >= x1)
         return;
     
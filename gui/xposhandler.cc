@@ -40,8 +40,12 @@ extern "C" {
 #include "stdio.h"
 }
 
+#include "../profiler.hh"
+
 void XPosHandler::set_zoom(int zoom)
 {
+    PROFILE_SCOPE("XPosHandler::set_zoom");
+    
     this->zoom = zoom;
     
     stream->seek(x_pos);
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <algorithm>
 
 extern "C" {
 #include "BIOS.h"
@@ -11,6 +12,7 @@ extern "C" {
 #include "Interrupt.h"
 #include "irq.h"
 #include "buttons.h"
+#include "events.h"
 #include "lcd.h"
 }
 
@@ -23,8 +25,26 @@ extern "C" {
 #include "window.hh"
 #include "cursor.hh"
 #include "timemeasure.hh"
+#include "timeformat.hh"
 #include "grid.hh"
 #include "menudrawable.hh"
+#include "capture.hh"
+#include "overview.hh"
+#include "profileroverlay.hh"
+#include "profiler.hh"
+#include "vcdwriter.hh"
+#include "sigrokwriter.hh"
+#include "capturestreamer.hh"
+#include "capturefile.hh"
+#include "capturestream.hh"
+#include "sectorcache.hh"
+#include "selectedsignalstream.hh"
+#include "annotationgraph.hh"
+#include "cachedeventstream.hh"
+#include "uartdecoder.hh"
+#include "spidecoder.hh"
+#include "i2cdecoder.hh"
+#include "modbusdecoder.hh"
  
 //define some colors
 #define WHITE   0xFFFF
@@ -44,135 +64,301 @@ static const uint32_t hl_set[2] = {1 << (16 + 5), 1 << 5};
 static uint32_t adc_fifo[256];
 #define ADC_FIFO_HALFSIZE (sizeof(adc_fifo) / sizeof(uint32_t) / 2)
 
-struct signal_buffer_t signal_buffer = {0, 0};
+// Time available for processing one half of adc_fifo, in profiler ticks.
+#define ADC_FIFO_HALFPERIOD \
+    (ADC_FIFO_HALFSIZE * (profiler_frequency / DSOSignalStream::frequency))
 
-enum menu1_entry {ENTRY_MEMORY_DUMP = 4, 
+enum menu1_entry {ENTRY_MEMORY_DUMP = 9, 
                  ENTRY_NORMAL_SCROLL = 0, 
-                 ENTRY_TRANSIENT_SCROLL = 1};
+                 ENTRY_TRANSIENT_SCROLL = 1,
+                 ENTRY_PROFILER = 2,
+                 ENTRY_PROFILER_DUMP = 3,
+                 ENTRY_SAVE_CAPTURE = 4,
+                 ENTRY_LOAD_CAPTURE = 5,
+                 ENTRY_EXPORT_SIGROK = 6,
+                 ENTRY_USART_STREAM = 7,
+                 ENTRY_DECODER = 8};
                  
 enum scroll_mode_enum {NORMAL_SCROLL, TRANSIENT_SCROLL};
 
 scroll_mode_enum scroll_mode;
 
-// This function is the hotspot of the whole capture process.
-// It compares the samples until it finds an edge.
-const uint32_t * __attribute__((optimize("O3")))
-find_edge(const uint32_t *data, const uint32_t *end, const uint32_t mask, const uint32_t old)
+// Channels whose edges TRANSIENT_SCROLL stops at
+static signals_t transient_channels;
+
+// Protocol decoders that can be shown above the signals. Clicking the menu
+// entry selects the next one.
+enum decoder_enum {DECODER_OFF, DECODER_UART_9600, DECODER_UART_38400,
+                   DECODER_MODBUS_9600, DECODER_SPI, DECODER_I2C, DECODER_COUNT};
+static const char *decoder_names[DECODER_COUNT] = {
+    "Decoder: Off", "UART 9600 A", "UART 38400 A", "Modbus 9600 A",
+    "SPI D:CS A:SCK", "I2C A:SCL B:SDA"};
+static const char *decoder_labels[DECODER_COUNT] = {
+    "", "UART", "UART", "Modbus", "SPI", "I2C"};
+
+// Live capture streaming over USART1, NULL when not streaming.
+// usart_stopping is 1 while waiting to queue the end frame, and 2 while
+// the last bytes are being sent.
+static CaptureStreamer *usart_streamer;
+static int usart_stopping;
+
+// Adapter for accessing the DMA channel 4 flags from capture_irq()
+struct HardwareDma
 {
-    // Get to a 4xsizeof(int) boundary
-    while (((uint32_t)data & 0x0F) != ((uint32_t)adc_fifo & 0x0F))
+    uint32_t flags()
+    {
+        uint32_t isr = DMA1->ISR;
+        uint32_t result = 0;
+        if (isr & DMA_ISR_HTIF4) result |= DMA_HALF;
+        if (isr & DMA_ISR_TCIF4) result |= DMA_FULL;
+        if (isr & DMA_ISR_TEIF4) result |= DMA_ERROR;
+        return result;
+    }
+    
+    void clear(uint32_t flags)
     {
-        if ((*data & mask) != old) return data;
-        data++;
+        uint32_t ifcr = 0;
+        if (flags & DMA_HALF) ifcr |= DMA_IFCR_CHTIF4;
+        if (flags & DMA_FULL) ifcr |= DMA_IFCR_CTCIF4;
+        if (flags & DMA_ERROR) ifcr |= DMA_IFCR_CTEIF4;
+        DMA1->IFCR = ifcr;
     }
+};
+
+void __irq__ DMA1_Channel4_IRQHandler()
+{
+    PROFILE_SCOPE("DMA1_Ch4_IRQ");
+    HardwareDma dma;
     
-    while (data < end)
+    size_t bytes = signal_buffer.bytes;
+    capture_status_t status = capture_irq(dma, adc_fifo, ADC_FIFO_HALFSIZE);
+    
+    if (signal_buffer.bytes != bytes)
+        post_event(EVENT_CAPTURE);
+    
+    if (status == CAPTURE_DMA_ERROR)
+    {
+        crash_with_message("Oh noes: DMA channel 4 transfer error!",
+            __builtin_return_address(0)
+        );
+        while(1);
+    }
+    else if (status == CAPTURE_SYNC_ERROR)
+    {
+        crash_with_message("Lost the H_L sync", __builtin_return_address(0));
+        while(1);
+    }
+    else if (status == CAPTURE_FULL && !usart_streamer)
+    {
+        // Buffer is full. When streaming, the capture continues once the
+        // sent data has been discarded, and the gap is marked as lost.
+        NVIC_DisableIRQ(DMA1_Channel4_IRQn);
+    }
+}
+
+// Transmit interrupt for streaming the capture over USART1. The USART1 TX
+// DMA channel is the one used by the capture, so this is byte at a time.
+void __irq__ USART1_IRQHandler()
+{
+    uint8_t byte;
+    if (usart_streamer && usart_streamer->get_byte(byte))
+        USART1->DR = byte;
+    else
+    {
+        USART1->CR1 &= ~USART_CR1_TXEIE;
+        post_event(EVENT_STREAM);
+    }
+}
+
+// Start or stop streaming the live capture over USART1.
+static void toggle_streaming()
+{
+    if (!usart_streamer)
+    {
+        usart_streamer = new CaptureStreamer(&signal_buffer);
+        usart_stopping = 0;
+        usart_streamer->start(DSOSignalStream::frequency);
+        USART1->CR1 |= USART_CR1_TXEIE;
+    }
+    else if (!usart_stopping)
     {
-        if ((*data & mask) != old) return data;
-        data++;
-        if ((*data & mask) != old) return data;
-        data++;
-        if ((*data & mask) != old) return data;
-        data++;
-        if ((*data & mask) != old) return data;
-        data++;
+        usart_stopping = 1;
     }
     
-    return end;
+    post_event(EVENT_STREAM);
 }
 
-static void
-process_samples(const uint32_t *data) 
+// Queue new data for the serial port, and remove the data that has been
+// sent from the signal buffer once it is half full. Returns true if the
+// buffer was rewound, which invalidates the positions of the streams.
+static bool service_streaming()
 {
-    static uint32_t old = 0;
-    static signaltime_t count = 0;
+    if (!usart_streamer)
+        return false;
     
-    // Compare the highest bit of each channel and the digital inputs.
-    const uint32_t mask = 0x00038080;
+    bool queued = false;
+    while (usart_streamer->poll())
+        queued = true;
     
-    const uint32_t *end = data + ADC_FIFO_HALFSIZE;
-    for(;;)
+    if (usart_stopping == 1)
     {
-        const uint32_t *start = data;
-        data = find_edge(data, end, mask, old);
-        
-        // Update count
-        count += data - start;
-        
-        if (data == end)
-            break; // All done.
-        
-        // Just a sanity-check
-        if (*data & 0xFF000000)
+        __disable_irq();
+        if (usart_streamer->finish())
         {
-            crash_with_message("Lost the H_L sync", __builtin_return_address(0));
-            while(1);
-        }
-        
-        // We may need up to 10 bytes of space in the buffer
-        if (sizeof(signal_buffer.storage) < signal_buffer.bytes + 10)
-        {
-            // Buffer is full
-            NVIC_DisableIRQ(DMA1_Channel4_IRQn);
-            return;
+            queued = true;
+            usart_stopping = 2;
         }
+        __enable_irq();
+    }
+    
+    if (queued)
+        USART1->CR1 |= USART_CR1_TXEIE;
+    
+    if (usart_stopping == 2 && usart_streamer->idle())
+    {
+        NVIC_DisableIRQ(USART1_IRQn);
+        CaptureStreamer *streamer = usart_streamer;
+        usart_streamer = NULL;
+        NVIC_EnableIRQ(USART1_IRQn);
+        delete streamer;
+        return false;
+    }
+    
+    // Move only a small unsent tail, as the interrupts are disabled
+    size_t sent = usart_streamer->bytes_queued();
+    if (signal_buffer.bytes > sizeof(signal_buffer.storage) / 2 &&
+        sent > 0 && signal_buffer.bytes - sent < 1024)
+    {
+        __disable_irq();
+        capture_discard(sent);
+        usart_streamer->discard(sent);
+        __enable_irq();
+        return true;
+    }
+    
+    return false;
+}
 
-        // Write the value as base-128 varint (google protobuf-style)
-        uint64_t value_to_write = (count << 4) + signal_buffer.last_value;
-        uint8_t *p = signal_buffer.storage + signal_buffer.bytes;
-        int i = 0;
-        while (value_to_write)
-        {
-            p[i] = (value_to_write & 0x7F) | 0x80;
-            value_to_write >>= 7;
-            i++;
-        }
-        p[i - 1] &= 0x7F; // Unset top bit on last byte
-        signal_buffer.bytes += i;
+// Flush callback for SectorWriter, the data is already in the sector buffer.
+static bool write_sector(const uint8_t *sector, void *context)
+{
+    return _fwrite_sector();
+}
 
-        // Prepare for seeking the next edge
-        old = (*data & mask);
-        count = 0;
-        
-        signal_buffer.last_value = 0;
-        if (*data & 0x00000080) signal_buffer.last_value |= 1; // Channel A
-        if (*data & 0x00008000) signal_buffer.last_value |= 2; // Channel B
-        if (*data & 0x00010000) signal_buffer.last_value |= 4; // Channel C
-        if (*data & 0x00020000) signal_buffer.last_value |= 8; // Channel D
+// Read callback for SectorCache
+static bool read_sector(uint32_t sector, uint8_t *buffer, void *context)
+{
+    return _fread_sector(sector, buffer);
+}
+
+// Events kept by the graph of the decoder, so that the decoder doesn't
+// run again on every frame.
+static const size_t decoder_cache_events = 64;
+static const size_t decoder_cache_chunk = 16;
+
+// Graph of the events of a decoder, through a cache of them.
+template <typename T>
+static AnnotationGraph *create_cached_graph(const TypedEventStream<T> &decoder,
+                                            const XPosHandler *xpos)
+{
+    return new AnnotationGraph(CachedEventStream<T>(decoder, decoder_cache_events,
+                                                    decoder_cache_chunk), xpos);
+}
+
+// Create the graph for a decoder reading the signals from stream, or return
+// NULL for DECODER_OFF. The graph keeps its own clone of the decoder.
+static AnnotationGraph *create_decoder_graph(int decoder, const SignalStream &stream,
+                                             const XPosHandler *xpos)
+{
+    if (decoder == DECODER_UART_9600 || decoder == DECODER_UART_38400)
+    {
+        uart_config_t config = {stream.get_frequency(),
+                                (decoder == DECODER_UART_9600) ? 9600u : 38400u,
+                                8, UART_PARITY_NONE, 1, 0};
+        return create_cached_graph(UartDecoder(stream, config), xpos);
+    }
+    else if (decoder == DECODER_MODBUS_9600)
+    {
+        uart_config_t config = {stream.get_frequency(), 9600, 8,
+                                UART_PARITY_NONE, 1, 0};
+        return create_cached_graph(ModbusDecoder(UartDecoder(stream, config)), xpos);
+    }
+    else if (decoder == DECODER_SPI)
+    {
+        // Mode 0, MOSI on B and MISO on C
+        spi_config_t config = {3, 0, 1, 2, false, false, false, false, 8};
+        return create_cached_graph(SpiDecoder(stream, config), xpos);
+    }
+    else if (decoder == DECODER_I2C)
+    {
+        i2c_config_t config = {0, 1, -1};
+        return create_cached_graph(I2cTransactionStream(I2cDecoder(stream, config)), xpos);
     }
     
-    signal_buffer.last_duration = count;
+    return NULL;
 }
 
-void __irq__ DMA1_Channel4_IRQHandler()
+// Replace the graph of the decoder with a new one, e.g. when the decoder
+// or the sample rate of the stream has changed.
+static void replace_decoder_graph(std::unique_ptr<AnnotationGraph> &graph, Window &window,
+                                  int decoder, const SignalStream &stream,
+                                  const XPosHandler *xpos)
 {
-    if (DMA1->ISR & DMA_ISR_TEIF4)
+    if (graph)
+        window.items.erase(std::find(window.items.begin(), window.items.end(), graph.get()));
+    
+    graph.reset(create_decoder_graph(decoder, stream, xpos));
+    if (graph)
     {
-        crash_with_message("Oh noes: DMA channel 4 transfer error!",
-            __builtin_return_address(0)
-        );
-        while(1);
+        graph->y0 = 186;
+        graph->color = WHITE;
+        window.items.push_back(graph.get());
     }
-    else if (DMA1->ISR & DMA_ISR_HTIF4)
+}
+
+// Open the most recently saved capture file. Returns a new stream for
+// reading it, or NULL if there is no valid capture file. The activity
+// histogram is updated to show the file, estimated from its index.
+static CaptureFileStream<SectorCache> *load_capture(SectorCache *cache, const char **name)
+{
+    static char filename[13];
+    int i = 0;
+    while (i <= 999)
     {
-        process_samples(&adc_fifo[0]);
-        DMA1->IFCR = DMA_IFCR_CHTIF4;
-        if (DMA1->ISR & DMA_ISR_TCIF4)
-        {
-            crash_with_message("Oh noes: ADC fifo overflow in HTIF", __builtin_return_address(0));
-            while(1);
-        }
+        snprintf(filename, sizeof(filename), "LOGIC%03d.CAP", i);
+        if (!_fexists(filename)) break;
+        i++;
     }
-    else if (DMA1->ISR & DMA_ISR_TCIF4)
+    
+    if (i == 0)
+        return NULL;
+    
+    snprintf(filename, sizeof(filename), "LOGIC%03d.CAP", i - 1);
+    *name = filename;
+    if (!_fopen_rd(filename))
+        return NULL;
+    
+    cache->invalidate();
+    capture_header_t header;
+    cache->read(0, &header, sizeof(header));
+    if (!cache->ok() || !capturefile_read_header((const uint8_t*)&header, header))
+        return NULL;
+    
+    // Stop the capture, as the overview now shows the file
+    NVIC_DisableIRQ(DMA1_Channel4_IRQn);
+    
+    CaptureFileStream<SectorCache> *stream =
+        new CaptureFileStream<SectorCache>(cache, header);
+    
+    capturefile_estimate_activity(cache, header, activity_histogram);
+    
+    if (!cache->ok())
     {
-        process_samples(&adc_fifo[ADC_FIFO_HALFSIZE]);
-        DMA1->IFCR = DMA_IFCR_CTCIF4;
-        if (DMA1->ISR & DMA_ISR_HTIF4)
-        {
-            crash_with_message("Oh noes: ADC fifo overflow in TCIF", __builtin_return_address(0));
-            while(1);
-        }
+        delete stream;
+        return NULL;
     }
+    
+    return stream;
 }
 
 void start_capture()
@@ -199,8 +385,7 @@ void start_capture()
     TIM1->CCR4 = 2;
     
     // Reset the signal buffer
-    signal_buffer.last_duration = 0;
-    signal_buffer.bytes = 0;
+    capture_reset(ADC_FIFO_HALFPERIOD);
     
     // DMA1 channel 3: copy data from hl_set to GPIOC->BSRR
     // Priority: very high
@@ -245,10 +430,15 @@ void start_capture()
 
 void draw_screen(const std::vector<Drawable*> &objs, int startx, int endx)
 {
+    PROFILE_SCOPE("draw_screen");
+    
     const int screenheight = 240;
     uint16_t buffer1[screenheight];
     uint16_t buffer2[screenheight];
     
+    // The events read while drawing are released all at once afterwards.
+    EventPool::begin_frame();
+    
     for (Drawable *d: objs)
     {
         d->Prepare(startx, endx);
@@ -267,6 +457,8 @@ void draw_screen(const std::vector<Drawable*> &objs, int startx, int endx)
         
         lcd_write_dma(buffer, screenheight);
     }
+    
+    EventPool::end_frame();
 }
 
 #include "gpio.h"
@@ -286,7 +478,7 @@ void show_status(const std::vector<Drawable*> &screenobjs, TextDrawable &statust
     draw_screen(screenobjs, 0, 400);
 }
 
-void menu_click(int index, MenuDrawable *menu)
+void menu_click(int index, MenuDrawable *menu, ProfilerOverlay *profiler)
 {
     if (index == ENTRY_MEMORY_DUMP)  //do a memory dump
     {
@@ -301,15 +493,36 @@ void menu_click(int index, MenuDrawable *menu)
     }
     else if (index == ENTRY_TRANSIENT_SCROLL)
     {
+        // Clicking again selects the channels: all, A, B, C, D
+        if (scroll_mode == TRANSIENT_SCROLL)
+            transient_channels = (transient_channels == 0x0F) ? 1 : (transient_channels << 1) & 0x0F;
+        if (transient_channels == 0)
+            transient_channels = 0x0F;
+        
+        static const char *labels[] = {"Trans. Scroll A", "Trans. Scroll B",
+                                       "Trans. Scroll C", "Trans. Scroll D"};
+        int channel = __builtin_ctz(transient_channels);
+        menu->setText(1, (transient_channels == 0x0F) ? "Trans. Scroll" : labels[channel]);
         menu->setColor(0, GREY);
         menu->setColor(1, WHITE);
         scroll_mode = TRANSIENT_SCROLL;
     }
+    else if (index == ENTRY_PROFILER)
+    {
+        profiler->visible = !profiler->visible;
+        menu->setColor(2, profiler->visible ? WHITE : GREY);
+        profiler_reset();
+    }
+    else if (index == ENTRY_PROFILER_DUMP)
+    {
+        profiler_dump();
+    }
 }
 
 int main(void)
 {   
     __Set(BEEP_VOLUME, 0);
+    profiler_init();
     __Display_Str(80, 50, RGB565RGB(0,255,0), 0, (u8*)"Logic Analyzer (c) 2012 jpa");
     
     lcd_init();
@@ -321,6 +534,8 @@ int main(void)
     USART1->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE;
     gpio_usart1_tx_mode(GPIO_AFOUT_10);
     gpio_usart1_rx_mode(GPIO_HIGHZ_INPUT);
+    NVIC_SetPriority(USART1_IRQn, 2); // Below the capture DMA
+    NVIC_EnableIRQ(USART1_IRQn);
     
     __Set(ADC_CTRL, EN);       
     __Set(ADC_MODE, SEPARATE);               
@@ -348,8 +563,17 @@ int main(void)
     
     start_capture();
     
-    DSOSignalStream stream(&signal_buffer);
+    DSOSignalStream live_stream(&signal_buffer);
+    StreamSelector selector(&live_stream);
+    SelectedSignalStream stream(&selector);
+    
+    // Capture file that is being browsed instead of the live capture, if any.
+    // The sector cache is too large for the stack, so it is allocated only
+    // while a file is open.
+    std::unique_ptr<SectorCache> file_cache;
+    std::unique_ptr<CaptureFileStream<SectorCache> > file_stream;
     XPosHandler xpos(400, stream);
+    TimeFormat timeformat(stream.get_frequency());
     
     //init gui
     std::vector<Drawable*> screenobjs;
@@ -380,17 +604,31 @@ int main(void)
         screenobjs.push_back(text);
     }
     
-    BreakLines breaklines(&xpos, 500000);
+    BreakLines breaklines(&xpos, stream.get_frequency());
     breaklines.linecolor = RGB565RGB(127, 127, 127);
     breaklines.textcolor = RGB565RGB(127, 127, 127);
     breaklines.y0 = 50;
     breaklines.y1 = 180;
     graphwindow.items.push_back(&breaklines);
     
-    TimeMeasure timemeasure(&xpos);
+    TimeMeasure timemeasure(stream, &xpos);
     timemeasure.linecolor = 0xFF00;
+    for (int i = 0; i < 4; i++)
+    {
+        // Above the graph of the channel
+        timemeasure.channel_y[i] = 150 - i * 30 + 16;
+        timemeasure.channel_color[i] = colors[i];
+    }
     graphwindow.items.push_back(&timemeasure);
     
+    // Decoded data above the signals, if a decoder has been selected
+    int decoder = DECODER_OFF;
+    std::unique_ptr<AnnotationGraph> decoder_graph;
+    TextDrawable decodertext(50, 194, "");
+    decodertext.valign = TextDrawable::MIDDLE;
+    decodertext.halign = TextDrawable::RIGHT;
+    screenobjs.push_back(&decodertext);
+    
     Cursor cursor(&xpos);
     cursor.linecolor = 0x00FF;
     graphwindow.items.push_back(&cursor);
@@ -411,54 +649,180 @@ int main(void)
     button4txt.invert = true;
     screenobjs.push_back(&button4txt);
     
-    MenuDrawable menu1(180,116,5);
+    Overview overview(&activity_histogram, &xpos, 400 - 64);
+    overview.x0 = 64;
+    overview.x1 = 400;
+    overview.y0 = 212;
+    overview.y1 = 222;
+    overview.color = RGB565RGB(127, 127, 127);
+    overview.viewcolor = RGB565RGB(31, 31, 63);
+    screenobjs.push_back(&overview);
+    
+    MenuDrawable menu1(180,35,10);
     menu1.setText(0,"Normal Scroll");
     menu1.setColor(0, WHITE);
     menu1.setText(1,"Trans. Scroll");
     menu1.setColor(1, GREY);
     menu1.setSeparator(1,true);
-    menu1.setText(2,"Selected");
-    menu1.setColor(2, WHITE);
-    menu1.setText(3,"Not Selected");
-    menu1.setColor(3, GREY);
+    menu1.setText(2,"Profiler");
+    menu1.setColor(2, GREY);
+    menu1.setText(3,"Profiler Dump");
     menu1.setSeparator(3, true);
-    menu1.setText(4,"Memory Dump");
+    menu1.setText(4,"Save Capture");
+    menu1.setText(5,"Load Capture");
+    menu1.setText(6,"Export Sigrok");
+    menu1.setText(7,"USART Stream");
+    menu1.setColor(7, GREY);
+    menu1.setSeparator(7, true);
+    menu1.setText(8, decoder_names[DECODER_OFF]);
+    menu1.setColor(8, GREY);
+    menu1.setSeparator(8, true);
+    menu1.setText(9,"Memory Dump");
     menu1.index = 2;
     menu1.visible = false;
     screenobjs.push_back(&menu1);
         
+    ProfilerOverlay profileroverlay(8, 224);
+    screenobjs.push_back(&profileroverlay);
+    
     TextDrawable statustext(390, 0, "");
     statustext.halign = TextDrawable::RIGHT;
     statustext.valign = TextDrawable::BOTTOM;
     screenobjs.push_back(&statustext);
     
+    TextDrawable telemetrytext(390, 14, "");
+    telemetrytext.halign = TextDrawable::RIGHT;
+    telemetrytext.valign = TextDrawable::BOTTOM;
+    screenobjs.push_back(&telemetrytext);
+    
     scroll_mode = NORMAL_SCROLL;
+    transient_channels = 0x0F;
+    
+    // New capture data is drawn at most this often, in milliseconds.
+    const uint32_t capture_redraw_interval = 100;
+    uint32_t last_redraw = get_time();
+    bool redraw = true;
+    bool capture_changed = false;
     
     while(1) {
-        xpos.set_zoom(xpos.get_zoom());
+        uint32_t events = take_events(ANY_EVENT);
+        
+        // Before service_streaming() discards any of the data
+        if (events & EVENT_CAPTURE)
+        {
+            // Decoded events that ended after the stored data may change
+            if (decoder_graph && !file_stream)
+                decoder_graph->invalidate_after(capture_stored_time());
+            
+            capture_update_stats();
+        }
+        
+        if (events & (EVENT_CAPTURE | EVENT_STREAM))
+        {
+            if (service_streaming() && !file_stream)
+            {
+                selector.select(&live_stream); // Positions have changed
+                if (decoder_graph)
+                    decoder_graph->invalidate();
+                redraw = true;
+            }
+        }
         
-        size_t free_bytes, largest_block;
-        get_malloc_memory_status(&free_bytes, &largest_block);
+        if ((events & EVENT_CAPTURE) && !file_stream)
+            capture_changed = true;
         
-        // Show_status also redraws the screen.
-        // Yeah yeah, I know it's ugly.
-        show_status(screenobjs, statustext,
-                    "Position: %u us  Buffer: %2ld %%  RAM: %4d B",
-                 (unsigned)(xpos.get_xpos() * 1000000 / DSOSignalStream::frequency),
-                    div_round(signal_buffer.bytes * 100, sizeof(signal_buffer.storage)),
-                 free_bytes);
+        if (events & EVENT_TIMER)
+        {
+            redraw = true;
+            capture_telemetry.update(signal_buffer.bytes,
+                                     sizeof(signal_buffer.storage),
+                                     DSOSignalStream::frequency);
+            
+            char buffer[CaptureTelemetry::status_length];
+            capture_telemetry.format(buffer, sizeof(buffer));
+            telemetrytext.set_text(buffer);
+            telemetrytext.color = capture_telemetry.warning() ? RGB565RGB(255, 63, 63) : WHITE;
+        }
         
-        uint32_t start = get_time();
-        uint32_t keys;
-        while (!(keys = get_keys(ANY_KEY)) && (get_time() - start) < 100);
+        if (capture_changed && get_time() - last_redraw >= capture_redraw_interval)
+            redraw = true;
         
-        if (keys & BUTTON1)
+        if (redraw)
+        {
+            xpos.set_zoom(xpos.get_zoom());
+            
+            size_t free_bytes, largest_block;
+            get_malloc_memory_status(&free_bytes, &largest_block);
+            
+            // Show_status also redraws the screen.
+            // Yeah yeah, I know it's ugly.
+            if (file_stream && !file_stream->ok())
+            {
+                // The signal ends at the failed sector
+                show_status(screenobjs, statustext,
+                            "Read error, the end of the file is not shown.");
+            }
+            else
+            {
+                // Pool is the number of decoded events that didn't fit in
+                // the EventPool and were allocated from the heap.
+                show_status(screenobjs, statustext,
+                            "Pos: %u us  Buf: %2ld %%  RAM: %4d B  Pool: %lu",
+                         (unsigned)timeformat.to_microseconds(xpos.get_xpos()),
+                            div_round(signal_buffer.bytes * 100, sizeof(signal_buffer.storage)),
+                         free_bytes, (unsigned long)EventPool::fallbacks());
+            }
+            
+            last_redraw = get_time();
+            redraw = false;
+            capture_changed = false;
+        }
+        
+        uint32_t keys = get_keys(ANY_KEY);
+        if (!keys)
+        {
+            // Sleep until something happens. Pending capture data is drawn
+            // once the redraw interval has passed, so until then the DMA
+            // interrupts don't need to wake up the loop.
+            uint32_t mask = ANY_EVENT;
+            uint32_t timeout = 0xFFFFFFFF;
+            if (capture_changed)
+            {
+                uint32_t elapsed = get_time() - last_redraw;
+                mask &= ~EVENT_CAPTURE;
+                timeout = (elapsed < capture_redraw_interval) ?
+                          capture_redraw_interval - elapsed : 0;
+            }
+            wait_events(mask, timeout);
+            continue;
+        }
+        
+        redraw = true;
+        
+        if ((keys & BUTTON1) && usart_streamer)
+        {
+            show_status(screenobjs, statustext, "Stop the USART stream first.");
+            delay_ms(3000);
+        }
+        else if (keys & BUTTON1)
         {
+            selector.select(&live_stream);
+            file_stream.reset();
+            file_cache.reset();
             start_capture();
+            timeformat = TimeFormat(stream.get_frequency());
+            breaklines.set_frequency(stream.get_frequency());
+            timemeasure.set_frequency(stream.get_frequency());
+            replace_decoder_graph(decoder_graph, graphwindow, decoder, stream, &xpos);
             xpos.set_xpos(0);
         }
         
-        if (keys & BUTTON2)
+        if ((keys & BUTTON2) && file_stream)
+        {
+            show_status(screenobjs, statustext, "Press CLEAR to return to live capture.");
+            delay_ms(3000);
+        }
+        else if (keys & BUTTON2)
         {
             stream.seek(0);
             
@@ -466,28 +830,9 @@ int main(void)
             show_status(screenobjs, statustext, "Writing data to %s ", name);
             
             _fopen_wr(name);
-            _fprintf("$version DSO Quad Logic Analyzer $end\n");
-            _fprintf("$timescale 2us $end\n");
-            _fprintf("$scope module logic $end\n");
-            _fprintf("$var wire 1 A ChannelA $end\n");
-            _fprintf("$var wire 1 B ChannelB $end\n");
-            _fprintf("$var wire 1 C ChannelC $end\n");
-            _fprintf("$var wire 1 D ChannelD $end\n");
-            _fprintf("$upscope $end\n");
-            _fprintf("$enddefinitions $end\n");
-            _fprintf("$dumpvars 0A 0B 0C 0D $end\n");
-            
-            SignalEvent event;
-            while (stream.read_forwards(event))
-            {
-                _fprintf("#%lu %dA %dB %dC %dD\n",
-                         (uint32_t)event.start,
-                         !!(event.levels & 1), !!(event.levels & 2),
-                         !!(event.levels & 4), !!(event.levels & 8)
-                );
-            }
-            
-            _fprintf("#%lu\n", (uint32_t)event.end);
+            SectorWriter output(_fsector_buffer(), write_sector);
+            VcdWriter vcd(&output);
+            vcd.write_stream(stream, "2us");
             
             if (_fclose())
             {
@@ -539,11 +884,9 @@ int main(void)
                 else if (scroll_mode == TRANSIENT_SCROLL)
                 {
                     SignalEvent event;
-                    int offset;
-                    signaltime_t center_time = xpos.get_xpos();
-                    stream.seek(center_time);
-                    stream.read_backwards(event);
-                    xpos.set_xpos(event.start);
+                    SignalSearch search = SignalSearch::edge(transient_channels);
+                    if (stream.find_backwards(xpos.get_xpos(), search, event))
+                        xpos.set_xpos(event.start);
                 }
             }
         }
@@ -563,20 +906,133 @@ int main(void)
                 else if (scroll_mode == TRANSIENT_SCROLL)
                 {
                     SignalEvent event;
-                    int offset;
-                    signaltime_t center_time = xpos.get_xpos();
-                    stream.seek(center_time);
-                    stream.read_forwards(event);
-                    xpos.set_xpos(event.end);
+                    SignalSearch search = SignalSearch::edge(transient_channels);
+                    if (stream.find_forwards(xpos.get_xpos(), search, event))
+                        xpos.set_xpos(event.start);
                 }
             }
         }
         
         if (keys & SCROLL2_PRESS)
         {
-            if (menu1.visible)
+            if (menu1.visible && menu1.index == ENTRY_SAVE_CAPTURE && file_stream)
             {
-                menu_click(menu1.index, &menu1);
+                show_status(screenobjs, statustext, "Press CLEAR to return to live capture.");
+                delay_ms(3000);
+            }
+            else if (menu1.visible && menu1.index == ENTRY_SAVE_CAPTURE)
+            {
+                char *name = select_filename("LOGIC%03d.CAP");
+                show_status(screenobjs, statustext, "Writing data to %s ", name);
+                
+                capture_info_t info = {};
+                info.frequency = DSOSignalStream::frequency;
+                info.channel_names[0] = "A";
+                info.channel_names[1] = "B";
+                info.channel_names[2] = "C";
+                info.channel_names[3] = "D";
+                
+                _fopen_wr(name);
+                SectorWriter output(_fsector_buffer(), write_sector);
+                capturefile_write(&output, &signal_buffer, info);
+                
+                if (_fclose())
+                {
+                    show_status(screenobjs, statustext, "%s successfully written", name);
+                }
+                else
+                {
+                    show_status(screenobjs, statustext, "Failed to write file.");
+                }
+                
+                delay_ms(3000);
+            }
+            else if (menu1.visible && menu1.index == ENTRY_EXPORT_SIGROK && file_stream)
+            {
+                // The loaded file can't be read while writing another one
+                show_status(screenobjs, statustext, "Press CLEAR to return to live capture.");
+                delay_ms(3000);
+            }
+            else if (menu1.visible && menu1.index == ENTRY_EXPORT_SIGROK)
+            {
+                stream.seek(0);
+                
+                char *name = select_filename("LOGIC%03d.SR");
+                show_status(screenobjs, statustext, "Writing data to %s ", name);
+                
+                _fopen_wr(name);
+                SectorWriter output(_fsector_buffer(), write_sector);
+                SigrokWriter sigrok(&output);
+                bool ok = sigrok.write_stream(stream, stream.get_frequency());
+                
+                if (_fclose() && ok)
+                {
+                    show_status(screenobjs, statustext, "%s successfully written", name);
+                }
+                else
+                {
+                    show_status(screenobjs, statustext, "Failed to write file.");
+                }
+                
+                delay_ms(3000);
+            }
+            else if (menu1.visible && menu1.index == ENTRY_USART_STREAM &&
+                     file_stream && !usart_streamer)
+            {
+                show_status(screenobjs, statustext, "Press CLEAR to return to live capture.");
+                delay_ms(3000);
+            }
+            else if (menu1.visible && menu1.index == ENTRY_USART_STREAM)
+            {
+                toggle_streaming();
+                menu1.setColor(ENTRY_USART_STREAM, usart_stopping ? GREY : WHITE);
+            }
+            else if (menu1.visible && menu1.index == ENTRY_LOAD_CAPTURE)
+            {
+                const char *name = NULL;
+                if (!file_cache)
+                    file_cache.reset(new SectorCache(read_sector));
+                
+                CaptureFileStream<SectorCache> *loaded = load_capture(file_cache.get(), &name);
+                if (!loaded && !file_stream)
+                    file_cache.reset();
+                
+                if (loaded)
+                {
+                    file_stream.reset(loaded);
+                    selector.select(loaded);
+                    
+                    // The file may have another sample rate
+                    timeformat = TimeFormat(stream.get_frequency());
+                    breaklines.set_frequency(stream.get_frequency());
+                    timemeasure.set_frequency(stream.get_frequency());
+                    replace_decoder_graph(decoder_graph, graphwindow, decoder, stream, &xpos);
+                    xpos.set_xpos(0);
+                    show_status(screenobjs, statustext, "Loaded %s", name);
+                }
+                else if (name)
+                {
+                    show_status(screenobjs, statustext, "Read error in %s", name);
+                }
+                else
+                {
+                    show_status(screenobjs, statustext, "No capture files found.");
+                }
+                
+                delay_ms(1000);
+            }
+            else if (menu1.visible && menu1.index == ENTRY_DECODER)
+            {
+                decoder = (decoder + 1) % DECODER_COUNT;
+                replace_decoder_graph(decoder_graph, graphwindow, decoder, stream, &xpos);
+                
+                decodertext.set_text(decoder_labels[decoder]);
+                menu1.setText(ENTRY_DECODER, decoder_names[decoder]);
+                menu1.setColor(ENTRY_DECODER, decoder_graph ? WHITE : GREY);
+            }
+            else if (menu1.visible)
+            {
+                menu_click(menu1.index, &menu1, &profileroverlay);
             }
             else
             {
@@ -590,6 +1046,21 @@ int main(void)
         
         if ((keys & SCROLL1_RIGHT) && zoom < 3)
             xpos.set_zoom(zoom + 1);
+        
+        if (keys & SCROLL1_PRESS)
+        {
+            // Jump to the first edge of the next burst shown in the overview
+            signaltime_t burst = activity_histogram.next_burst(xpos.get_xpos());
+            if (burst >= 0)
+            {
+                SignalEvent event;
+                stream.seek(burst);
+                if (stream.read_forwards(event) && event.start < burst)
+                    xpos.set_xpos(event.end);
+                else
+                    xpos.set_xpos(burst);
+            }
+        }
     }
     
     return 0;
@@ -0,0 +1,187 @@
+/* Lightweight instrumentation for measuring where the CPU time goes.
+ *
+ * On the device the timestamps come from the Cortex-M3 DWT cycle counter,
+ * on the host from std::chrono. Counters are plain global or function-local
+ * static objects with constexpr constructors, so they don't need static
+ * constructors (which are not run by our startup code) and they register
+ * themselves to a list on first use.
+ *
+ * Example usage:
+ * void foo()
+ * {
+ *     PROFILE_SCOPE("foo");
+ *     ...
+ * }
+ *
+ * The counters can be used from interrupts, but a single counter should
+ * only be updated from a single context.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __arm__
+
+// The DWT registers are not in our version of core_cm3.h
+#define DWT_CTRL            (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT          (*((volatile uint32_t *)0xE0001004))
+#define DWT_CTRL_CYCCNTENA  (1 << 0)
+#define DEMCR               (*((volatile uint32_t *)0xE000EDFC))
+#define DEMCR_TRCENA        (1 << 24)
+
+// Timestamps are in CPU cycles
+static const uint32_t profiler_frequency = 72000000;
+
+static inline uint32_t profiler_now()
+{
+    return DWT_CYCCNT;
+}
+
+static inline void profiler_init()
+{
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+#else
+
+#include <chrono>
+
+// Timestamps are in nanoseconds
+static const uint32_t profiler_frequency = 1000000000;
+
+static inline uint32_t profiler_now()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+static inline void profiler_init() {}
+
+#endif
+
+class ProfileCounter
+{
+public:
+    constexpr ProfileCounter(const char *name):
+        name(name), calls(0), total(0), max(0), next(0), registered(false)
+    {}
+
+    // Record one call that took the given number of timestamp ticks.
+    void add(uint32_t ticks)
+    {
+        calls++;
+        total += ticks;
+        if (ticks > max) max = ticks;
+        if (!registered) do_register();
+    }
+
+    // Record occurrences of a plain event, without timing.
+    void count(uint32_t n = 1)
+    {
+        calls += n;
+        if (!registered) do_register();
+    }
+
+    void reset()
+    {
+        calls = 0;
+        total = 0;
+        max = 0;
+    }
+
+    const char *name;
+    uint32_t calls;
+    uint64_t total; // Sum of ticks for all calls
+    uint32_t max; // Longest single call
+    ProfileCounter *next;
+
+    // First counter on the list of all counters that have been used.
+    static ProfileCounter *&first()
+    {
+        static ProfileCounter *head = 0;
+        return head;
+    }
+
+private:
+    bool registered;
+
+    void do_register()
+    {
+        registered = true;
+        ProfileCounter *old;
+        do {
+            old = first();
+            next = old;
+        } while (!__sync_bool_compare_and_swap(&first(), old, this));
+    }
+};
+
+// Measures the time from construction to the end of the scope.
+class ProfileScope
+{
+public:
+    ProfileScope(ProfileCounter &counter):
+        counter(counter), start(profiler_now())
+    {}
+
+    ~ProfileScope()
+    {
+        counter.add(profiler_now() - start);
+    }
+
+private:
+    ProfileCounter &counter;
+    uint32_t start;
+};
+
+#define _PROFILER_PASTE(x, y) _PROFILER_PASTE2(x, y)
+#define _PROFILER_PASTE2(x, y) x ## y
+
+// Time the rest of the current scope using a counter with the given name.
+#define PROFILE_SCOPE(name) \
+    static ProfileCounter _PROFILER_PASTE(_profile_counter_, __LINE__)(name); \
+    ProfileScope _PROFILER_PASTE(_profile_scope_, __LINE__)( \
+        _PROFILER_PASTE(_profile_counter_, __LINE__))
+
+// Time when the counters were last reset.
+inline uint32_t &profiler_epoch()
+{
+    static uint32_t epoch = 0;
+    return epoch;
+}
+
+// Clear all counters and start a new measurement period.
+static inline void profiler_reset()
+{
+    for (ProfileCounter *c = ProfileCounter::first(); c; c = c->next)
+        c->reset();
+
+    profiler_epoch() = profiler_now();
+}
+
+// Write the statistics of all counters since the last reset to stdout,
+// which is USART1 on the device.
+static inline void profiler_dump()
+{
+    uint32_t elapsed = profiler_now() - profiler_epoch();
+    uint32_t ticks_per_us = profiler_frequency / 1000000;
+
+    printf("--- Profile of %lu us ---\n",
+           (unsigned long)(elapsed / ticks_per_us));
+    printf("%-20s %8s %8s %8s %6s\n", "name", "calls", "avg us", "max us", "load");
+
+    for (ProfileCounter *c = ProfileCounter::first(); c; c = c->next)
+    {
+        uint32_t avg = c->calls ? (uint32_t)(c->total / c->calls) : 0;
+        uint32_t permille = elapsed ? (uint32_t)(c->total * 1000 / elapsed) : 0;
+        printf("%-20s %8lu %8lu %8lu %4lu.%lu%%\n", c->name,
+               (unsigned long)c->calls,
+               (unsigned long)(avg / ticks_per_us),
+               (unsigned long)(c->max / ticks_per_us),
+               (unsigned long)(permille / 10), (unsigned long)(permille % 10));
+    }
+}
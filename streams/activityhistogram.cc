@@ -0,0 +1,145 @@
+#include "activityhistogram.hh"
+
+// Initial bucket width is 2**initial_shift ticks
+static const int initial_shift = 8;
+
+void ActivityHistogram::reset()
+{
+    shift = initial_shift;
+    offset = 0;
+    end = 0;
+
+    for (int i = 0; i < buckets; i++)
+        counts[i] = 0;
+}
+
+void ActivityHistogram::compress()
+{
+    for (int i = 0; i < buckets / 2; i++)
+    {
+        uint32_t sum = counts[2 * i] + counts[2 * i + 1];
+        if (sum > 0xFFFF)
+            sum = 0xFFFF;
+        counts[i] = sum;
+    }
+
+    for (int i = buckets / 2; i < buckets; i++)
+        counts[i] = 0;
+
+    shift++;
+}
+
+void ActivityHistogram::add(signaltime_t time)
+{
+    signaltime_t position = time + offset;
+    while ((position >> shift) >= buckets)
+        compress();
+
+    int index = position >> shift;
+    if (counts[index] != 0xFFFF)
+        counts[index]++;
+
+    if (time > end)
+        end = time;
+}
+
+void ActivityHistogram::add_range(signaltime_t start, signaltime_t end,
+                                  uint32_t count)
+{
+    if (end <= start)
+        return;
+
+    while (((end - 1 + offset) >> shift) >= buckets)
+        compress();
+
+    int first = (start + offset) >> shift;
+    int last = (end - 1 + offset) >> shift;
+    for (int i = first; i <= last; i++)
+    {
+        signaltime_t from = ((signaltime_t)i << shift) - offset;
+        signaltime_t to = ((signaltime_t)(i + 1) << shift) - offset;
+        if (from < start)
+            from = start;
+        if (to > end)
+            to = end;
+
+        uint32_t sum = counts[i] + (uint64_t)count * (to - from) / (end - start);
+        if (sum > 0xFFFF)
+            sum = 0xFFFF;
+        counts[i] = sum;
+    }
+
+    if (end > this->end)
+        this->end = end;
+}
+
+void ActivityHistogram::set_end(signaltime_t time)
+{
+    while (((time + offset) >> shift) >= buckets)
+        compress();
+
+    end = time;
+}
+
+void ActivityHistogram::discard(signaltime_t time)
+{
+    signaltime_t position = time + offset;
+    int removed = position >> shift;
+    if (removed > buckets)
+        removed = buckets;
+
+    for (int i = 0; i < buckets; i++)
+        counts[i] = (i + removed < buckets) ? counts[i + removed] : 0;
+
+    offset = position - ((signaltime_t)removed << shift);
+    end = (end > time) ? end - time : 0;
+}
+
+uint32_t ActivityHistogram::get_sum(signaltime_t start, signaltime_t end) const
+{
+    if (start < 0)
+        start = 0;
+
+    int first = (start + offset) >> shift;
+    int last = (end - 1 + offset) >> shift;
+    if (last >= buckets)
+        last = buckets - 1;
+
+    uint32_t sum = 0;
+    for (int i = first; i <= last; i++)
+        sum += counts[i];
+
+    return sum;
+}
+
+signaltime_t ActivityHistogram::next_burst(signaltime_t time) const
+{
+    int used = ((end + offset) >> shift) + 1;
+    if (used > buckets)
+        used = buckets;
+
+    int current = (time + offset) >> shift;
+    if (current < 0 || current >= used)
+        current = 0;
+
+    // First try to find the beginning of a burst, and if everything is
+    // busy, just any bucket with activity.
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 1; i <= used; i++)
+        {
+            int index = (current + i) % used;
+
+            if (counts[index] == 0)
+                continue;
+
+            if (pass == 0 && index > 0 && counts[index - 1] != 0)
+                continue;
+
+            signaltime_t start = ((signaltime_t)index << shift) - offset;
+            return (start > 0) ? start : 0;
+        }
+    }
+
+    return -1;
+}
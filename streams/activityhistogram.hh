@@ -0,0 +1,70 @@
+/* Coarse histogram of the signal activity over the whole capture.
+ *
+ * The histogram is updated from the capture interrupt every time an edge
+ * is stored, so adding an event has to be cheap. The capture length is not
+ * known in advance, so the buckets start narrow and whenever the capture
+ * grows past the last bucket, adjacent buckets are merged and the bucket
+ * width is doubled. This keeps the memory usage constant and the update
+ * O(1) amortized.
+ *
+ * Readers don't lock anything; a merge happening in the middle of a redraw
+ * just causes a single bad frame.
+ */
+
+#pragma once
+
+#include "signalstream.hh"
+
+class ActivityHistogram
+{
+public:
+    static const int buckets = 128;
+
+    // Clear the histogram for a new capture.
+    void reset();
+
+    // Record a transition at the given time.
+    void add(signaltime_t time);
+
+    // Record a number of transitions spread evenly over the time range
+    // start <= t < end, when only their total is known.
+    void add_range(signaltime_t start, signaltime_t end, uint32_t count);
+
+    // Record the total length of the capture so far.
+    void set_end(signaltime_t time);
+
+    // Remove the given time from the start of the capture, when the data
+    // has been removed from the buffer. Later times are relative to the
+    // new start. The bucket at the new start keeps its whole count, so
+    // the removed part of it still shows.
+    void discard(signaltime_t time);
+
+    // Width of a single bucket in ticks
+    signaltime_t bucket_width() const { return (signaltime_t)1 << shift; }
+
+    // Number of transitions in a bucket (saturated at 65535). The first
+    // bucket starts at time -get_offset().
+    uint16_t get_count(int index) const { return counts[index]; }
+    signaltime_t get_offset() const { return offset; }
+
+    // Sum of counts in the time range start <= t < end, including
+    // partially covered buckets.
+    uint32_t get_sum(signaltime_t start, signaltime_t end) const;
+
+    // End time of the capture, as given to set_end() or add().
+    signaltime_t get_end() const { return end; }
+
+    // Find the start of the next burst of activity after the bucket that
+    // contains the given time, i.e. a non-empty bucket that follows an
+    // empty one. Wraps around to the start of the capture. Returns -1 if
+    // there is no activity at all.
+    signaltime_t next_burst(signaltime_t time) const;
+
+private:
+    volatile uint8_t shift;
+    volatile signaltime_t offset; // Less than the bucket width
+    volatile signaltime_t end;
+    volatile uint16_t counts[buckets];
+
+    void compress();
+};
@@ -0,0 +1,120 @@
+#include "activityhistogram.hh"
+#include "unittests.h"
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test basic counting");
+        ActivityHistogram hist;
+        hist.reset();
+
+        signaltime_t width = hist.bucket_width();
+        hist.add(0);
+        hist.add(1);
+        hist.add(width * 3);
+        hist.set_end(width * 4);
+
+        TEST(hist.get_count(0) == 2);
+        TEST(hist.get_count(1) == 0);
+        TEST(hist.get_count(3) == 1);
+        TEST(hist.get_sum(0, width * 4) == 3);
+        TEST(hist.get_sum(width, width * 3) == 0);
+        TEST(hist.get_end() == width * 4);
+    }
+
+    {
+        COMMENT("Test merging of buckets when capture grows");
+        ActivityHistogram hist;
+        hist.reset();
+
+        signaltime_t width = hist.bucket_width();
+        for (int i = 0; i < ActivityHistogram::buckets; i++)
+            hist.add(i * width);
+
+        hist.add(ActivityHistogram::buckets * width);
+
+        TEST(hist.bucket_width() == 2 * width);
+        TEST(hist.get_count(0) == 2);
+        TEST(hist.get_count(ActivityHistogram::buckets / 2 - 1) == 2);
+        TEST(hist.get_count(ActivityHistogram::buckets / 2) == 1);
+        TEST(hist.get_sum(0, hist.get_end() + 1) ==
+             ActivityHistogram::buckets + 1);
+
+        hist.set_end(100 * ActivityHistogram::buckets * width);
+        TEST(hist.bucket_width() == 128 * width);
+        TEST(hist.get_count(0) == ActivityHistogram::buckets);
+        TEST(hist.get_count(1) == 1);
+    }
+
+    {
+        COMMENT("Test finding the next burst");
+        ActivityHistogram hist;
+        hist.reset();
+
+        signaltime_t width = hist.bucket_width();
+        hist.add(2 * width);
+        hist.add(3 * width);
+        hist.add(10 * width + 5);
+        hist.set_end(20 * width);
+
+        TEST(hist.next_burst(0) == 2 * width);
+        TEST(hist.next_burst(2 * width) == 10 * width);
+        TEST(hist.next_burst(10 * width) == 2 * width);
+
+        ActivityHistogram empty;
+        empty.reset();
+        empty.set_end(20 * width);
+        TEST(empty.next_burst(0) == -1);
+    }
+
+    {
+        COMMENT("Test spreading transitions over a range");
+        ActivityHistogram hist;
+        hist.reset();
+
+        signaltime_t width = hist.bucket_width();
+        hist.add_range(width / 2, width * 3, 500);
+        TEST(hist.get_count(0) == 100);
+        TEST(hist.get_count(1) == 200);
+        TEST(hist.get_count(2) == 200);
+        TEST(hist.get_count(3) == 0);
+        TEST(hist.get_end() == width * 3);
+
+        hist.add_range(0, width * ActivityHistogram::buckets * 2, 1000);
+        TEST(hist.bucket_width() == 2 * width);
+        TEST(hist.get_count(0) == 300 + 7);
+        TEST(hist.get_sum(0, hist.get_end()) > 500 + 1000 - ActivityHistogram::buckets);
+    }
+
+    {
+        COMMENT("Test discarding the start of the capture");
+        ActivityHistogram hist;
+        hist.reset();
+
+        signaltime_t width = hist.bucket_width();
+        for (int i = 0; i < 10; i++)
+            hist.add(i * width + 1);
+        hist.set_end(width * 10);
+
+        hist.discard(width * 3 + width / 2);
+        TEST(hist.get_offset() == width / 2);
+        TEST(hist.get_end() == width * 10 - width * 3 - width / 2);
+        TEST(hist.get_count(0) == 1 && hist.get_count(6) == 1 && hist.get_count(7) == 0);
+        TEST(hist.get_sum(0, hist.get_end()) == 7);
+
+        // The edge that was at width * 4 + 1
+        TEST(hist.get_sum(width / 2 + 1, width / 2 + 2) == 1);
+        hist.add(width / 2 + 1);
+        TEST(hist.get_count(1) == 2);
+
+        // Merging keeps the buckets aligned with the offset
+        hist.add(width * ActivityHistogram::buckets);
+        TEST(hist.bucket_width() == 2 * width);
+        TEST(hist.get_count(0) == 3);
+        TEST(hist.get_sum(0, hist.get_end() + 1) == 9);
+    }
+
+    return status;
+}
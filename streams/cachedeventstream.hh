@@ -0,0 +1,259 @@
+/* Cache of the events of a decoder, so that the view can move back and
+ * forth without running the decoder again.
+ *
+ * The decoded events are stored in chunks of a fixed size in one array.
+ * Each chunk holds the events from a range of time, in order, and
+ * seek() finds the chunk containing the time and does a binary search in
+ * it. When reading goes past the cached ranges, the source is decoded
+ * from there into a new chunk, replacing the least recently used one if
+ * all are in use.
+ *
+ * The range of a chunk ends at the last event in it. So when the source
+ * runs out of data, only the events decoded so far are cached, and the
+ * next read after the end asks the source again. If more data has been
+ * captured meanwhile, the new events are appended to the last chunk.
+ * If older data changes, call invalidate() or invalidate_after().
+ *
+ * After seek(time), the source must return the first event that ends
+ * after time, like the decoders in this project do.
+ */
+
+#pragma once
+
+#include "eventstream.hh"
+
+template <typename T>
+class CachedEventStream: public TypedEventStream<T>
+{
+public:
+    // The constructor clones the source. Max_events is rounded down to a
+    // multiple of chunk_events.
+    CachedEventStream(const TypedEventStream<T> &source, size_t max_events = 256,
+                      size_t chunk_events = 32):
+        source(source.clone()), chunk_events(chunk_events),
+        chunk_count(max_events / chunk_events),
+        events(new T[chunk_count * chunk_events]),
+        chunks(new chunk_t[chunk_count]),
+        use_counter(0), current(-1), position(0), time(0)
+    {
+        invalidate();
+    }
+
+    CachedEventStream(const CachedEventStream &other):
+        TypedEventStream<T>(), source(other.source->clone()),
+        chunk_events(other.chunk_events), chunk_count(other.chunk_count),
+        events(new T[chunk_count * chunk_events]),
+        chunks(new chunk_t[chunk_count]),
+        use_counter(other.use_counter), current(other.current),
+        position(other.position), time(other.time)
+    {
+        for (size_t i = 0; i < chunk_count * chunk_events; i++)
+            events[i] = other.events[i];
+
+        for (size_t i = 0; i < chunk_count; i++)
+            chunks[i] = other.chunks[i];
+    }
+
+    virtual ~CachedEventStream() {}
+
+    // After seek(), the next event read is the first one that ends after
+    // the given time.
+    virtual void seek(signaltime_t time)
+    {
+        this->time = time;
+        current = -1;
+    }
+
+    // Read the next event. Returns false at the end of the data.
+    virtual bool read_forwards(T &result)
+    {
+        if (current < 0 && !find_chunk(time) &&
+            !fill_chunk(find_free_chunk(), time, false))
+        {
+            return false;
+        }
+
+        while (position == chunks[current].count)
+        {
+            // Continue from the chunk of the next range, or if there is
+            // none, decode more. Appending to the last chunk is tried
+            // first, as the source may have more data now.
+            int previous = current;
+            time = chunks[previous].end;
+            if (find_chunk(time))
+                break;
+
+            if (chunks[previous].count < chunk_events &&
+                fill_chunk(previous, time, true))
+            {
+                break;
+            }
+
+            if (!fill_chunk(find_free_chunk(), time, false))
+            {
+                current = previous;
+                position = chunks[previous].count;
+                return false;
+            }
+        }
+
+        result = events[current * chunk_events + position];
+        position++;
+        time = result.end;
+        return true;
+    }
+
+    // Forget all the cached events.
+    virtual void invalidate()
+    {
+        for (size_t i = 0; i < chunk_count; i++)
+            chunks[i].count = 0;
+
+        current = -1;
+    }
+
+    // Forget the events that end after the given time, e.g. if the data
+    // after it has changed.
+    virtual void invalidate_after(signaltime_t time)
+    {
+        for (size_t i = 0; i < chunk_count; i++)
+        {
+            chunk_t &chunk = chunks[i];
+            if (chunk.count == 0 || chunk.end <= time)
+                continue;
+
+            chunk.count = find_position(i, time);
+            if (chunk.count > 0)
+                chunk.end = events[i * chunk_events + chunk.count - 1].end;
+        }
+
+        current = -1;
+    }
+
+    virtual CachedEventStream* clone() const
+    {
+        return new CachedEventStream(*this);
+    }
+
+private:
+    // The chunk contains the events that end in start < t <= end.
+    struct chunk_t
+    {
+        signaltime_t start;
+        signaltime_t end;
+        size_t count; // 0 if the chunk is not in use
+        uint32_t last_used;
+    };
+
+    std::unique_ptr<TypedEventStream<T> > source;
+    size_t chunk_events;
+    size_t chunk_count;
+    std::unique_ptr<T[]> events;
+    std::unique_ptr<chunk_t[]> chunks;
+    uint32_t use_counter;
+
+    int current; // Chunk being read, or -1 if reading continues at time
+    size_t position; // Index of the next event in the current chunk
+    signaltime_t time; // End of the previous event read
+
+    // Index of the first event in the chunk that ends after time.
+    size_t find_position(int index, signaltime_t time) const
+    {
+        const T *first = &events[index * chunk_events];
+        size_t low = 0, high = chunks[index].count;
+        while (low < high)
+        {
+            size_t middle = (low + high) / 2;
+            if (first[middle].end <= time)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return low;
+    }
+
+    bool find_chunk(signaltime_t time)
+    {
+        for (size_t i = 0; i < chunk_count; i++)
+        {
+            chunk_t &chunk = chunks[i];
+            if (chunk.count > 0 && chunk.start <= time && time < chunk.end)
+            {
+                chunk.last_used = ++use_counter;
+                current = i;
+                position = find_position(i, time);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Find a free chunk, or the least recently used one.
+    int find_free_chunk() const
+    {
+        int best = 0;
+        for (size_t i = 0; i < chunk_count; i++)
+        {
+            if (chunks[i].count == 0)
+            {
+                best = i;
+                break;
+            }
+
+            if (chunks[i].last_used < chunks[best].last_used)
+                best = i;
+        }
+
+        return best;
+    }
+
+    // Decode the events after the given time into the chunk, either
+    // replacing its contents or appending to them. Returns false if there
+    // were no events, and then the chunk is unchanged.
+    bool fill_chunk(int index, signaltime_t from, bool append)
+    {
+        chunk_t &chunk = chunks[index];
+        T *first = &events[index * chunk_events];
+        size_t old_count = append ? chunk.count : 0;
+        size_t count = old_count;
+
+        source->seek(from);
+        while (count < chunk_events && source->read_forwards(first[count]))
+        {
+            if (first[count].end > from)
+                count++;
+        }
+
+        if (count == chunk_events)
+        {
+            // The next chunk continues after the end of this one, so any
+            // events that end at the same time have to go there. When
+            // appending, that may leave nothing to append, and then a new
+            // chunk is started instead.
+            size_t min_count = append ? old_count : 1;
+            T next;
+            bool have_next = source->read_forwards(next);
+            while (have_next && count > min_count &&
+                   first[count - 1].end == next.end)
+            {
+                count--;
+            }
+        }
+
+        if (count == old_count)
+            return false;
+
+        if (!append)
+            chunk.start = from;
+
+        chunk.count = count;
+        chunk.end = first[count - 1].end;
+        chunk.last_used = ++use_counter;
+        current = index;
+        position = find_position(index, from);
+        return true;
+    }
+
+    CachedEventStream &operator=(const CachedEventStream &other);
+};
@@ -0,0 +1,201 @@
+#include "cachedeventstream.hh"
+#include "unittests.h"
+#include <vector>
+
+struct TestEvent: public Event
+{
+    int value;
+};
+
+// Returns events from a vector, of which only the first *available are
+// visible. Counts the calls to read_forwards().
+class VectorEventStream: public TypedEventStream<TestEvent>
+{
+public:
+    VectorEventStream(const std::vector<TestEvent> *events, size_t *available,
+                      int *reads):
+        events(events), available(available), reads(reads), pos(0) {}
+
+    virtual void seek(signaltime_t time)
+    {
+        pos = 0;
+        while (pos < *available && (*events)[pos].end <= time)
+            pos++;
+    }
+
+    virtual bool read_forwards(TestEvent &event)
+    {
+        (*reads)++;
+        if (pos >= *available)
+            return false;
+
+        event = (*events)[pos++];
+        return true;
+    }
+
+    virtual VectorEventStream* clone() const
+    {
+        return new VectorEventStream(*this);
+    }
+
+private:
+    const std::vector<TestEvent> *events;
+    size_t *available;
+    int *reads;
+    size_t pos;
+};
+
+// Events of 10 ticks, and if with_stops is set, every third event is
+// 0-length at the end of the previous one.
+static std::vector<TestEvent> make_events(int count, bool with_stops)
+{
+    std::vector<TestEvent> result;
+    signaltime_t time = 0;
+    for (int i = 0; i < count; i++)
+    {
+        TestEvent event;
+        event.value = i;
+        if (with_stops && i % 3 == 2)
+        {
+            event.start = event.end = time;
+        }
+        else
+        {
+            event.start = time;
+            event.end = time + 10;
+            time += 10;
+        }
+        result.push_back(event);
+    }
+    return result;
+}
+
+// Check that reading after seek(time) gives the events that end after
+// time, up to count events.
+static bool check_seek(CachedEventStream<TestEvent> &stream,
+                       const std::vector<TestEvent> &events, signaltime_t time,
+                       int count)
+{
+    size_t expected = 0;
+    while (expected < events.size() && events[expected].end <= time)
+        expected++;
+
+    stream.seek(time);
+    TestEvent event;
+    for (int i = 0; i < count && expected < events.size(); i++, expected++)
+    {
+        if (!stream.read_forwards(event) || event.value != events[expected].value)
+            return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test reading through the cache");
+        std::vector<TestEvent> events = make_events(100, false);
+        size_t available = events.size();
+        int reads = 0;
+        VectorEventStream source(&events, &available, &reads);
+        CachedEventStream<TestEvent> stream(source);
+
+        TEST(check_seek(stream, events, 0, 100));
+        TEST(reads < 110);
+
+        reads = 0;
+        bool all_ok = true;
+        for (signaltime_t time = 0; time < 1000; time += 7)
+            all_ok = all_ok && check_seek(stream, events, time, 10);
+        TEST(all_ok);
+        TEST(reads == 0);
+
+        std::unique_ptr<TestEvent> allocated;
+        stream.seek(995);
+        allocated.reset(stream.read());
+        TEST(allocated && allocated->value == 99);
+        allocated.reset(stream.read());
+        TEST(!allocated);
+    }
+
+    {
+        COMMENT("Test least recently used eviction");
+        std::vector<TestEvent> events = make_events(1000, false);
+        size_t available = events.size();
+        int reads = 0;
+        VectorEventStream source(&events, &available, &reads);
+        CachedEventStream<TestEvent> stream(source, 32, 8);
+
+        TEST(check_seek(stream, events, 0, 8));
+        TEST(check_seek(stream, events, 5000, 8));
+        TEST(check_seek(stream, events, 2000, 8));
+        TEST(check_seek(stream, events, 7000, 8));
+
+        reads = 0;
+        TEST(check_seek(stream, events, 0, 8));
+        TEST(reads == 0);
+
+        TEST(check_seek(stream, events, 9000, 8));
+        TEST(reads > 0);
+
+        reads = 0;
+        TEST(check_seek(stream, events, 0, 8));
+        TEST(check_seek(stream, events, 2000, 8));
+        TEST(reads == 0);
+        TEST(check_seek(stream, events, 5000, 8));
+        TEST(reads > 0);
+    }
+
+    {
+        COMMENT("Test data added at the end");
+        std::vector<TestEvent> events = make_events(100, false);
+        size_t available = 50;
+        int reads = 0;
+        VectorEventStream source(&events, &available, &reads);
+        CachedEventStream<TestEvent> stream(source);
+
+        TestEvent event;
+        int count = 0;
+        while (stream.read_forwards(event))
+            count++;
+        TEST(count == 50);
+
+        available = 80;
+        reads = 0;
+        while (stream.read_forwards(event))
+            count++;
+        TEST(count == 80 && event.value == 79);
+        TEST(reads < 40);
+
+        reads = 0;
+        TEST(check_seek(stream, events, 0, 80));
+        TEST(reads == 0);
+        TEST(!stream.read_forwards(event));
+
+        COMMENT("Test invalidating the end");
+        events[70].value = 1000;
+        stream.invalidate_after(695);
+        reads = 0;
+        TEST(check_seek(stream, events, 0, 80));
+        TEST(reads > 0 && reads < 20);
+    }
+
+    {
+        COMMENT("Test events that end at the same time");
+        std::vector<TestEvent> events = make_events(300, true);
+        size_t available = events.size();
+        int reads = 0;
+        VectorEventStream source(&events, &available, &reads);
+        CachedEventStream<TestEvent> stream(source, 64, 8);
+
+        bool all_ok = check_seek(stream, events, 0, 300);
+        for (signaltime_t time = 0; time < 2000; time += 13)
+            all_ok = all_ok && check_seek(stream, events, time, 20);
+        TEST(all_ok);
+    }
+
+    return status;
+}
@@ -0,0 +1,252 @@
+#include "capture.hh"
+#include "varint.hh"
+#include "../profiler.hh"
+#include <string.h>
+
+struct signal_buffer_t signal_buffer = {0, 0};
+ActivityHistogram activity_histogram;
+CaptureTelemetry capture_telemetry;
+
+// Masked value of the previous sample
+static uint32_t old;
+
+// Number of samples since the latest edge
+static signaltime_t count;
+
+// Time of the latest edge written to signal_buffer, from the start of
+// the buffer.
+static signaltime_t last_edge_time;
+
+// Number of samples dropped because the interrupt fell behind.
+static volatile signaltime_t lost_samples;
+
+// Position in signal_buffer up to which the events have been added to
+// signal_buffer.stats, and the absolute time at that position.
+static size_t stats_pos;
+static signaltime_t stats_time;
+
+// Absolute time of the start of signal_buffer, i.e. the total time
+// removed with capture_discard().
+static signaltime_t discarded_time;
+
+void capture_reset(uint32_t period_ticks)
+{
+    signal_buffer.last_duration = 0;
+    signal_buffer.last_value = 0;
+    signal_buffer.bytes = 0;
+    old = 0;
+    count = 0;
+    last_edge_time = 0;
+    lost_samples = 0;
+    stats_pos = 0;
+    stats_time = 0;
+    discarded_time = 0;
+    activity_histogram.reset();
+    capture_telemetry.reset(period_ticks);
+    signal_buffer.stats.reset();
+}
+
+// This function is the hotspot of the whole capture process.
+// It compares the samples until it finds an edge.
+static const uint32_t * __attribute__((optimize("O3")))
+find_edge(const uint32_t *data, const uint32_t *end, const uint32_t mask, const uint32_t old)
+{
+    // Get to a multiple of 4 samples from the end
+    while ((end - data) & 3)
+    {
+        if ((*data & mask) != old) return data;
+        data++;
+    }
+
+    while (data < end)
+    {
+        if ((*data & mask) != old) return data;
+        data++;
+        if ((*data & mask) != old) return data;
+        data++;
+        if ((*data & mask) != old) return data;
+        data++;
+        if ((*data & mask) != old) return data;
+        data++;
+    }
+
+    return end;
+}
+
+// Append a varint to the signal_buffer
+static void write_varint(uint64_t value)
+{
+    signal_buffer.bytes += varint_encode(signal_buffer.storage + signal_buffer.bytes, value);
+}
+
+// Convert the sample bits to signals_t
+static signals_t sample_levels(uint32_t sample)
+{
+    signals_t levels = 0;
+    if (sample & 0x00000080) levels |= 1; // Channel A
+    if (sample & 0x00008000) levels |= 2; // Channel B
+    if (sample & 0x00010000) levels |= 4; // Channel C
+    if (sample & 0x00020000) levels |= 8; // Channel D
+    return levels;
+}
+
+void capture_discard(size_t bytes)
+{
+    // The main loop keeps the statistics close to the end of the buffer,
+    // so the time at the new start is found by decoding just the data
+    // after it.
+    if (stats_pos < bytes)
+        capture_update_stats();
+
+    signaltime_t start_time = stats_time;
+    size_t pos = bytes;
+    while (pos < stats_pos)
+    {
+        signaltime_t duration;
+        signals_t levels;
+        pos = varint_read_record(signal_buffer.storage, pos, duration, levels);
+        start_time -= duration;
+    }
+
+    signaltime_t removed = start_time - discarded_time;
+    discarded_time = start_time;
+    last_edge_time -= removed;
+    activity_histogram.discard(removed);
+    stats_pos -= bytes;
+
+    size_t remaining = signal_buffer.bytes - bytes;
+    memmove(signal_buffer.storage, signal_buffer.storage + bytes, remaining);
+    signal_buffer.bytes = remaining;
+}
+
+void capture_update_stats()
+{
+    // The interrupt changes the byte count whenever it stores an event, so
+    // if it stays the same, the current levels belong to the same data.
+    size_t bytes;
+    signaltime_t last_duration;
+    signals_t last_value;
+    do {
+        bytes = signal_buffer.bytes;
+        last_duration = signal_buffer.last_duration;
+        last_value = signal_buffer.last_value;
+    } while (bytes != signal_buffer.bytes ||
+             last_duration != signal_buffer.last_duration);
+
+    SignalStats &stats = signal_buffer.stats;
+    while (stats_pos < bytes)
+    {
+        signaltime_t duration;
+        signals_t levels;
+        stats_pos = varint_read_record(signal_buffer.storage, stats_pos,
+                                       duration, levels);
+
+        if (levels == SIGNALS_LOST)
+            stats.add_lost(stats_time, duration);
+        else
+            stats.add_edge(stats_time, levels);
+
+        stats_time += duration;
+    }
+
+    // The current levels have lasted since the last stored event
+    stats.add_edge(stats_time, last_value);
+    stats.set_end(stats_time + last_duration);
+}
+
+signaltime_t capture_stored_time()
+{
+    return stats_time - discarded_time;
+}
+
+void capture_lost(size_t samples)
+{
+    static ProfileCounter overruns("fifo overruns");
+    overruns.count();
+    lost_samples += samples;
+}
+
+capture_status_t capture_process(const uint32_t *data, size_t samples)
+{
+    PROFILE_SCOPE("process_samples");
+    static ProfileCounter edges("edges");
+    uint32_t start_ticks = profiler_now();
+    uint32_t edges_found = 0;
+
+    if (lost_samples)
+    {
+        // We may need up to 21 bytes for the pending event and the marker
+        if (sizeof(signal_buffer.storage) < signal_buffer.bytes + 21)
+        {
+            lost_samples += samples;
+            return CAPTURE_FULL;
+        }
+
+        // Store the pending event and the lost data marker. The marker
+        // is a zero byte followed by the number of lost ticks.
+        if (count > 0)
+            write_varint((count << 4) + signal_buffer.last_value);
+        write_varint(0);
+        write_varint(lost_samples);
+
+        last_edge_time += count + lost_samples;
+        lost_samples = 0;
+
+        // Start over from the first sample of this block
+        old = (*data & CAPTURE_SAMPLE_MASK);
+        count = 0;
+        signal_buffer.last_value = sample_levels(*data);
+    }
+
+    const uint32_t *end = data + samples;
+    for(;;)
+    {
+        const uint32_t *start = data;
+        data = find_edge(data, end, CAPTURE_SAMPLE_MASK, old);
+
+        // Update count
+        count += data - start;
+
+        if (data == end)
+            break; // All done.
+
+        // Just a sanity-check
+        if (*data & 0xFF000000)
+            return CAPTURE_SYNC_ERROR;
+
+        // We may need up to 10 bytes of space in the buffer
+        if (sizeof(signal_buffer.storage) < signal_buffer.bytes + 10)
+        {
+            // The rest of the block is lost, in case the capture continues
+            // after capture_discard().
+            lost_samples += end - data;
+            signal_buffer.last_duration = count;
+            return CAPTURE_FULL;
+        }
+
+        // The first sample of a capture can differ from the initial state,
+        // but a 0-length event must not be stored as it would look like
+        // a lost data marker.
+        if (count > 0)
+            write_varint((count << 4) + signal_buffer.last_value);
+        edges_found++;
+
+        last_edge_time += count;
+        activity_histogram.add(last_edge_time);
+
+        // Prepare for seeking the next edge
+        old = (*data & CAPTURE_SAMPLE_MASK);
+        count = 0;
+
+        signal_buffer.last_value = sample_levels(*data);
+    }
+
+    signal_buffer.last_duration = count;
+    activity_histogram.set_end(last_edge_time + count);
+
+    edges.count(edges_found);
+    capture_telemetry.add_block(samples, edges_found,
+                                profiler_now() - start_ticks);
+
+    return CAPTURE_OK;
+}
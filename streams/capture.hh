@@ -0,0 +1,119 @@
+/* Encoding of the raw ADC samples into the signal_buffer.
+ *
+ * This is the hardware-independent part of the capture interrupt. The DMA
+ * copies the samples from the FPGA to a circular FIFO, and the interrupt
+ * handler calls capture_irq() when either half of the FIFO is complete.
+ * The DMA registers are accessed through a small adapter class, so that
+ * the same code can run against the simulator in dmasimulator.hh.
+ */
+
+#pragma once
+
+#include "dsosignalstream.hh"
+#include "activityhistogram.hh"
+#include "capturetelemetry.hh"
+
+// The buffer the samples are encoded into.
+extern signal_buffer_t signal_buffer;
+
+// Transition density over the whole capture, for the overview strip.
+extern ActivityHistogram activity_histogram;
+
+// Buffer fill rate and interrupt load statistics.
+extern CaptureTelemetry capture_telemetry;
+
+// Bits that are compared in the samples: the highest bit of each analog
+// channel and the digital inputs.
+const uint32_t CAPTURE_SAMPLE_MASK = 0x00038080;
+
+enum capture_status_t
+{
+    CAPTURE_OK = 0,
+    CAPTURE_FULL = 1, // Buffer is full, the block was counted as lost
+    CAPTURE_SYNC_ERROR = 2, // Samples don't look like channel data
+    CAPTURE_DMA_ERROR = 3 // DMA reported a transfer error
+};
+
+// Flags returned by the DMA adapter
+enum capture_dma_flags
+{
+    DMA_HALF = 1, // First half of the FIFO has been filled
+    DMA_FULL = 2, // Second half of the FIFO has been filled
+    DMA_ERROR = 4 // Transfer error
+};
+
+// Clear the buffer for a new capture. Period_ticks is the time available
+// for processing one half of the FIFO, in profiler ticks.
+void capture_reset(uint32_t period_ticks);
+
+// Encode a block of samples into the signal_buffer.
+capture_status_t capture_process(const uint32_t *data, size_t count);
+
+// Remove bytes from the start of the signal_buffer, after they have been
+// sent elsewhere. The capture interrupt must not run during the call.
+// The events that remain keep their durations, so the capture continues
+// seamlessly, but times in the buffer restart from 0.
+//
+// The activity_histogram is moved to the new start, so the overview keeps
+// matching the buffer. The signal_buffer.stats keep covering the whole
+// capture including the removed data, with times from the start of the
+// capture. The call decodes the data stored after the latest
+// capture_update_stats(), so that should be called just before.
+void capture_discard(size_t bytes);
+
+// Add the events stored since the previous call to signal_buffer.stats.
+// Called from the main loop, so that the statistics don't add to the
+// time spent in the capture interrupt.
+void capture_update_stats();
+
+// Time at the end of the events added by the latest capture_update_stats(),
+// in the times of the buffer. The data before it is complete and doesn't
+// change, until it is removed with capture_discard().
+signaltime_t capture_stored_time();
+
+// Record that a block of samples was lost. A marker is stored when the
+// next block is processed.
+void capture_lost(size_t count);
+
+// Handle a DMA interrupt. Fifo points to the start of the circular buffer
+// that contains 2 * halfsize samples.
+//
+// Dma is an adapter with methods:
+// uint32_t flags(); // Returns capture_dma_flags
+// void clear(uint32_t flags);
+template <typename Dma>
+capture_status_t capture_irq(Dma &dma, const uint32_t *fifo, size_t halfsize)
+{
+    capture_status_t status = CAPTURE_OK;
+    uint32_t flags = dma.flags();
+
+    if (flags & DMA_ERROR)
+    {
+        return CAPTURE_DMA_ERROR;
+    }
+    else if (flags & DMA_HALF)
+    {
+        status = capture_process(&fifo[0], halfsize);
+        dma.clear(DMA_HALF);
+        if (dma.flags() & DMA_FULL)
+        {
+            // FIFO overflow: the DMA has already filled the second half
+            // and is overwriting the first one. Drop the second half and
+            // resynchronize on the next block.
+            dma.clear(DMA_FULL);
+            capture_lost(halfsize);
+        }
+    }
+    else if (flags & DMA_FULL)
+    {
+        status = capture_process(&fifo[halfsize], halfsize);
+        dma.clear(DMA_FULL);
+        if (dma.flags() & DMA_HALF)
+        {
+            dma.clear(DMA_HALF);
+            capture_lost(halfsize);
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,340 @@
+#include "capture.hh"
+#include "dmasimulator.hh"
+#include "varint.hh"
+#include "unittests.h"
+#include <memory>
+#include <algorithm>
+
+// Square wave on channel A, context points to the half period in samples.
+static uint32_t square_wave(signaltime_t index, const void *context)
+{
+    int halfperiod = *(const int*)context;
+    return ((index / halfperiod) & 1) ? 0x00000080 : 0;
+}
+
+// Square waves on all channels, toggling every other sample.
+static uint32_t busy_signal(signaltime_t index, const void *context)
+{
+    return ((index / 2) & 1) ? 0x00038080 : 0;
+}
+
+// Different kinds of signals: a square wave on A, short pulses on B, a
+// slow square wave on D and C stays low.
+static uint32_t mixed_signal(signaltime_t index, const void *context)
+{
+    uint32_t sample = 0;
+    if ((index / 5) & 1) sample |= 0x00000080;
+    if (index % 300 < 7) sample |= 0x00008000;
+    if ((index / 97) & 1) sample |= 0x00020000;
+    return sample;
+}
+
+// Data with the FPGA sync bits set, as if H_L got out of phase.
+static uint32_t garbage(signaltime_t index, const void *context)
+{
+    return (index > 300) ? 0xFF000080 : 0;
+}
+
+struct capture_summary_t
+{
+    signaltime_t total_time;
+    signaltime_t lost_time;
+    int lost_markers;
+    bool all_equal; // All complete events have the same length
+};
+
+static capture_summary_t summarize(signaltime_t expected_length)
+{
+    capture_summary_t summary = {0, 0, 0, true};
+    DSOSignalStream stream(&signal_buffer);
+    SignalEvent event;
+    stream.seek(0);
+    while (stream.read_forwards(event))
+    {
+        signaltime_t length = event.end - event.start;
+        summary.total_time += length;
+
+        if (event.levels == SIGNALS_LOST)
+        {
+            summary.lost_time += length;
+            summary.lost_markers++;
+        }
+        else if (length != expected_length)
+        {
+            summary.all_equal = false;
+        }
+    }
+    return summary;
+}
+
+// Total duration of the records in the first bytes of signal_buffer.
+static signaltime_t buffer_time(size_t bytes, signaltime_t &lost_time)
+{
+    signaltime_t total = 0;
+    size_t pos = 0;
+    while (pos < bytes)
+    {
+        signaltime_t duration;
+        signals_t levels;
+        pos = varint_read_record(signal_buffer.storage, pos, duration, levels);
+        total += duration;
+        if (levels == SIGNALS_LOST)
+            lost_time += duration;
+    }
+    return total;
+}
+
+// Check the statistics of one channel against decoding the buffer.
+static bool check_stats(int channel)
+{
+    signaltime_t high_time = 0, shortest = 0, longest = 0;
+    uint32_t transitions = 0;
+    signaltime_t idle_start = 0;
+    bool have_edge = false, after_lost = true;
+    signals_t mask = 1 << channel;
+
+    DSOSignalStream stream(&signal_buffer);
+    SignalEvent event;
+    stream.seek(0);
+    while (stream.read_forwards(event))
+    {
+        if (event.levels == SIGNALS_LOST)
+        {
+            longest = std::max(longest, event.start - idle_start);
+            idle_start = event.end;
+            have_edge = false;
+            after_lost = true;
+            continue;
+        }
+
+        if (event.levels & mask)
+            high_time += event.end - event.start;
+
+        if (!after_lost && ((event.levels ^ event.old_levels) & mask))
+        {
+            transitions++;
+            signaltime_t idle = event.start - idle_start;
+            longest = std::max(longest, idle);
+            if (have_edge && (shortest == 0 || idle < shortest))
+                shortest = idle;
+            have_edge = true;
+            idle_start = event.start;
+        }
+
+        after_lost = false;
+    }
+    longest = std::max(longest, event.end - idle_start);
+
+    const SignalStats &stats = stream.get_stats();
+    return stats.get_end() == event.end && stats.get_transitions(channel) == transitions &&
+           stats.get_high_time(channel) == high_time &&
+           stats.get_shortest_pulse(channel) == shortest &&
+           stats.get_longest_idle(channel) == longest;
+}
+
+// Runs a capture of a square wave and returns true if deadlines were missed.
+static bool misses_deadline(int halfperiod, uint32_t latency)
+{
+    capture_reset(0);
+    DmaSimulator sim(square_wave, &halfperiod);
+    sim.latency_cycles = latency;
+    sim.run(DmaSimulator::fifo_size * 8);
+    return summarize(halfperiod).lost_markers > 0;
+}
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test capture of a square wave");
+        capture_reset(0);
+        int halfperiod = 5;
+        DmaSimulator sim(square_wave, &halfperiod);
+        TEST(sim.run(1280) == CAPTURE_OK);
+        TEST(sim.interrupt_count() == 10);
+        TEST(sim.samples_transferred() == 1280);
+
+        capture_summary_t summary = summarize(5);
+        TEST(summary.total_time == 1280);
+        TEST(summary.lost_markers == 0);
+        TEST(summary.all_equal);
+
+        DSOSignalStream stream(&signal_buffer);
+        std::unique_ptr<SignalEvent> event;
+        stream.seek(0);
+        event.reset(stream.read());
+        TEST(event && event->start == 0 && event->end == 5 && event->levels == 0);
+        event.reset(stream.read());
+        TEST(event && event->start == 5 && event->end == 10 && event->levels == 1);
+    }
+
+    {
+        COMMENT("Test a late interrupt");
+        capture_reset(0);
+        int halfperiod = 5;
+        DmaSimulator sim(square_wave, &halfperiod);
+        TEST(sim.run(512) == CAPTURE_OK);
+        sim.inject_latency(DmaSimulator::halfsize * DmaSimulator::cycles_per_sample);
+        TEST(sim.run(1024) == CAPTURE_OK);
+
+        capture_summary_t summary = summarize(5);
+        TEST(summary.lost_markers == 1);
+        TEST(summary.lost_time == DmaSimulator::halfsize);
+        TEST(summary.total_time == 1536);
+        TEST(sim.worst_interrupt_cycles() > 0);
+    }
+
+    {
+        COMMENT("Test buffer full");
+        capture_reset(0);
+        DmaSimulator sim(busy_signal);
+        TEST(sim.run(200000) == CAPTURE_FULL);
+        TEST(signal_buffer.bytes + 10 > sizeof(signal_buffer.storage));
+        TEST(signal_buffer.bytes <= sizeof(signal_buffer.storage));
+        TEST(sim.samples_transferred() < 200000);
+    }
+
+    {
+        COMMENT("Test continuous capture with capture_discard()");
+        capture_reset(0);
+        int halfperiod = 3;
+        DmaSimulator sim(square_wave, &halfperiod);
+        signaltime_t discarded_time = 0;
+        signaltime_t lost_time = 0;
+        int full_count = 0;
+        for (int i = 0; i < 450; i++)
+        {
+            if (sim.run(DmaSimulator::fifo_size * 4) == CAPTURE_FULL)
+                full_count++;
+
+            if (i % 10 == 0)
+                capture_update_stats();
+
+            // Send out the buffer so rarely that it fills up in between
+            if (i % 100 == 99)
+            {
+                size_t bytes = signal_buffer.bytes;
+                discarded_time += buffer_time(bytes, lost_time);
+                capture_discard(bytes);
+            }
+        }
+
+        capture_summary_t summary = summarize(3);
+        TEST(full_count > 0);
+        TEST(lost_time > 0);
+        TEST(summary.lost_markers == 1);
+
+        // The samples after the last complete block are still in the FIFO
+        signaltime_t processed = sim.samples_transferred() / DmaSimulator::halfsize
+                                 * DmaSimulator::halfsize;
+        TEST(discarded_time + summary.total_time == processed);
+
+        // The overview covers only what is left in the buffer
+        TEST(activity_histogram.get_end() == summary.total_time);
+        uint32_t buffer_edges = 0;
+        DSOSignalStream stream(&signal_buffer);
+        SignalEvent event;
+        stream.seek(0);
+        bool after_lost = true;
+        while (stream.read_forwards(event))
+        {
+            if (!after_lost && event.levels != SIGNALS_LOST)
+                buffer_edges++;
+            after_lost = (event.levels == SIGNALS_LOST);
+        }
+        uint32_t histogram_edges = activity_histogram.get_sum(0, summary.total_time);
+        printf("Edges in buffer: %u, in histogram: %u\n", buffer_edges, histogram_edges);
+        TEST(histogram_edges >= buffer_edges);
+        TEST(histogram_edges <= buffer_edges + activity_histogram.bucket_width() / 3);
+
+        // The statistics also cover the discarded data
+        capture_update_stats();
+        const SignalStats &stats = signal_buffer.stats;
+        TEST(stats.get_end() == processed);
+        TEST(capture_stored_time() + signal_buffer.last_duration == summary.total_time);
+        TEST(stats.get_lost_time() == lost_time + summary.lost_time);
+        TEST(stats.get_shortest_pulse(0) == 3);
+    }
+
+    {
+        COMMENT("Test the statistics of the whole capture");
+        capture_reset(0);
+        DmaSimulator sim(mixed_signal);
+        TEST(sim.run(4096) == CAPTURE_OK);
+
+        // The interrupt leaves the statistics to the main loop
+        const SignalStats &stats = signal_buffer.stats;
+        TEST(stats.get_end() == 0 && stats.get_transitions(0) == 0);
+
+        capture_update_stats();
+        TEST(check_stats(0) && check_stats(1) && check_stats(2) && check_stats(3));
+
+        TEST(stats.get_transitions(0) == 819 && stats.get_shortest_pulse(0) == 5);
+        TEST(stats.get_shortest_pulse(1) == 7 && stats.get_longest_idle(1) == 293);
+        TEST(stats.get_transitions(2) == 0 && stats.get_longest_idle(2) == 4096 &&
+             stats.get_high_time(2) == 0);
+        TEST(stats.get_high_time(3) == 21 * 97);
+
+        COMMENT("Test the statistics with lost data");
+        sim.inject_latency(DmaSimulator::halfsize * DmaSimulator::cycles_per_sample);
+        TEST(sim.run(2048) == CAPTURE_OK);
+        capture_update_stats();
+        TEST(sim.run(2048) == CAPTURE_OK);
+        capture_update_stats();
+        TEST(stats.get_lost_time() == DmaSimulator::halfsize);
+        TEST(check_stats(0) && check_stats(1) && check_stats(2) && check_stats(3));
+    }
+
+    {
+        COMMENT("Test loss of sync");
+        capture_reset(0);
+        DmaSimulator sim(garbage);
+        TEST(sim.run(1024) == CAPTURE_SYNC_ERROR);
+    }
+
+    {
+        COMMENT("Test interrupt load");
+        capture_reset(0);
+        int halfperiod = 1;
+        DmaSimulator sim(square_wave, &halfperiod);
+        sim.run(1024);
+        TEST(sim.load_permille() > 500);
+        TEST(sim.load_permille() < 1000);
+    }
+
+    {
+        COMMENT("Test deadline with varying edge density");
+        // The handler must finish before the DMA fills the other half of
+        // the FIFO, 128 * 144 = 18432 cycles after the DMA event. Each
+        // event of a square wave takes one byte, so the cost model allows
+        // this many edges per block after the latency.
+        const uint32_t latency = 8000;
+        DmaSimulator model(square_wave);
+        const int halfsize = DmaSimulator::halfsize;
+        uint32_t budget = halfsize * DmaSimulator::cycles_per_sample;
+        uint32_t fixed = latency + model.base_cycles + model.sample_cycles * halfsize;
+        uint32_t max_edges = (budget - fixed - 1) / (model.edge_cycles + model.byte_cycles);
+
+        int threshold = 0;
+        for (int halfperiod = 1; halfperiod <= 16; halfperiod++)
+        {
+            if (!misses_deadline(halfperiod, latency))
+            {
+                threshold = halfperiod;
+                break;
+            }
+        }
+        printf("Shortest half period without overruns: %d samples, "
+               "at most %u edges per block\n", threshold, max_edges);
+        TEST(threshold > 0);
+        TEST((uint32_t)(halfsize + threshold - 1) / threshold <= max_edges);
+        TEST(threshold == 1 || (uint32_t)halfsize / (threshold - 1) > max_edges);
+
+        // Without the latency even the busiest signal fits
+        TEST(!misses_deadline(1, 0));
+        TEST(misses_deadline(1, latency));
+    }
+
+    return status;
+}
@@ -0,0 +1,104 @@
+#include "capturetelemetry.hh"
+#include <stdio.h>
+
+void CaptureTelemetry::reset(uint32_t period_ticks)
+{
+    total_samples = 0;
+    total_edges = 0;
+    worst_isr_ticks = 0;
+
+    this->period_ticks = period_ticks;
+    prev_samples = 0;
+    prev_edges = 0;
+    prev_bytes = 0;
+    edge_rate = 0;
+    byte_rate = 0;
+    isr_load = 0;
+    to_full = -1;
+}
+
+void CaptureTelemetry::add_block(uint32_t samples, uint32_t edges, uint32_t isr_ticks)
+{
+    total_samples += samples;
+    total_edges += edges;
+
+    if (isr_ticks > worst_isr_ticks)
+        worst_isr_ticks = isr_ticks;
+}
+
+// Exponential moving average, so that a single busy block doesn't make
+// the numbers jump around too much.
+static uint32_t smooth(uint32_t old_rate, uint32_t new_rate)
+{
+    if (old_rate == 0)
+        return new_rate;
+
+    return ((uint64_t)old_rate * 3 + new_rate) / 4;
+}
+
+void CaptureTelemetry::update(size_t bytes_used, size_t bytes_capacity,
+                              frequency_t frequency)
+{
+    uint32_t samples = total_samples;
+    uint32_t edges = total_edges;
+    uint32_t worst = __sync_fetch_and_and(&worst_isr_ticks, 0);
+
+    if (bytes_used < prev_bytes)
+        prev_bytes = 0; // Capture was restarted
+
+    uint32_t delta_samples = samples - prev_samples;
+    if (delta_samples == 0)
+    {
+        // Capture has stopped
+        edge_rate = 0;
+        byte_rate = 0;
+        isr_load = 0;
+    }
+    else
+    {
+        uint64_t delta_edges = edges - prev_edges;
+        uint64_t delta_bytes = bytes_used - prev_bytes;
+        edge_rate = smooth(edge_rate, delta_edges * frequency / delta_samples);
+        byte_rate = smooth(byte_rate, delta_bytes * frequency / delta_samples);
+
+        if (period_ticks)
+            isr_load = (uint64_t)worst * 1000 / period_ticks;
+    }
+
+    prev_samples = samples;
+    prev_edges = edges;
+    prev_bytes = bytes_used;
+
+    // We may need up to 10 bytes of space to store the next event.
+    if (bytes_used + 10 > bytes_capacity)
+        to_full = 0;
+    else if (byte_rate == 0)
+        to_full = -1;
+    else
+        to_full = (bytes_capacity - bytes_used) / byte_rate;
+}
+
+bool CaptureTelemetry::warning() const
+{
+    if (isr_load > warning_load_permille)
+        return true;
+
+    return to_full >= 0 && to_full < warning_seconds;
+}
+
+void CaptureTelemetry::format(char *buf, size_t size) const
+{
+    int pos = snprintf(buf, size, "Edges: %lu/s %lu B/s",
+                       (unsigned long)edge_rate, (unsigned long)byte_rate);
+    if (pos < 0 || pos >= (int)size)
+        return;
+
+    if (to_full >= 0)
+    {
+        pos += snprintf(buf + pos, size - pos, " Full: %ld s", (long)to_full);
+        if (pos >= (int)size)
+            return;
+    }
+
+    snprintf(buf + pos, size - pos, " ISR: %lu%%", (unsigned long)(isr_load / 10));
+}
@@ -0,0 +1,73 @@
+/* Rolling statistics about the capture process: how fast the buffer is
+ * filling, how busy the signals are and how close the capture interrupt
+ * is to missing its deadline.
+ *
+ * The capture interrupt calls add_block() for every processed half of the
+ * DMA FIFO; it only increments a few counters. The main loop calls update()
+ * periodically to compute the rates. The rates are measured against the
+ * number of processed samples, so no separate clock is needed.
+ */
+
+#pragma once
+
+#include "signalstream.hh"
+
+class CaptureTelemetry
+{
+public:
+    // Clear statistics for a new capture. Period_ticks is the time
+    // available for processing one block, in the same units as the
+    // isr_ticks given to add_block().
+    void reset(uint32_t period_ticks);
+
+    // Called from the capture interrupt after each block.
+    void add_block(uint32_t samples, uint32_t edges, uint32_t isr_ticks);
+
+    // Called from the main loop to update the rates.
+    void update(size_t bytes_used, size_t bytes_capacity, frequency_t frequency);
+
+    // Total number of edges given to add_block() since reset().
+    uint32_t edge_count() const { return total_edges; }
+
+    uint32_t edges_per_second() const { return edge_rate; }
+    uint32_t bytes_per_second() const { return byte_rate; }
+
+    // Longest interrupt duration since previous update(), relative to the
+    // block period, 1000 = 100%.
+    uint32_t isr_load_permille() const { return isr_load; }
+
+    // Estimate of time until the buffer is full, or -1 if it is not
+    // filling up at all.
+    int32_t seconds_to_full() const { return to_full; }
+
+    // True if the capture is about to stop or the interrupt is close to
+    // falling behind.
+    bool warning() const;
+
+    // Format the rates for the status line, e.g.
+    // "Edges: 1200/s 340 B/s Full: 60 s ISR: 12%". The time to full is
+    // left out when the buffer is not filling up. With 6-digit rates the
+    // text needs status_length bytes, including the terminator.
+    void format(char *buf, size_t size) const;
+    static const size_t status_length = 51;
+
+    // Thresholds for warning()
+    static const uint32_t warning_load_permille = 750;
+    static const int32_t warning_seconds = 10;
+
+private:
+    // Updated by the interrupt
+    volatile uint32_t total_samples;
+    volatile uint32_t total_edges;
+    volatile uint32_t worst_isr_ticks;
+
+    // Updated by update()
+    uint32_t period_ticks;
+    uint32_t prev_samples;
+    uint32_t prev_edges;
+    size_t prev_bytes;
+    uint32_t edge_rate;
+    uint32_t byte_rate;
+    uint32_t isr_load;
+    int32_t to_full;
+};
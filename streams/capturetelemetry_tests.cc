@@ -0,0 +1,105 @@
+#include "capturetelemetry.hh"
+#include "unittests.h"
+#include <string.h>
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test rate computation");
+        CaptureTelemetry telemetry;
+        telemetry.reset(1000);
+
+        // One second at 1000 Hz: 10 blocks of 100 samples with 5 edges each
+        for (int i = 0; i < 10; i++)
+            telemetry.add_block(100, 5, 200);
+
+        telemetry.update(150, 1000, 1000);
+        TEST(telemetry.edges_per_second() == 50);
+        TEST(telemetry.bytes_per_second() == 150);
+        TEST(telemetry.isr_load_permille() == 200);
+        TEST(telemetry.seconds_to_full() == 5);
+        TEST(telemetry.warning());
+    }
+
+    {
+        COMMENT("Test smoothing and worst-case interrupt duration");
+        CaptureTelemetry telemetry;
+        telemetry.reset(1000);
+
+        telemetry.add_block(1000, 100, 100);
+        telemetry.update(10, 100000, 1000);
+        TEST(telemetry.edges_per_second() == 100);
+        TEST(!telemetry.warning());
+
+        telemetry.add_block(500, 100, 900);
+        telemetry.add_block(500, 100, 100);
+        telemetry.update(20, 100000, 1000);
+        TEST(telemetry.edges_per_second() == 125);
+        TEST(telemetry.isr_load_permille() == 900);
+        TEST(telemetry.warning());
+
+        telemetry.add_block(1000, 100, 100);
+        telemetry.update(30, 100000, 1000);
+        TEST(telemetry.isr_load_permille() == 100);
+    }
+
+    {
+        COMMENT("Test stopped capture");
+        CaptureTelemetry telemetry;
+        telemetry.reset(1000);
+
+        telemetry.add_block(1000, 10, 100);
+        telemetry.update(995, 1000, 1000);
+        TEST(telemetry.seconds_to_full() == 0);
+
+        telemetry.update(995, 1000, 1000);
+        TEST(telemetry.edges_per_second() == 0);
+        TEST(telemetry.bytes_per_second() == 0);
+        TEST(telemetry.seconds_to_full() == 0);
+        TEST(telemetry.warning());
+    }
+
+    {
+        COMMENT("Test idle capture");
+        CaptureTelemetry telemetry;
+        telemetry.reset(1000);
+
+        telemetry.add_block(1000, 0, 100);
+        telemetry.update(0, 1000, 1000);
+        TEST(telemetry.seconds_to_full() == -1);
+        TEST(!telemetry.warning());
+    }
+
+    {
+        COMMENT("Test status line formatting");
+        CaptureTelemetry telemetry;
+        telemetry.reset(1000);
+
+        // The expected texts are variables, as TEST() prints its argument
+        // as a format string.
+        const char *idle = "Edges: 100/s 0 B/s ISR: 12%";
+        const char *busy = "Edges: 999999/s 999999 B/s Full: 99999 s ISR: 100%";
+
+        char buf[CaptureTelemetry::status_length];
+        telemetry.add_block(1000, 100, 120);
+        telemetry.update(0, 1000, 1000);
+        telemetry.format(buf, sizeof(buf));
+        TEST(strcmp(buf, idle) == 0);
+
+        // The busiest line that still has to fit
+        telemetry.reset(1000);
+        telemetry.add_block(1000, 999999, 1000);
+        telemetry.update(999999, 999999 + 99999 * (size_t)999999, 1000);
+        telemetry.format(buf, sizeof(buf));
+        TEST(strcmp(buf, busy) == 0);
+
+        // Longer text is cut off, but terminated
+        char small[16];
+        telemetry.format(small, sizeof(small));
+        TEST(strcmp(small, "Edges: 999999/s") == 0);
+    }
+
+    return status;
+}
@@ -0,0 +1,210 @@
+/* Host-side simulation of the capture DMA and interrupt.
+ *
+ * On the device, DMA1 channel 4 copies one sample from the FPGA every
+ * 144 CPU cycles into a circular FIFO and raises the half- and
+ * full-transfer interrupts. This class emulates the same FIFO in simulated
+ * CPU cycles, so that capture_irq() can be run on the PC against arbitrary
+ * signals. The interrupt handler runs after a configurable latency and
+ * takes time according to a cost model of the work the real handler did:
+ * the edges capture_process() stored and the bytes it appended. The DMA
+ * keeps writing while the handler runs, so the simulation misses
+ * deadlines the same way as the real hardware.
+ */
+
+#pragma once
+
+#include <string.h>
+#include "capture.hh"
+
+class DmaSimulator
+{
+public:
+    // Returns the FPGA data word for the given sample index.
+    typedef uint32_t (*generator_t)(signaltime_t index, const void *context);
+
+    static const size_t fifo_size = 256;
+    static const size_t halfsize = fifo_size / 2;
+
+    // 72 MHz CPU clock, 500 kHz sample rate
+    static const uint32_t cycles_per_sample = 144;
+
+    DmaSimulator(generator_t generator, const void *context = NULL)
+    {
+        this->generator = generator;
+        this->context = context;
+
+        latency_cycles = 0;
+        base_cycles = 180;
+        sample_cycles = 5;
+        edge_cycles = 100;
+        byte_cycles = 10;
+
+        pos = 0;
+        end = 0;
+        cycle = 0;
+        pending = 0;
+        pending_cycle = 0;
+        extra_latency = 0;
+        charged = false;
+        irq_bytes = 0;
+        irq_edges = 0;
+        interrupts = 0;
+        busy_cycles = 0;
+        worst_cycles = 0;
+
+        memset(fifo, 0, sizeof(fifo));
+    }
+
+    // Time from the DMA event to the start of the interrupt handler.
+    // Default: 0
+    uint32_t latency_cycles;
+
+    // Cost model of the interrupt handler, in CPU cycles. The defaults are
+    // counted from the Cortex-M3 instruction timings of the code in
+    // capture.cc, they have not been measured on the device yet. To
+    // calibrate, compare the average "DMA1_Ch4_IRQ" time in
+    // profiler_dump() with idle inputs and with a square wave of known
+    // frequency on the inputs.
+
+    // Exception entry and exit 24, the two profiler scopes and the
+    // telemetry update about 100, capture_irq() and the DMA registers
+    // about 50. Default: 180
+    uint32_t base_cycles;
+
+    // Load, mask, compare and branch in find_edge(). Default: 5
+    uint32_t sample_cycles;
+
+    // Leaving and re-entering find_edge() with its alignment loop, the
+    // sync and space checks, sample_levels() and ActivityHistogram::add().
+    // Default: 100
+    uint32_t edge_cycles;
+
+    // One round of the varint_encode() loop with its 64-bit shift.
+    // Default: 10
+    uint32_t byte_cycles;
+
+    // Delay the next interrupt by additional cycles, e.g. to simulate
+    // a higher-priority interrupt or a long critical section.
+    void inject_latency(uint32_t cycles)
+    {
+        extra_latency += cycles;
+    }
+
+    // Run the capture until given number of samples has been transferred
+    // or capture_irq() returns an error.
+    capture_status_t run(signaltime_t samples)
+    {
+        end = pos + samples;
+
+        for (;;)
+        {
+            // Let the DMA run until an interrupt is pending
+            while (!pending && pos < end)
+                advance_to((pos + 1) * (uint64_t)cycles_per_sample);
+
+            if (!pending)
+                return CAPTURE_OK;
+
+            uint64_t start = pending_cycle + latency_cycles + extra_latency;
+            extra_latency = 0;
+            if (start > cycle)
+                advance_to(start);
+
+            uint64_t isr_start = cycle;
+            charged = false;
+            irq_bytes = signal_buffer.bytes;
+            irq_edges = capture_telemetry.edge_count();
+            capture_status_t status = capture_irq(*this, fifo, halfsize);
+            interrupts++;
+
+            uint64_t duration = cycle - isr_start;
+            busy_cycles += duration;
+            if (duration > worst_cycles)
+                worst_cycles = duration;
+
+            if (status != CAPTURE_OK)
+                return status;
+        }
+    }
+
+    // Adapter interface for capture_irq()
+    uint32_t flags()
+    {
+        return pending;
+    }
+
+    void clear(uint32_t flags)
+    {
+        if (!charged)
+        {
+            // The first clear() happens right after the block has been
+            // processed; account for the processing time here.
+            uint32_t edges = capture_telemetry.edge_count() - irq_edges;
+            uint32_t bytes = signal_buffer.bytes - irq_bytes;
+            uint32_t cost = base_cycles + sample_cycles * halfsize
+                          + edge_cycles * edges + byte_cycles * bytes;
+            charged = true;
+            advance_to(cycle + cost);
+        }
+
+        pending &= ~flags;
+    }
+
+    // Statistics
+    signaltime_t samples_transferred() const { return pos; }
+    uint64_t cycles() const { return cycle; }
+    uint32_t interrupt_count() const { return interrupts; }
+    uint64_t worst_interrupt_cycles() const { return worst_cycles; }
+
+    // Fraction of CPU time spent in the interrupt, 1000 = 100%.
+    uint32_t load_permille() const
+    {
+        return cycle ? busy_cycles * 1000 / cycle : 0;
+    }
+
+private:
+    generator_t generator;
+    const void *context;
+    uint32_t fifo[fifo_size];
+
+    signaltime_t pos; // Index of the next sample to transfer
+    signaltime_t end; // DMA stops after this sample
+    uint64_t cycle; // Current CPU cycle
+    uint32_t pending; // Interrupt flags that are set
+    uint64_t pending_cycle; // When the oldest pending flag was set
+    uint32_t extra_latency;
+    bool charged; // Processing time of current interrupt accounted for
+    size_t irq_bytes; // Buffer size when the current interrupt started
+    uint32_t irq_edges; // Edge count when the current interrupt started
+
+    uint32_t interrupts;
+    uint64_t busy_cycles;
+    uint64_t worst_cycles;
+
+    // Transfer all samples that complete before the given cycle.
+    void advance_to(uint64_t new_cycle)
+    {
+        while (pos < end && (pos + 1) * (uint64_t)cycles_per_sample <= new_cycle)
+        {
+            size_t index = pos % fifo_size;
+            fifo[index] = generator(pos, context);
+            pos++;
+
+            uint32_t flag = 0;
+            if (index == halfsize - 1)
+                flag = DMA_HALF;
+            else if (index == fifo_size - 1)
+                flag = DMA_FULL;
+
+            if (flag)
+            {
+                if (!pending)
+                    pending_cycle = pos * (uint64_t)cycles_per_sample;
+                pending |= flag;
+            }
+        }
+
+        if (new_cycle > cycle)
+            cycle = new_cycle;
+    }
+};
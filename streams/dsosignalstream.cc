@@ -1,7 +1,9 @@
 #include "dsosignalstream.hh"
+#include "varint.hh"
 
-DSOSignalStream::DSOSignalStream(const signal_buffer_t *buffer):
-    read_pos(0), previous_event(), previous_was_last(false), buffer(buffer)
+DSOSignalStream::DSOSignalStream(const signal_buffer_t *buffer, frequency_t tickfreq):
+    read_pos(0), previous_event(), previous_was_last(false), buffer(buffer),
+    tickfreq(tickfreq)
 {
 }
 
@@ -9,7 +11,7 @@ void DSOSignalStream::seek(signaltime_t time)
 {
     SignalEvent dummy;
     
-    if (time == 0)
+    if (time <= 0)
     {
         read_pos = 0;
         previous_event = SignalEvent();
@@ -47,10 +49,6 @@ void DSOSignalStream::seek(signaltime_t time)
 
 bool DSOSignalStream::read_forwards(SignalEvent &result)
 {
-    uint64_t value = 0;
-    uint8_t bitpos = 0;
-    uint8_t byte;
-    
     if (previous_was_last)
     {
         // We need a seek() to get out of this state.
@@ -73,30 +71,33 @@ bool DSOSignalStream::read_forwards(SignalEvent &result)
     if (read_pos < buffer->bytes)
     {
         // Read from encoded storage
-        do {
-            byte = buffer->storage[read_pos];
-            value |= (uint64_t)(byte & 0x7F) << bitpos;
-            read_pos++;
-            bitpos += 7;
-        } while (byte & 0x80);
+        signaltime_t duration;
+        signals_t levels;
+        read_pos = varint_read_record(buffer->storage, read_pos, duration, levels);
         
         result.start = previous_event.end;
-        result.end = result.start + (value >> 4);
+        result.end = result.start + duration;
         result.old_levels = previous_event.levels;
-        result.levels = value & 0x0F;
+        result.levels = levels;
         
         previous_was_last = false;
     }
+    else if (!previous_was_last)
+    {
+        // The last event is 0-length, there is nothing to read yet.
+        // Keep previous_event so that read_backwards() remains in sync.
+        return false;
+    }
     
     previous_event = result;
     
-    // If the last event is 0-length, return false
     return result.start < result.end;
 }
 
 bool DSOSignalStream::read_backwards(SignalEvent &result)
 {
-    uint8_t byte;
+    signaltime_t duration;
+    signals_t levels;
     
     if (read_pos <= 0)
         return false;
@@ -104,34 +105,135 @@ bool DSOSignalStream::read_backwards(SignalEvent &result)
     if (!previous_was_last)
     {
         // Seek to the previous event
-        do {
-            read_pos--;
-        } while (buffer->storage[read_pos - 1] & 0x80);
+        read_pos = varint_read_record_backwards(buffer->storage, read_pos,
+                                                duration, levels);
     }
     
-    // And read the event before that
-    uint64_t value = 0;
-    size_t pos = read_pos;
-    do {
-        pos--;
-        byte = buffer->storage[pos];
-        value <<= 7;
-        value |= (uint64_t)(byte & 0x7F);
-    } while (pos != 0 && buffer->storage[pos - 1] & 0x80);
-    
     result = previous_event;
-    previous_event.end = result.start;
-    previous_event.start = result.start - (value >> 4);
-    previous_event.levels = result.old_levels = value & 0x0F;
     
-    // Note: the old_levels will not be valid, but it is not used anywhere.
-    previous_event.old_levels = -1;
+    // And read the event before that
+    if (read_pos == 0)
+    {
+        // At the beginning of the buffer, same state as after seek(0).
+        previous_event = SignalEvent();
+    }
+    else
+    {
+        varint_read_record_backwards(buffer->storage, read_pos, duration, levels);
+        previous_event.end = result.start;
+        previous_event.start = result.start - duration;
+        previous_event.levels = levels;
+        
+        // Note: the old_levels will not be valid, but it is not used anywhere.
+        previous_event.old_levels = -1;
+    }
     
+    result.old_levels = previous_event.levels;
     previous_was_last = false;
     
     return true;
 }
 
+// Search cursor that reads the records directly from the buffer. The
+// number of bytes is fixed when the cursor is created, so that the
+// interrupt adding data doesn't confuse the search.
+class DSOSearchCursor
+{
+public:
+    DSOSearchCursor(const signal_buffer_t *buffer, size_t pos, signaltime_t time):
+        buffer(buffer), bytes(buffer->bytes), pos(pos), time(time),
+        in_last(false), last_duration(0), last_value(0)
+    {
+    }
+    
+    bool next(signaltime_t &start, signaltime_t &end, signals_t &levels)
+    {
+        signaltime_t duration;
+        
+        if (in_last)
+        {
+            return false;
+        }
+        else if (pos < bytes)
+        {
+            pos = varint_read_record(buffer->storage, pos, duration, levels);
+        }
+        else
+        {
+            // The real time event, valid only if no data has been added
+            last_duration = buffer->last_duration;
+            last_value = buffer->last_value;
+            if (last_duration == 0 || buffer->bytes != bytes)
+                return false;
+            
+            in_last = true;
+            duration = last_duration;
+            levels = last_value;
+        }
+        
+        start = time;
+        end = time = start + duration;
+        return true;
+    }
+    
+    bool prev(signaltime_t &start, signaltime_t &end, signals_t &levels)
+    {
+        signaltime_t duration;
+        
+        if (in_last)
+        {
+            in_last = false;
+            duration = last_duration;
+            levels = last_value;
+        }
+        else if (pos > 0)
+        {
+            pos = varint_read_record_backwards(buffer->storage, pos, duration, levels);
+        }
+        else
+        {
+            return false;
+        }
+        
+        end = time;
+        start = time = end - duration;
+        return true;
+    }
+    
+private:
+    const signal_buffer_t *buffer;
+    size_t bytes;
+    size_t pos;
+    signaltime_t time; // Start time of the record at pos
+    bool in_last;
+    signaltime_t last_duration;
+    signals_t last_value;
+};
+
+bool DSOSignalStream::find_forwards(signaltime_t from, const SignalSearch &search,
+                                    SignalEvent &result)
+{
+    seek(from);
+    DSOSearchCursor cursor(buffer, read_pos, previous_event.end);
+    return signal_search_forwards(cursor, from, search, result);
+}
+
+bool DSOSignalStream::find_backwards(signaltime_t from, const SignalSearch &search,
+                                     SignalEvent &result)
+{
+    seek(from);
+    DSOSearchCursor cursor(buffer, read_pos, previous_event.end);
+    return signal_search_backwards(cursor, from, search, result);
+}
+
+void DSOSignalStream::measure(signaltime_t from, signaltime_t to,
+                              SignalMeasurement &result)
+{
+    seek(from);
+    DSOSearchCursor cursor(buffer, read_pos, previous_event.end);
+    signal_measure(cursor, from, to, result);
+}
+
 DSOSignalStream* DSOSignalStream::clone() const
 {
     return new DSOSignalStream(*this);
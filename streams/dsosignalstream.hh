@@ -8,6 +8,10 @@
  * The lowest 4 bits of the integer are the signal levels. The upper bits,
  * up to 60 bits, are the number of ticks how long the levels remained.
  * 
+ * A varint with value 0 is a marker for lost data. It is followed by a
+ * second varint, which is the number of ticks that were lost. The marker
+ * is returned as an event with levels SIGNALS_LOST.
+ * 
  * When updating in the real time, the latest levels are kept separately
  * for faster updating. The meaning of last_duration and last_value are
  * same as in varint-encoded values. If last_duration is 0, there is no
@@ -16,6 +20,7 @@
 
 #pragma once
 #include "signalstream.hh"
+#include "signalstats.hh"
 
 // This is the structure for the low-level buffer used to store the data.
 // The structure is updated from an interrupt, and can be read
@@ -34,11 +39,17 @@ struct signal_buffer_t
     // Not marked volatile because the valid bytes never change after initial
     // write.
     uint8_t storage[25000];
+    
+    // Statistics of the whole capture, maintained by the capture code.
+    // Buffers filled in other ways leave them zero.
+    SignalStats stats;
 };
 
 class DSOSignalStream: public SignalStream {
 public:
-    DSOSignalStream(const signal_buffer_t *buffer);
+    // Tickfreq is the sample rate of the data in the buffer, e.g. from the
+    // timescale of a VCD file. By default, the rate of the live capture.
+    DSOSignalStream(const signal_buffer_t *buffer, frequency_t tickfreq = frequency);
     virtual ~DSOSignalStream() {};
     
     virtual void seek(signaltime_t time);
@@ -52,8 +63,23 @@ public:
     // event.
     virtual bool read_backwards(SignalEvent &result);
     
+    // Searches and measurements that decode the storage directly,
+    // without going through read_forwards() and read_backwards() for each
+    // event.
+    virtual bool find_forwards(signaltime_t from, const SignalSearch &search,
+                               SignalEvent &result);
+    virtual bool find_backwards(signaltime_t from, const SignalSearch &search,
+                                SignalEvent &result);
+    virtual void measure(signaltime_t from, signaltime_t to,
+                         SignalMeasurement &result);
+    
+    virtual frequency_t get_frequency() const { return tickfreq; }
+    
     virtual DSOSignalStream* clone() const;
     
+    // Statistics of the whole capture in the buffer, without decoding it.
+    const SignalStats &get_stats() const { return buffer->stats; }
+    
     static const int frequency = 500000;
     
 private:
@@ -61,5 +87,6 @@ private:
     SignalEvent previous_event; // Event immediately before read_pos (old_levels is not valid)
     bool previous_was_last; // Previous event was read from last_duration
     const signal_buffer_t *buffer;
+    frequency_t tickfreq;
 };
 
@@ -1,5 +1,38 @@
 #include "dsosignalstream.hh"
+#include "testsignalstream.hh"
+#include "varint.hh"
 #include "unittests.h"
+#include <vector>
+
+// Store the events of source in the buffer, with the last one as the real
+// time event.
+static void fill_buffer(signal_buffer_t &buffer, SignalStream &source)
+{
+    std::vector<SignalEvent> events;
+    SignalEvent event;
+    source.seek(0);
+    while (source.read_forwards(event))
+        events.push_back(event);
+    
+    buffer.bytes = 0;
+    for (size_t i = 0; i + 1 < events.size(); i++)
+    {
+        uint64_t value = ((events[i].end - events[i].start) << 4) | events[i].levels;
+        buffer.bytes += varint_encode(buffer.storage + buffer.bytes, value);
+    }
+    
+    buffer.last_duration = events.back().end - events.back().start;
+    buffer.last_value = events.back().levels;
+}
+
+static bool same_result(bool found1, const SignalEvent &a, bool found2, const SignalEvent &b)
+{
+    if (found1 != found2)
+        return false;
+    
+    return !found1 || (a.start == b.start && a.end == b.end &&
+                       a.levels == b.levels && a.old_levels == b.old_levels);
+}
 
 int main()
 {
@@ -118,5 +151,189 @@ int main()
             event.start == 5 && event.end == 7 && event.levels == 2);
     }
     
+    {
+        COMMENT("Test lost data markers");
+        signal_buffer_t buffer = {
+            5, 0, 0, {0x12, 0x00, 0xAC, 0x02, 0x34}
+        };
+        DSOSignalStream stream(&buffer);
+        SignalEvent event;
+        
+        TEST(stream.read_forwards(event) &&
+            event.start == 0 && event.end == 1 && event.levels == 2);
+        TEST(stream.read_forwards(event) &&
+            event.start == 1 && event.end == 301 &&
+            event.levels == SIGNALS_LOST && event.old_levels == 2);
+        TEST(stream.read_forwards(event) &&
+            event.start == 301 && event.end == 304 &&
+            event.levels == 4 && event.old_levels == SIGNALS_LOST);
+        TEST(!stream.read_forwards(event));
+        
+        stream.seek(302);
+        TEST(stream.read_backwards(event) &&
+            event.start == 1 && event.end == 301 &&
+            event.levels == SIGNALS_LOST && event.old_levels == 2);
+        TEST(stream.read_backwards(event) &&
+            event.start == 0 && event.end == 1 && event.levels == 2);
+        TEST(!stream.read_backwards(event));
+        
+        stream.seek(200);
+        TEST(stream.read_forwards(event) &&
+            event.start == 1 && event.end == 301 &&
+            event.levels == SIGNALS_LOST);
+    }
+    
+    {
+        COMMENT("Test edge, pulse and pattern searches");
+        TestSignalStream source("__--__-----_--___-",
+                                "-_-_-_-_-_-_-_-_-_",
+                                "", "");
+        signal_buffer_t buffer = {};
+        fill_buffer(buffer, source);
+        DSOSignalStream stream(&buffer);
+        SignalEvent event;
+        
+        TEST(stream.find_forwards(0, SignalSearch::edge(1), event) &&
+             event.start == 2 && event.end == 4 &&
+             event.levels == 1 && event.old_levels == 0);
+        TEST(stream.find_forwards(2, SignalSearch::edge(1), event) &&
+             event.start == 4 && event.end == 6 && event.levels == 0);
+        TEST(stream.find_forwards(0, SignalSearch::pulse(1, 1, 4), event) &&
+             event.start == 6 && event.end == 11);
+        TEST(stream.find_forwards(4, SignalSearch::pulse(1, 1, 0, 2), event) &&
+             event.start == 12 && event.end == 14);
+        TEST(stream.find_forwards(0, SignalSearch::pattern(3, 1), event) &&
+             event.start == 3 && event.end == 4 && event.old_levels == 3);
+        TEST(!stream.find_forwards(17, SignalSearch::edge(1), event));
+        
+        TEST(stream.find_backwards(12, SignalSearch::edge(1), event) &&
+             event.start == 11 && event.end == 12 && event.levels == 0);
+        TEST(stream.find_backwards(8, SignalSearch::edge(1), event) &&
+             event.start == 6 && event.end == 11 && event.levels == 1);
+        TEST(!stream.find_backwards(3, SignalSearch::pulse(1, 0, 3), event));
+        TEST(stream.find_backwards(18, SignalSearch::pulse(1, 0, 3), event) &&
+             event.start == 14 && event.end == 17);
+        TEST(stream.find_backwards(100, SignalSearch::edge(1), event) &&
+             event.start == 17 && event.end == 18);
+        TEST(stream.find_backwards(1, SignalSearch::edge(1), event) &&
+             event.start == 0 && event.end == 2);
+        
+        COMMENT("Test sampling other channels at the found edge");
+        SignalSearch sampled = SignalSearch::edge(1);
+        sampled.sample = 2;
+        TEST(stream.find_forwards(0, sampled, event) &&
+             event.start == 2 && event.end == 4 &&
+             event.levels == 3 && event.old_levels == 0);
+        TEST(stream.find_forwards(2, sampled, event) &&
+             event.start == 4 && event.end == 6 && event.levels == 2);
+        TEST(stream.find_backwards(8, sampled, event) &&
+             event.start == 6 && event.end == 11 && event.levels == 3);
+        TEST(stream.find_backwards(12, sampled, event) &&
+             event.start == 11 && event.end == 12 && event.levels == 0);
+        
+        COMMENT("Compare with the generic search");
+        SignalSearch searches[] = {
+            SignalSearch::edge(1), SignalSearch::edge(2), SignalSearch::edge(3),
+            SignalSearch::pattern(3, 3), SignalSearch::pattern(3, 0),
+            SignalSearch::pulse(1, 1, 2, 3), SignalSearch::pulse(1, 0, 1, 1),
+            sampled
+        };
+        bool all_same = true;
+        for (const SignalSearch &search: searches)
+        {
+            for (signaltime_t from = 0; from <= 18; from++)
+            {
+                SignalEvent a, b;
+                bool found1 = stream.find_forwards(from, search, a);
+                bool found2 = source.find_forwards(from, search, b);
+                all_same = all_same && same_result(found1, a, found2, b);
+                
+                found1 = stream.find_backwards(from, search, a);
+                found2 = source.find_backwards(from, search, b);
+                all_same = all_same && same_result(found1, a, found2, b);
+            }
+        }
+        TEST(all_same);
+    }
+    
+    {
+        COMMENT("Test searching over lost data");
+        signal_buffer_t buffer = {
+            5, 0, 0, {0x12, 0x00, 0xAC, 0x02, 0x34}
+        };
+        DSOSignalStream stream(&buffer);
+        SignalEvent event;
+        
+        TEST(stream.find_forwards(0, SignalSearch::edge(15), event) &&
+             event.start == 301 && event.end == 304 &&
+             event.levels == 4 && event.old_levels == SIGNALS_LOST);
+        TEST(!stream.find_forwards(0, SignalSearch::pattern(2, 2), event));
+        TEST(stream.find_backwards(400, SignalSearch::pattern(2, 2), event) &&
+             event.start == 0 && event.end == 1);
+        
+        // The stream can be read normally after a search
+        stream.seek(0);
+        TEST(stream.read_forwards(event) && event.start == 0 && event.end == 1);
+    }
+    
+    {
+        COMMENT("Test measuring the channels");
+        TestSignalStream source("__--__--__--__--__",
+                                "_-----_-----_-----",
+                                "------------------", "");
+        signal_buffer_t buffer = {};
+        fill_buffer(buffer, source);
+        DSOSignalStream stream(&buffer);
+        SignalMeasurement result;
+        
+        stream.measure(0, 18, result);
+        TEST(result.measured_time == 18 && result.data_end == 18 && !result.lost);
+        TEST(result.channel[0].edges == 8 && result.channel[0].periods == 3 &&
+             result.channel[0].period_min == 4 && result.channel[0].period_max == 4 &&
+             result.channel[0].histogram[1] == 7 && result.duty_cycle(0) == 444);
+        TEST(result.channel[1].edges == 5 && result.channel[1].period_mean() == 6 &&
+             result.channel[1].histogram[0] == 2 && result.channel[1].histogram[2] == 2 &&
+             result.duty_cycle(1) == 833);
+        TEST(result.channel[2].edges == 0 && result.channel[2].periods == 0 &&
+             result.duty_cycle(2) == 1000);
+        TEST(result.channel[3].edges == 0 && result.duty_cycle(3) == 0);
+        
+        stream.measure(5, 11, result);
+        TEST(result.measured_time == 6 && result.channel[0].edges == 3 &&
+             result.channel[0].periods == 1 && result.channel[0].histogram[1] == 2 &&
+             result.duty_cycle(0) == 500);
+        
+        stream.measure(10, 30, result);
+        TEST(result.data_end == 18 && result.measured_time == 8);
+        
+        COMMENT("Compare with the generic measurement");
+        bool all_same = true;
+        for (signaltime_t from = 0; from <= 18; from++)
+        {
+            for (signaltime_t to = from; to <= 19; to++)
+            {
+                SignalMeasurement a, b;
+                stream.measure(from, to, a);
+                source.measure(from, to, b);
+                all_same = all_same && memcmp(&a, &b, sizeof(a)) == 0;
+            }
+        }
+        TEST(all_same);
+    }
+    
+    {
+        COMMENT("Test measuring over lost data");
+        signal_buffer_t buffer = {
+            5, 0, 0, {0x12, 0x00, 0xAC, 0x02, 0x34}
+        };
+        DSOSignalStream stream(&buffer);
+        SignalMeasurement result;
+        
+        stream.measure(0, 304, result);
+        TEST(result.lost && result.measured_time == 4 &&
+             result.channel[1].high_time == 1 && result.channel[2].edges == 0 &&
+             result.duty_cycle(2) == 750);
+    }
+    
     return status;
 }
@@ -0,0 +1,172 @@
+/* Fixed-size memory pool for the Events returned by EventStream::read().
+ *
+ * Every read() allocates an event and the caller deletes it soon after,
+ * which would churn the small heap. Event has its own operator new and
+ * delete that take the memory from here instead: a static array of
+ * equal-sized blocks with a free list, so allocating and freeing take
+ * constant time and can't fragment the heap. Events larger than a block,
+ * or allocated when the pool is full, fall back to the heap.
+ *
+ * Optionally the pool can be used as an arena for the duration of a
+ * frame: between begin_frame() and end_frame(), events are allocated from
+ * the top of the used blocks. Deleting the latest one gives its block
+ * back right away, so a read()-delete loop needs only one block. Other
+ * events deleted in the frame are released all at once by end_frame().
+ * Events allocated in a frame must not be used after it. If some are
+ * still allocated at end_frame(), their blocks are not reused and the
+ * events are counted in leaked().
+ *
+ * The state is plain data in a function-local static, so it works
+ * without global constructors.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+
+class EventPool
+{
+public:
+    // The largest event in the decoders is I2cTransaction, 48 bytes.
+    static const size_t block_size = 48;
+
+    // On the device, the events are read only by AnnotationGraph, one at
+    // a time. The decoders below it pass their events by value, so a few
+    // blocks are enough.
+    static const size_t block_count = 8;
+
+    static void *allocate(size_t size)
+    {
+        state_t &s = state();
+        block_t *block = NULL;
+
+        if (size <= block_size)
+        {
+            if (s.free_list && !s.in_frame)
+            {
+                block = s.free_list;
+                s.free_list = block->next;
+            }
+            else if (s.unused < block_count)
+            {
+                block = &s.blocks[s.unused++];
+            }
+            else if (s.free_list)
+            {
+                block = s.free_list;
+                s.free_list = block->next;
+            }
+        }
+
+        if (!block)
+        {
+            s.fallbacks++;
+            return ::operator new(size);
+        }
+
+        s.in_use++;
+        if (s.in_frame && block >= s.blocks + s.frame_mark)
+            s.frame_in_use++;
+
+        return block;
+    }
+
+    static void release(void *p)
+    {
+        state_t &s = state();
+        block_t *block = static_cast<block_t*>(p);
+
+        if (block < s.blocks || block >= s.blocks + block_count)
+        {
+            ::operator delete(p);
+            return;
+        }
+
+        s.in_use--;
+
+        if (s.in_frame && block >= s.blocks + s.frame_mark)
+        {
+            s.frame_in_use--;
+            if (block == &s.blocks[s.unused - 1])
+                s.unused--; // The latest block can be reused at once
+
+            return; // Others are released by end_frame()
+        }
+
+        block->next = s.free_list;
+        s.free_list = block;
+    }
+
+    static void begin_frame()
+    {
+        state_t &s = state();
+        if (s.in_use == 0)
+        {
+            // Start from an empty pool, so that the frame has all of it.
+            s.unused = 0;
+            s.free_list = NULL;
+        }
+
+        s.in_frame = true;
+        s.frame_mark = s.unused;
+        s.frame_in_use = 0;
+    }
+
+    static void end_frame()
+    {
+        state_t &s = state();
+        s.in_frame = false;
+
+        if (s.frame_in_use == 0)
+        {
+            s.unused = s.frame_mark;
+        }
+        else
+        {
+            // The blocks of the events that are still allocated can't be
+            // given out again. Leave the frame's blocks allocated, the
+            // pool is emptied again once all events have been deleted.
+            s.leaked += s.frame_in_use;
+        }
+    }
+
+    // Number of events currently allocated from the pool
+    static size_t in_use() { return state().in_use; }
+
+    // Number of allocations that had to use the heap
+    static uint32_t fallbacks() { return state().fallbacks; }
+
+    // Number of events that were still allocated at the end of their frame
+    static uint32_t leaked() { return state().leaked; }
+
+private:
+    union block_t
+    {
+        block_t *next; // When free
+        uint64_t align;
+        uint8_t data[block_size];
+    };
+
+    // Blocks below 'unused' have been allocated at some point and are
+    // either in use or in the free list. Blocks allocated in a frame are
+    // all at or above frame_mark.
+    struct state_t
+    {
+        block_t blocks[block_count];
+        block_t *free_list;
+        size_t unused;
+        size_t in_use;
+        uint32_t fallbacks;
+        uint32_t leaked;
+        bool in_frame;
+        size_t frame_mark;
+        size_t frame_in_use; // Blocks at or above frame_mark
+    };
+
+    static state_t &state()
+    {
+        static state_t s;
+        return s;
+    }
+};
@@ -0,0 +1,152 @@
+#include "eventpool.hh"
+#include "signalstream.hh"
+#include "testsignalstream.hh"
+#include "unittests.h"
+#include <vector>
+
+struct LargeEvent: public Event
+{
+    uint8_t data[EventPool::block_size];
+};
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test allocating and freeing");
+        Event *a = new SignalEvent;
+        Event *b = new SignalEvent;
+        TEST(EventPool::in_use() == 2 && a != b);
+
+        delete a;
+        Event *c = new SignalEvent;
+        TEST(c == a && EventPool::in_use() == 2);
+
+        delete b;
+        delete c;
+        TEST(EventPool::in_use() == 0 && EventPool::fallbacks() == 0);
+
+        COMMENT("Test events that don't fit in the pool");
+        Event *large = new LargeEvent;
+        TEST(EventPool::in_use() == 0 && EventPool::fallbacks() == 1);
+        delete large;
+
+        std::vector<Event*> events;
+        for (size_t i = 0; i < EventPool::block_count + 5; i++)
+            events.push_back(new SignalEvent);
+        TEST(EventPool::in_use() == EventPool::block_count);
+        TEST(EventPool::fallbacks() == 6);
+
+        for (Event *event: events)
+            delete event;
+        TEST(EventPool::in_use() == 0);
+    }
+
+    {
+        COMMENT("Test that reading a stream doesn't use the heap");
+        TestSignalStream stream("-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_", "", "", "");
+        uint32_t fallbacks = EventPool::fallbacks();
+        int count = 0;
+        for (;;)
+        {
+            std::unique_ptr<Event> event(stream.read());
+            if (!event)
+                break;
+            count++;
+        }
+        TEST(count == 48);
+        TEST(EventPool::in_use() == 0 && EventPool::fallbacks() == fallbacks);
+    }
+
+    {
+        COMMENT("Test frames");
+        EventPool::begin_frame();
+        Event *a = new SignalEvent;
+        Event *b = new SignalEvent;
+        delete a;
+        Event *c = new SignalEvent;
+        TEST(c != a && c != b); // Not reused within the frame
+        delete c;
+        Event *d = new SignalEvent;
+        TEST(d == c); // Except the latest one
+        delete d;
+        delete b;
+        TEST(EventPool::in_use() == 0);
+        EventPool::end_frame();
+
+        Event *outside = new SignalEvent;
+        TEST(outside == a); // Released by end_frame()
+
+        EventPool::begin_frame();
+        Event *e = new SignalEvent;
+        delete outside; // Allocated before the frame, freed normally
+        Event *f = new SignalEvent;
+        TEST(e != outside && f != outside && e != f);
+        delete e;
+        delete f;
+        EventPool::end_frame();
+
+        Event *g = new SignalEvent;
+        Event *h = new SignalEvent;
+        TEST(g == outside && h == e);
+        delete g;
+        delete h;
+        TEST(EventPool::in_use() == 0 && EventPool::leaked() == 0);
+    }
+
+    {
+        COMMENT("Test reading a stream in frames");
+        TestSignalStream stream("-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_-_", "", "", "");
+        uint32_t fallbacks = EventPool::fallbacks();
+        EventPool::begin_frame();
+        int count = 0;
+        for (;;)
+        {
+            std::unique_ptr<Event> event(stream.read());
+            if (!event)
+                break;
+            count++;
+        }
+        EventPool::end_frame();
+        TEST(count == 48);
+        TEST(EventPool::in_use() == 0 && EventPool::fallbacks() == fallbacks);
+    }
+
+    {
+        COMMENT("Test an event that is not deleted in its frame");
+        EventPool::begin_frame();
+        Event *kept = new SignalEvent;
+        Event *a = new SignalEvent;
+        delete a;
+        EventPool::end_frame();
+        TEST(EventPool::in_use() == 1 && EventPool::leaked() == 1);
+
+        // The block of the kept event must not be given out again.
+        std::vector<Event*> events;
+        for (size_t i = 0; i < EventPool::block_count; i++)
+            events.push_back(new SignalEvent);
+        bool all_ok = true;
+        for (Event *event: events)
+            all_ok = all_ok && event != kept;
+        TEST(all_ok);
+
+        for (Event *event: events)
+            delete event;
+        delete kept;
+        TEST(EventPool::in_use() == 0);
+
+        // Once everything has been deleted, frames use the whole pool again.
+        uint32_t fallbacks = EventPool::fallbacks();
+        EventPool::begin_frame();
+        events.clear();
+        for (size_t i = 0; i < EventPool::block_count; i++)
+            events.push_back(new SignalEvent);
+        for (Event *event: events)
+            delete event;
+        EventPool::end_frame();
+        TEST(EventPool::fallbacks() == fallbacks && EventPool::leaked() == 1);
+    }
+
+    return status;
+}
@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <cstring>
 #include <memory>
+#include "eventpool.hh"
 
 typedef int64_t signaltime_t;
 
@@ -18,6 +19,10 @@ struct Event
     {
         *buf = 0;
     }
+    
+    // Events returned by EventStream::read() come from the EventPool.
+    static void *operator new(size_t size) { return EventPool::allocate(size); }
+    static void operator delete(void *p) { EventPool::release(p); }
 };
 
 class EventStream
@@ -33,10 +38,46 @@ public:
     // Read the next event from the stream.
     // Returns NULL when there are no more events.
     // Caller is responsible for freeing the memory; use unique_ptr.
+    // The memory comes from the EventPool, so this is cheap.
     virtual Event* read() = 0;
     
     // Make a deep clone of this object, ie. it should make new copies
     // of all non-const objects.
     virtual EventStream* clone() const = 0;
+    
+    // Forget any cached events, or the ones that end after the given time,
+    // when the data behind the stream has changed. Streams without a cache
+    // have nothing to do.
+    virtual void invalidate() {}
+    virtual void invalidate_after(signaltime_t time) {}
 };
 
+
+// EventStream with a known event type. Decoders that are stacked on top of
+// each other use read_forwards() to read the events of the layer below
+// straight into their own storage, without allocating. Reading is pulled
+// by the top layer, so each layer decodes only as far as needed.
+template <typename T>
+class TypedEventStream: public EventStream
+{
+public:
+    // Read the next event. Returns false when there are no more events.
+    virtual bool read_forwards(T &result) = 0;
+    
+    virtual T* read()
+    {
+        T *result = new T;
+        
+        if (read_forwards(*result))
+        {
+            return result;
+        }
+        else
+        {
+            delete result;
+            return NULL;
+        }
+    }
+    
+    virtual TypedEventStream* clone() const = 0;
+};
@@ -0,0 +1,219 @@
+#include "projectedsignalstream.hh"
+
+ProjectedSignalStream::ProjectedSignalStream(const SignalStream &source,
+                                             signals_t mask, size_t index_size):
+    source(source.clone()), mask(mask | SIGNALS_LOST),
+    lookahead(), have_lookahead(false), previous_levels(0),
+    index(index_size ? new index_entry_t[index_size] : NULL),
+    index_size(index_size), index_count(0),
+    index_generation(source.get_generation())
+{
+}
+
+ProjectedSignalStream::ProjectedSignalStream(const ProjectedSignalStream &other):
+    SignalStream(), source(other.source->clone()), mask(other.mask),
+    lookahead(other.lookahead), have_lookahead(other.have_lookahead),
+    previous_levels(other.previous_levels),
+    index(other.index_size ? new index_entry_t[other.index_size] : NULL),
+    index_size(other.index_size), index_count(other.index_count),
+    index_generation(other.index_generation)
+{
+    for (size_t i = 0; i < index_count; i++)
+        index[i] = other.index[i];
+}
+
+ProjectedSignalStream::~ProjectedSignalStream()
+{
+    delete[] index;
+}
+
+void ProjectedSignalStream::seek(signaltime_t time)
+{
+    SignalEvent event;
+    have_lookahead = false;
+
+    const index_entry_t *entry = find_in_index(time);
+    if (entry)
+    {
+        // The source has an edge at entry->start, so this gets to the
+        // first event of the merged event.
+        source->seek(entry->start);
+        previous_levels = entry->old_levels;
+        return;
+    }
+
+    // Find the event containing time and go backwards to where the
+    // levels of the selected channels changed.
+    source->seek(time);
+    if (!source->read_forwards(event))
+    {
+        // Past the end, continue from the last event
+        if (!source->read_backwards(event))
+        {
+            previous_levels = 0;
+            return;
+        }
+    }
+
+    signals_t levels = event.levels & mask;
+    source->read_backwards(event);
+
+    previous_levels = 0;
+    while (source->read_backwards(event))
+    {
+        if ((event.levels & mask) != levels)
+        {
+            previous_levels = event.levels & mask;
+            source->read_forwards(event);
+            break;
+        }
+    }
+}
+
+bool ProjectedSignalStream::read_forwards(SignalEvent &result)
+{
+    if (!have_lookahead && !source->read_forwards(lookahead))
+        return false;
+
+    result.start = lookahead.start;
+    result.end = lookahead.end;
+    result.levels = lookahead.levels & mask;
+    result.old_levels = previous_levels;
+
+    uint32_t events = 1;
+    while ((have_lookahead = source->read_forwards(lookahead)) &&
+           (lookahead.levels & mask) == result.levels)
+    {
+        result.end = lookahead.end;
+        events++;
+    }
+
+    previous_levels = result.levels;
+
+    if (events >= index_threshold)
+        add_to_index(result, events);
+
+    return true;
+}
+
+bool ProjectedSignalStream::read_backwards(SignalEvent &result)
+{
+    SignalEvent event;
+
+    if (have_lookahead)
+    {
+        source->read_backwards(event);
+        have_lookahead = false;
+    }
+
+    if (!source->read_backwards(event))
+        return false;
+
+    result.start = event.start;
+    result.end = event.end;
+    result.levels = event.levels & mask;
+    result.old_levels = 0;
+
+    while (source->read_backwards(event))
+    {
+        if ((event.levels & mask) != result.levels)
+        {
+            result.old_levels = event.levels & mask;
+            source->read_forwards(event);
+            break;
+        }
+
+        result.start = event.start;
+    }
+
+    previous_levels = result.old_levels;
+    return true;
+}
+
+ProjectedSignalStream* ProjectedSignalStream::clone() const
+{
+    return new ProjectedSignalStream(*this);
+}
+
+// The index is sorted by the start time. When it is full, the entry with
+// the fewest source events is replaced.
+void ProjectedSignalStream::add_to_index(const SignalEvent &event, uint32_t events)
+{
+    if (source->get_generation() != index_generation)
+    {
+        index_count = 0;
+        index_generation = source->get_generation();
+    }
+
+    size_t pos = 0;
+    while (pos < index_count && index[pos].start < event.start)
+        pos++;
+
+    if (pos < index_count && index[pos].start == event.start)
+    {
+        // Already known, but the last event may have grown
+        if (event.end > index[pos].end)
+        {
+            index[pos].end = event.end;
+            index[pos].events = events;
+        }
+        return;
+    }
+
+    if (index_count == index_size)
+    {
+        if (index_size == 0)
+            return;
+
+        size_t smallest = 0;
+        for (size_t i = 1; i < index_count; i++)
+        {
+            if (index[i].events < index[smallest].events)
+                smallest = i;
+        }
+
+        if (index[smallest].events >= events)
+            return;
+
+        for (size_t i = smallest; i + 1 < index_count; i++)
+            index[i] = index[i + 1];
+        index_count--;
+
+        if (smallest < pos)
+            pos--;
+    }
+
+    for (size_t i = index_count; i > pos; i--)
+        index[i] = index[i - 1];
+
+    index[pos].start = event.start;
+    index[pos].end = event.end;
+    index[pos].events = events;
+    index[pos].old_levels = event.old_levels;
+    index_count++;
+}
+
+const ProjectedSignalStream::index_entry_t *ProjectedSignalStream::find_in_index(signaltime_t time)
+{
+    if (source->get_generation() != index_generation)
+    {
+        index_count = 0;
+        index_generation = source->get_generation();
+        return NULL;
+    }
+
+    size_t low = 0, high = index_count;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (index[mid].start <= time)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low > 0 && time < index[low - 1].end)
+        return &index[low - 1];
+
+    return NULL;
+}
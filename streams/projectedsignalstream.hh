@@ -0,0 +1,64 @@
+/* SignalStream adapter that shows only some of the channels of another
+ * stream. Consecutive events where the selected channels keep their levels
+ * are merged into one, so e.g. a graph of a slow signal doesn't have to
+ * handle every edge of a fast clock on another channel.
+ *
+ * The levels of the events are masked to the selected channels, and
+ * SIGNALS_LOST is kept. Finding the start of a long merged event in seek()
+ * would require reading backwards through all the events in it, so the
+ * longest events are remembered in a small index. The index is cleared if
+ * the data behind the source changes, see SignalStream::get_generation().
+ */
+
+#pragma once
+
+#include "signalstream.hh"
+
+class ProjectedSignalStream: public SignalStream
+{
+public:
+    // Index_size is the number of merged events to remember, 0 for none.
+    ProjectedSignalStream(const SignalStream &source, signals_t mask,
+                          size_t index_size = 0);
+    ProjectedSignalStream(const ProjectedSignalStream &other);
+    virtual ~ProjectedSignalStream();
+
+    virtual void seek(signaltime_t time);
+    virtual bool read_forwards(SignalEvent &result);
+    virtual bool read_backwards(SignalEvent &result);
+    virtual uint32_t get_generation() const { return source->get_generation(); }
+    virtual frequency_t get_frequency() const { return source->get_frequency(); }
+    virtual ProjectedSignalStream* clone() const;
+
+    // Minimum number of source events in a merged event for it to be
+    // added to the index.
+    static const uint32_t index_threshold = 16;
+
+private:
+    struct index_entry_t
+    {
+        signaltime_t start;
+        signaltime_t end; // Up to the end of the data, if it was reached
+        uint32_t events; // Number of source events merged
+        signals_t old_levels;
+    };
+
+    std::unique_ptr<SignalStream> source;
+    signals_t mask; // Includes SIGNALS_LOST
+
+    // The source is either positioned at the start of the next event,
+    // or after the lookahead event, which is the first event in it.
+    SignalEvent lookahead;
+    bool have_lookahead;
+    signals_t previous_levels; // Levels of the event before the read position
+
+    index_entry_t *index;
+    size_t index_size;
+    size_t index_count;
+    uint32_t index_generation;
+
+    void add_to_index(const SignalEvent &event, uint32_t events);
+    const index_entry_t *find_in_index(signaltime_t time);
+
+    ProjectedSignalStream &operator=(const ProjectedSignalStream &other);
+};
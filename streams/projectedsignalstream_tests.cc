@@ -0,0 +1,173 @@
+#include "projectedsignalstream.hh"
+#include "dsosignalstream.hh"
+#include "selectedsignalstream.hh"
+#include "testsignalstream.hh"
+#include "varint.hh"
+#include "unittests.h"
+
+// Counts the events read from the source stream
+class CountingStream: public SignalStream
+{
+public:
+    CountingStream(SignalStream *stream, int *count): stream(stream), count(count) {}
+    
+    virtual void seek(signaltime_t time) { stream->seek(time); }
+    
+    virtual bool read_forwards(SignalEvent &result)
+    {
+        (*count)++;
+        return stream->read_forwards(result);
+    }
+    
+    virtual bool read_backwards(SignalEvent &result)
+    {
+        (*count)++;
+        return stream->read_backwards(result);
+    }
+    
+    virtual frequency_t get_frequency() const { return stream->get_frequency(); }
+    
+    virtual CountingStream* clone() const
+    {
+        return new CountingStream(stream->clone(), count);
+    }
+    
+private:
+    SignalStream *stream; // Leaks the clones, but this is only a test
+    int *count;
+};
+
+// Fast clock on channel A, slow signal on channel B
+static void fill_buffer(signal_buffer_t &buffer, int clocks_per_bit, int bits)
+{
+    buffer.bytes = 0;
+    for (int bit = 0; bit < bits; bit++)
+    {
+        signals_t b = (bit % 3 == 0) ? 2 : 0;
+        for (int i = 0; i < clocks_per_bit * 2; i++)
+        {
+            uint64_t value = (5 << 4) | b | (i & 1);
+            buffer.bytes += varint_encode(buffer.storage + buffer.bytes, value);
+        }
+    }
+    buffer.last_duration = 0;
+    buffer.last_value = 0;
+}
+
+int main()
+{
+    int status = 0;
+    
+    {
+        COMMENT("Test merging the events");
+        TestSignalStream source("-_-_-_-_-_-_-_-_-",
+                                "___----------____",
+                                "", "");
+        ProjectedSignalStream stream(source, 2);
+        SignalEvent event;
+        
+        TEST(stream.read_forwards(event) && event.start == 0 && event.end == 3 &&
+             event.levels == 0 && event.old_levels == 0);
+        TEST(stream.read_forwards(event) && event.start == 3 && event.end == 13 &&
+             event.levels == 2 && event.old_levels == 0);
+        TEST(stream.read_forwards(event) && event.start == 13 && event.end == 17 &&
+             event.levels == 0 && event.old_levels == 2);
+        TEST(!stream.read_forwards(event));
+        
+        COMMENT("Test reading backwards");
+        TEST(stream.read_backwards(event) && event.start == 13 && event.end == 17);
+        TEST(stream.read_backwards(event) && event.start == 3 && event.end == 13 &&
+             event.old_levels == 0);
+        TEST(stream.read_forwards(event) && event.start == 3 && event.end == 13);
+        TEST(stream.read_backwards(event) && event.start == 3 && event.end == 13);
+        TEST(stream.read_backwards(event) && event.start == 0 && event.end == 3);
+        TEST(!stream.read_backwards(event));
+        
+        COMMENT("Test seeking into the middle of an event");
+        stream.seek(8);
+        TEST(stream.read_forwards(event) && event.start == 3 && event.end == 13 &&
+             event.old_levels == 0);
+        TEST(stream.read_forwards(event) && event.start == 13 && event.old_levels == 2);
+    }
+    
+    {
+        COMMENT("Test lost data");
+        signal_buffer_t buffer = {
+            6, 0, 0, {0x13, 0x12, 0x00, 0xAC, 0x02, 0x35}
+        };
+        DSOSignalStream source(&buffer);
+        ProjectedSignalStream stream(source, 1);
+        SignalEvent event;
+        
+        TEST(stream.read_forwards(event) && event.start == 0 && event.end == 1 &&
+             event.levels == 1);
+        TEST(stream.read_forwards(event) && event.start == 1 && event.end == 2 &&
+             event.levels == 0);
+        TEST(stream.read_forwards(event) && event.start == 2 && event.end == 302 &&
+             event.levels == SIGNALS_LOST && event.old_levels == 0);
+        TEST(stream.read_forwards(event) && event.start == 302 && event.end == 305 &&
+             event.levels == 1 && event.old_levels == SIGNALS_LOST);
+    }
+    
+    {
+        COMMENT("Test the index");
+        signal_buffer_t buffer = {};
+        fill_buffer(buffer, 200, 20);
+        DSOSignalStream dso(&buffer);
+        int count = 0;
+        CountingStream source(&dso, &count);
+        ProjectedSignalStream indexed(source, 2, 16);
+        ProjectedSignalStream plain(source, 2);
+        ProjectedSignalStream small(source, 2, 4);
+        SignalEvent event1, event2, event3;
+        
+        // Read through once to fill the index
+        int events = 0;
+        while (indexed.read_forwards(event1))
+            events++;
+        TEST(events == 14);
+        
+        bool same = true;
+        int indexed_count = 0, plain_count = 0;
+        for (signaltime_t time = 0; time < 40000; time += 1234)
+        {
+            count = 0;
+            indexed.seek(time);
+            indexed_count += count;
+            same = same && indexed.read_forwards(event1);
+            
+            count = 0;
+            plain.seek(time);
+            plain_count += count;
+            same = same && plain.read_forwards(event2);
+            
+            small.seek(time);
+            same = same && small.read_forwards(event3) &&
+                   event3.start == event2.start && event3.end == event2.end;
+            
+            same = same && event1.start == event2.start && event1.end == event2.end &&
+                   event1.levels == event2.levels && event1.old_levels == event2.old_levels &&
+                   event1.start <= time && event1.end > time;
+        }
+        TEST(same);
+        TEST(indexed_count == 0 && plain_count > 1000);
+        printf("Source events read in seeks: %d with index, %d without\n",
+               indexed_count, plain_count);
+        
+        COMMENT("Test that changing the source clears the index");
+        StreamSelector selector(&dso);
+        SelectedSignalStream selected(&selector);
+        ProjectedSignalStream stream(selected, 2, 8);
+        while (stream.read_forwards(event1));
+        
+        signal_buffer_t buffer2 = {};
+        fill_buffer(buffer2, 100, 20);
+        DSOSignalStream dso2(&buffer2);
+        selector.select(&dso2);
+        
+        stream.seek(2000);
+        TEST(stream.read_forwards(event1) && event1.start == 1000 && event1.end == 3000);
+    }
+    
+    return status;
+}
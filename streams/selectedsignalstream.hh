@@ -0,0 +1,108 @@
+/* SignalStream that forwards to whichever stream is currently selected in
+ * a StreamSelector. The GUI objects keep their own clones of the stream,
+ * so this allows switching all of them to a different data source at once,
+ * e.g. from the live capture to a file loaded from disc.
+ */
+
+#pragma once
+
+#include "signalstream.hh"
+
+class StreamSelector
+{
+public:
+    StreamSelector(const SignalStream *stream): current(stream), generation(0) {}
+
+    // The stream must remain valid until another one is selected.
+    void select(const SignalStream *stream)
+    {
+        current = stream;
+        generation++;
+    }
+
+    const SignalStream *get() const { return current; }
+    uint32_t get_generation() const { return generation; }
+
+private:
+    const SignalStream *current;
+    uint32_t generation;
+};
+
+class SelectedSignalStream: public SignalStream
+{
+public:
+    SelectedSignalStream(const StreamSelector *selector):
+        selector(selector), generation(0)
+    {
+    }
+
+    SelectedSignalStream(const SelectedSignalStream &other):
+        SignalStream(), selector(other.selector), generation(0)
+    {
+    }
+
+    virtual void seek(signaltime_t time)
+    {
+        update()->seek(time);
+    }
+
+    virtual bool read_forwards(SignalEvent &result)
+    {
+        return update()->read_forwards(result);
+    }
+
+    virtual bool read_backwards(SignalEvent &result)
+    {
+        return update()->read_backwards(result);
+    }
+
+    virtual bool find_forwards(signaltime_t from, const SignalSearch &search,
+                               SignalEvent &result)
+    {
+        return update()->find_forwards(from, search, result);
+    }
+
+    virtual bool find_backwards(signaltime_t from, const SignalSearch &search,
+                                SignalEvent &result)
+    {
+        return update()->find_backwards(from, search, result);
+    }
+
+    virtual void measure(signaltime_t from, signaltime_t to,
+                         SignalMeasurement &result)
+    {
+        update()->measure(from, to, result);
+    }
+
+    virtual uint32_t get_generation() const
+    {
+        return selector->get_generation();
+    }
+
+    virtual frequency_t get_frequency() const
+    {
+        return selector->get()->get_frequency();
+    }
+
+    virtual SelectedSignalStream* clone() const
+    {
+        return new SelectedSignalStream(*this);
+    }
+
+private:
+    const StreamSelector *selector;
+    std::unique_ptr<SignalStream> stream;
+    uint32_t generation;
+
+    // Make a new clone of the source if the selection has changed.
+    SignalStream *update()
+    {
+        if (!stream || generation != selector->get_generation())
+        {
+            stream.reset(selector->get()->clone());
+            generation = selector->get_generation();
+        }
+
+        return stream.get();
+    }
+};
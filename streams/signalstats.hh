@@ -0,0 +1,135 @@
+/* Statistics of each channel over the whole capture: the number of
+ * transitions, the time spent high, the shortest pulse and the longest
+ * time without transitions.
+ *
+ * capture_update_stats() feeds the newly stored events to these from the
+ * main loop, so the capture interrupt doesn't spend any time on them and
+ * the statistics can be queried without decoding the whole buffer. The
+ * work per event is constant. The statistics cover everything since the
+ * reset, including data removed from the buffer with capture_discard().
+ *
+ * There are no constructors, so that the class can be part of the
+ * statically allocated signal_buffer_t.
+ */
+
+#pragma once
+
+#include "signalstream.hh"
+
+class SignalStats
+{
+public:
+    static const int channels = 4;
+
+    // Clear the statistics for a new capture starting at time 0.
+    void reset()
+    {
+        memset(this, 0, sizeof(*this));
+    }
+
+    // The signals change to the given levels at the given time. If no
+    // time has passed since the previous change, the previous levels are
+    // just replaced, e.g. for the first sample of a capture.
+    void add_edge(signaltime_t time, signals_t levels)
+    {
+        signaltime_t length = time - current_start;
+        if (length == 0)
+        {
+            current_levels = levels;
+            return;
+        }
+
+        signals_t changed = levels ^ current_levels;
+        for (int i = 0; i < channels; i++)
+        {
+            if ((current_levels >> i) & 1)
+                high_time[i] += length;
+
+            if (!((changed >> i) & 1))
+                continue;
+
+            transitions[i]++;
+
+            signaltime_t idle = time - idle_start[i];
+            if (idle > longest_idle[i])
+                longest_idle[i] = idle;
+
+            // The first edge only ends the idle time before it
+            if (((have_edge >> i) & 1) &&
+                (shortest_pulse[i] == 0 || idle < shortest_pulse[i]))
+            {
+                shortest_pulse[i] = idle;
+            }
+
+            idle_start[i] = time;
+        }
+
+        have_edge |= changed;
+        current_start = time;
+        current_levels = levels;
+    }
+
+    // Samples were lost from the given time. Pulses are not measured over
+    // the lost period. The levels after it are given by the add_edge() at
+    // time + length, which doesn't count as a transition.
+    void add_lost(signaltime_t time, signaltime_t length)
+    {
+        add_edge(time, current_levels);
+
+        for (int i = 0; i < channels; i++)
+        {
+            signaltime_t idle = time - idle_start[i];
+            if (idle > longest_idle[i])
+                longest_idle[i] = idle;
+
+            idle_start[i] = time + length;
+        }
+
+        have_edge = 0;
+        lost_time += length;
+        current_start = time + length;
+    }
+
+    // Record the total length of the capture so far.
+    void set_end(signaltime_t time) { end = time; }
+
+    signaltime_t get_end() const { return end; }
+    signaltime_t get_lost_time() const { return lost_time; }
+
+    uint32_t get_transitions(int channel) const { return transitions[channel]; }
+
+    signaltime_t get_high_time(int channel) const
+    {
+        bool high = (current_levels >> channel) & 1;
+        return high_time[channel] + (high ? end - current_start : 0);
+    }
+
+    // Shortest time between two transitions, or 0 if there haven't been
+    // two transitions yet.
+    signaltime_t get_shortest_pulse(int channel) const
+    {
+        return shortest_pulse[channel];
+    }
+
+    // Longest time without transitions, including the time from the
+    // start of the capture to the first one and from the last one to
+    // the end.
+    signaltime_t get_longest_idle(int channel) const
+    {
+        signaltime_t idle = end - idle_start[channel];
+        return (idle > longest_idle[channel]) ? idle : longest_idle[channel];
+    }
+
+private:
+    signaltime_t end;
+    signaltime_t lost_time;
+    signaltime_t current_start; // Time of the latest change of the levels
+    signals_t current_levels;
+    signals_t have_edge; // Channels that have had a transition since a loss
+
+    uint32_t transitions[channels];
+    signaltime_t high_time[channels]; // Not including the current levels
+    signaltime_t shortest_pulse[channels];
+    signaltime_t longest_idle[channels]; // Not including the current idle
+    signaltime_t idle_start[channels]; // Latest transition or lost data
+};
@@ -14,6 +14,11 @@ typedef uint16_t signals_t;
 
 typedef uint32_t frequency_t;
 
+// Flag in the levels of an event covering a period where the samples were
+// lost, e.g. because the capture interrupt fell behind. The channel bits
+// of such an event are zero and should not be interpreted.
+const signals_t SIGNALS_LOST = 0x8000;
+
 struct SignalEvent: public Event
 {
     // Values before the transition. Same as the .levels in previous event,
@@ -37,6 +42,336 @@ struct SignalEvent: public Event
     }
 };
 
+// Conditions for SignalStream::find_forwards() and find_backwards().
+// Only the channels in mask are looked at, so consecutive events where just
+// the other channels change form a single period. A period matches if the
+// masked levels equal value (or any_value is set) and the length is within
+// min_length to max_length. Periods of lost data never match.
+// The levels of the channels in sample are returned too, as they were at
+// the start of the found period, but changes in them don't split periods.
+struct SignalSearch
+{
+    static const signaltime_t no_limit = 0x7FFFFFFFFFFFFFFFLL;
+    
+    signals_t mask;
+    signals_t value;
+    bool any_value;
+    signaltime_t min_length;
+    signaltime_t max_length;
+    signals_t sample; // Default: 0
+    
+    // Any edge on the channels in mask
+    static SignalSearch edge(signals_t mask)
+    {
+        SignalSearch search = {mask, 0, true, 0, no_limit};
+        return search;
+    }
+    
+    // The channels in mask change to the given levels
+    static SignalSearch pattern(signals_t mask, signals_t value)
+    {
+        SignalSearch search = {mask, 0, false, 0, no_limit};
+        search.value = value & mask;
+        return search;
+    }
+    
+    // The channels in mask stay at the given levels for a time between
+    // min_length and max_length ticks.
+    static SignalSearch pulse(signals_t mask, signals_t value,
+                              signaltime_t min_length,
+                              signaltime_t max_length = no_limit)
+    {
+        SignalSearch search = {mask, 0, false, min_length, max_length};
+        search.value = value & mask;
+        return search;
+    }
+    
+    bool matches(signals_t levels, signaltime_t length) const
+    {
+        return !(levels & SIGNALS_LOST) && (any_value || levels == value) &&
+               length >= min_length && length <= max_length;
+    }
+};
+
+// The search algorithms, shared by all streams. The cursor has the methods
+//   bool next(signaltime_t &start, signaltime_t &end, signals_t &levels);
+//   bool prev(signaltime_t &start, signaltime_t &end, signals_t &levels);
+// that work like read_forwards() and read_backwards(). It must initially be
+// positioned so that next() returns the event containing 'from', like after
+// seek(from). The found period is returned in result, with the masked
+// levels and the sampled channels. The start of the data counts as an edge
+// only when searching backwards.
+template <typename Cursor>
+bool signal_search_forwards(Cursor &cursor, signaltime_t from,
+                            const SignalSearch &search, SignalEvent &result)
+{
+    const signals_t mask = search.mask | SIGNALS_LOST;
+    signaltime_t start, end;
+    signals_t levels;
+    
+    if (!cursor.next(start, end, levels))
+        return false;
+    
+    signals_t key = levels & mask;
+    signals_t old_key = 0;
+    signals_t period_levels = levels;
+    signaltime_t period_start = start;
+    signaltime_t period_end = end;
+    
+    for (;;)
+    {
+        bool more = cursor.next(start, end, levels);
+        if (more && (levels & mask) == key)
+        {
+            period_end = end;
+            continue;
+        }
+        
+        if (period_start > from && search.matches(key, period_end - period_start))
+        {
+            result.start = period_start;
+            result.end = period_end;
+            result.old_levels = old_key;
+            result.levels = key | (period_levels & search.sample);
+            return true;
+        }
+        
+        if (!more)
+            return false;
+        
+        old_key = key;
+        key = levels & mask;
+        period_levels = levels;
+        period_start = start;
+        period_end = end;
+    }
+}
+
+template <typename Cursor>
+bool signal_search_backwards(Cursor &cursor, signaltime_t from,
+                             const SignalSearch &search, SignalEvent &result)
+{
+    const signals_t mask = search.mask | SIGNALS_LOST;
+    signaltime_t start, end;
+    signals_t levels;
+    signals_t key = 0;
+    signals_t period_levels = 0;
+    signaltime_t period_start = 0, period_end = 0;
+    bool have_period = false;
+    
+    // The period containing 'from' may continue after it, so read ahead to
+    // find where it ends, and then return to the start of it.
+    size_t count = 0;
+    while (cursor.next(start, end, levels))
+    {
+        count++;
+        
+        if (end <= from)
+        {
+            count = 0; // 'from' is past the end of the data
+            continue;
+        }
+        
+        if (!have_period)
+        {
+            have_period = true;
+            key = levels & mask;
+            period_levels = levels;
+            period_start = start;
+        }
+        else if ((levels & mask) != key)
+        {
+            break;
+        }
+        
+        period_end = end;
+    }
+    
+    while (count--)
+        cursor.prev(start, end, levels);
+    
+    while (cursor.prev(start, end, levels))
+    {
+        if (have_period && (levels & mask) == key)
+        {
+            period_levels = levels;
+            period_start = start;
+            continue;
+        }
+        
+        if (have_period && period_start < from &&
+            search.matches(key, period_end - period_start))
+        {
+            result.start = period_start;
+            result.end = period_end;
+            result.old_levels = levels & mask;
+            result.levels = key | (period_levels & search.sample);
+            return true;
+        }
+        
+        have_period = true;
+        key = levels & mask;
+        period_levels = levels;
+        period_start = start;
+        period_end = end;
+    }
+    
+    if (have_period && period_start < from &&
+        search.matches(key, period_end - period_start))
+    {
+        result.start = period_start;
+        result.end = period_end;
+        result.old_levels = 0;
+        result.levels = key | (period_levels & search.sample);
+        return true;
+    }
+    
+    return false;
+}
+
+// Statistics of one channel over a range of time, see SignalMeasurement.
+struct ChannelMeasurement
+{
+    static const int histogram_bins = 16;
+    
+    uint32_t edges; // Rising and falling edges
+    uint32_t periods; // Number of rising edge to rising edge periods
+    signaltime_t period_min;
+    signaltime_t period_max;
+    signaltime_t period_sum;
+    signaltime_t high_time; // Total time the channel was high
+    
+    // Number of complete high and low pulses of each width. Bin i counts
+    // the widths 2^i <= w < 2^(i+1) ticks, and the last bin also all the
+    // longer ones. Saturated at 65535.
+    uint16_t histogram[histogram_bins];
+    
+    signaltime_t period_mean() const
+    {
+        return periods ? period_sum / periods : 0;
+    }
+    
+    void add_period(signaltime_t period)
+    {
+        if (periods == 0 || period < period_min)
+            period_min = period;
+        if (periods == 0 || period > period_max)
+            period_max = period;
+        
+        period_sum += period;
+        periods++;
+    }
+    
+    void add_pulse(signaltime_t width)
+    {
+        int bin = 0;
+        while (width >= 2 && bin < histogram_bins - 1)
+        {
+            width >>= 1;
+            bin++;
+        }
+        
+        if (histogram[bin] != 0xFFFF)
+            histogram[bin]++;
+    }
+};
+
+// Result of SignalStream::measure(). Edges are counted only inside the
+// range, and the periods and pulses only if they are completely inside
+// it. Periods of lost data are left out of all the statistics, and no
+// period or pulse continues over them.
+struct SignalMeasurement
+{
+    static const int channels = 4;
+    
+    signaltime_t start; // The range measured
+    signaltime_t end;
+    signaltime_t data_end; // End of the data if before end, otherwise end
+    signaltime_t measured_time; // Length of the range, excluding lost data
+    bool lost; // Part of the range was lost data
+    ChannelMeasurement channel[channels];
+    
+    // Fraction of time the channel was high, in 1/1000ths
+    int duty_cycle(int index) const
+    {
+        if (measured_time == 0)
+            return 0;
+        
+        return channel[index].high_time * 1000 / measured_time;
+    }
+};
+
+// The measurement algorithm, shared by all streams. The cursor is like in
+// signal_search_forwards(), positioned so that next() returns the event
+// containing 'from'. Goes through the events in a single pass.
+template <typename Cursor>
+void signal_measure(Cursor &cursor, signaltime_t from, signaltime_t to,
+                    SignalMeasurement &result)
+{
+    const int channels = SignalMeasurement::channels;
+    memset(&result, 0, sizeof(result));
+    result.start = from;
+    result.end = to;
+    result.data_end = from;
+    
+    // Start of the latest pulse and period, or -1 if not known yet
+    signaltime_t pulse_start[channels], period_start[channels];
+    for (int i = 0; i < channels; i++)
+        pulse_start[i] = period_start[i] = -1;
+    
+    signaltime_t start, end;
+    signals_t levels, old_levels = 0;
+    bool have_old = false;
+    while (cursor.next(start, end, levels) && start < to)
+    {
+        if (end <= from)
+            continue;
+        
+        result.data_end = (end < to) ? end : to;
+        signaltime_t length = result.data_end - ((start > from) ? start : from);
+        
+        if (levels & SIGNALS_LOST)
+        {
+            result.lost = true;
+            have_old = false;
+            for (int i = 0; i < channels; i++)
+                pulse_start[i] = period_start[i] = -1;
+            continue;
+        }
+        
+        result.measured_time += length;
+        
+        signals_t changed = have_old ? (levels ^ old_levels) : 0;
+        for (int i = 0; i < channels; i++)
+        {
+            ChannelMeasurement &channel = result.channel[i];
+            bool high = (levels >> i) & 1;
+            
+            if (high)
+                channel.high_time += length;
+            
+            if (!((changed >> i) & 1))
+                continue;
+            
+            channel.edges++;
+            
+            if (pulse_start[i] >= 0)
+                channel.add_pulse(start - pulse_start[i]);
+            pulse_start[i] = start;
+            
+            if (high)
+            {
+                if (period_start[i] >= 0)
+                    channel.add_period(start - period_start[i]);
+                period_start[i] = start;
+            }
+        }
+        
+        old_levels = levels;
+        have_old = true;
+    }
+}
+
 class SignalStream: public EventStream {
 public:
     virtual ~SignalStream() {};
@@ -71,8 +406,70 @@ public:
     // event.
     virtual bool read_backwards(SignalEvent &result) = 0;
     
+    // Find the first period matching the search that begins after 'from'.
+    // Returns false if there is none. The read position is undefined
+    // afterwards, so seek() before reading.
+    virtual bool find_forwards(signaltime_t from, const SignalSearch &search,
+                               SignalEvent &result)
+    {
+        seek(from);
+        StreamCursor cursor(this);
+        return signal_search_forwards(cursor, from, search, result);
+    }
+    
+    // Find the last period matching the search that begins before 'from'.
+    virtual bool find_backwards(signaltime_t from, const SignalSearch &search,
+                                SignalEvent &result)
+    {
+        seek(from);
+        StreamCursor cursor(this);
+        return signal_search_backwards(cursor, from, search, result);
+    }
+    
+    // Measure the channels over the range from <= t < to, see
+    // SignalMeasurement. The read position is undefined afterwards.
+    virtual void measure(signaltime_t from, signaltime_t to,
+                         SignalMeasurement &result)
+    {
+        seek(from);
+        StreamCursor cursor(this);
+        signal_measure(cursor, from, to, result);
+    }
+    
+    // Changes when the data behind the stream is replaced, e.g. another
+    // capture is selected, so that any cached times become invalid.
+    virtual uint32_t get_generation() const { return 0; }
+    
     // Get the tick frequency (ticks per second) of the stream
-//     virtual frequency_t get_frequency() const;
+    virtual frequency_t get_frequency() const = 0;
     
     virtual SignalStream* clone() const = 0;
+    
+private:
+    // Search cursor for streams that don't have a faster one
+    struct StreamCursor
+    {
+        StreamCursor(SignalStream *stream): stream(stream) {}
+        
+        SignalStream *stream;
+        SignalEvent event;
+        
+        bool next(signaltime_t &start, signaltime_t &end, signals_t &levels)
+        {
+            return get(stream->read_forwards(event), start, end, levels);
+        }
+        
+        bool prev(signaltime_t &start, signaltime_t &end, signals_t &levels)
+        {
+            return get(stream->read_backwards(event), start, end, levels);
+        }
+        
+        bool get(bool ok, signaltime_t &start, signaltime_t &end, signals_t &levels)
+        {
+            start = event.start;
+            end = event.end;
+            levels = event.levels;
+            return ok;
+        }
+    };
 };
@@ -24,6 +24,7 @@ public:
         this->signal3 = signal3;
         this->signal4 = signal4;
         this->time = 0;
+        this->frequency = 500000;
         
         length1 = strlen(signal1);
         length2 = strlen(signal2);
@@ -78,11 +79,18 @@ public:
         return true;
     }
     
+    virtual frequency_t get_frequency() const
+    {
+        return frequency;
+    }
+    
     virtual TestSignalStream* clone() const
     {
         return new TestSignalStream(*this);
     }
     
+    frequency_t frequency; // Default: 500000
+    
 private:
     const char *signal1;
     size_t length1;
@@ -0,0 +1,108 @@
+/* Base-128 varint encoding used for the signal storage, see
+ * dsosignalstream.hh for the description of the format.
+ *
+ * The decoding functions are templates over the storage, so that they work
+ * both with plain memory and with anything that provides operator[] for
+ * reading bytes, e.g. a sector cache. Pos is the type of the offsets.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "signalstream.hh"
+
+// Maximum length of a single varint
+const int VARINT_MAX_BYTES = 10;
+
+// Encode value to p. Returns the number of bytes written.
+static inline int varint_encode(uint8_t *p, uint64_t value)
+{
+    int i = 0;
+    do {
+        p[i] = (value & 0x7F) | 0x80;
+        value >>= 7;
+        i++;
+    } while (value);
+    p[i - 1] &= 0x7F; // Unset top bit on last byte
+    return i;
+}
+
+// Decode the varint starting at pos. Returns the position after it.
+template <typename Storage, typename Pos>
+Pos varint_decode_forwards(const Storage &storage, Pos pos, uint64_t &value)
+{
+    uint8_t bitpos = 0;
+    uint8_t byte;
+    
+    value = 0;
+    do {
+        byte = storage[pos];
+        value |= (uint64_t)(byte & 0x7F) << bitpos;
+        pos++;
+        bitpos += 7;
+    } while (byte & 0x80);
+    
+    return pos;
+}
+
+// Decode the varint that ends right before pos. Returns its first position.
+template <typename Storage, typename Pos>
+Pos varint_decode_backwards(const Storage &storage, Pos pos, uint64_t &value)
+{
+    value = 0;
+    do {
+        pos--;
+        value <<= 7;
+        value |= (uint64_t)(storage[pos] & 0x7F);
+    } while (pos != 0 && storage[pos - 1] & 0x80);
+    
+    return pos;
+}
+
+// Read the event or lost data marker starting at pos.
+// Returns the position after it.
+template <typename Storage, typename Pos>
+Pos varint_read_record(const Storage &storage, Pos pos,
+                       signaltime_t &duration, signals_t &levels)
+{
+    uint64_t value;
+    pos = varint_decode_forwards(storage, pos, value);
+    
+    if (value == 0)
+    {
+        pos = varint_decode_forwards(storage, pos, value);
+        duration = value;
+        levels = SIGNALS_LOST;
+    }
+    else
+    {
+        duration = value >> 4;
+        levels = value & 0x0F;
+    }
+    
+    return pos;
+}
+
+// Read the event or lost data marker that ends right before pos.
+// Returns its first position.
+template <typename Storage, typename Pos>
+Pos varint_read_record_backwards(const Storage &storage, Pos pos,
+                                 signaltime_t &duration, signals_t &levels)
+{
+    uint64_t value;
+    pos = varint_decode_backwards(storage, pos, value);
+    
+    // A single zero byte can only be a marker, as the encoder never
+    // writes 0-length events or lost periods.
+    if (pos > 0 && storage[pos - 1] == 0 &&
+        (pos == 1 || !(storage[pos - 2] & 0x80)))
+    {
+        duration = value;
+        levels = SIGNALS_LOST;
+        return pos - 1;
+    }
+    
+    duration = value >> 4;
+    levels = value & 0x0F;
+    return pos;
+}
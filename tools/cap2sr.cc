@@ -0,0 +1,60 @@
+/* Converts a capture file to a sigrok session file for PulseView.
+ *
+ * Usage: cap2sr input.cap output.sr
+ */
+
+#include <stdio.h>
+#include "mappedcapture.hh"
+#include "sigrokwriter.hh"
+
+static bool write_sector(const uint8_t *sector, void *context)
+{
+    return fwrite(sector, SectorWriter::sector_size, 1, (FILE*)context) == 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s input.cap output.sr\n", argv[0]);
+        return 1;
+    }
+
+    MappedCaptureFile file;
+    if (!file.open(argv[1]))
+    {
+        fprintf(stderr, "%s: not a valid capture file\n", argv[1]);
+        return 1;
+    }
+
+    const capture_header_t &header = file.get_header();
+    char names[CAPTUREFILE_CHANNELS][CAPTUREFILE_NAME_LENGTH + 1] = {};
+    const char *name_pointers[CAPTUREFILE_CHANNELS];
+    for (int i = 0; i < CAPTUREFILE_CHANNELS; i++)
+    {
+        memcpy(names[i], header.channel_names[i], CAPTUREFILE_NAME_LENGTH);
+        name_pointers[i] = names[i];
+    }
+
+    FILE *output = fopen(argv[2], "wb");
+    if (!output)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    uint8_t buffer[SectorWriter::sector_size];
+    SectorWriter writer(buffer, write_sector, output);
+    SigrokWriter sigrok(&writer);
+    MappedCaptureStream stream(&file, header);
+    bool ok = sigrok.write_stream(stream, header.frequency, name_pointers);
+    ok = (fclose(output) == 0) && ok;
+
+    if (!ok)
+    {
+        fprintf(stderr, "%s: write failed\n", argv[2]);
+        return 1;
+    }
+
+    return 0;
+}
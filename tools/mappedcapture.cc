@@ -0,0 +1,63 @@
+#include "mappedcapture.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedCaptureFile::MappedCaptureFile():
+    data(NULL), length(0), header()
+{
+}
+
+MappedCaptureFile::~MappedCaptureFile()
+{
+    close();
+}
+
+bool MappedCaptureFile::open(const char *path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(header))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    data = (const uint8_t*)p;
+    length = st.st_size;
+
+    // The stream doesn't check the offsets, so make sure that everything
+    // the header refers to is inside the file.
+    if (!capturefile_read_header(data, header) ||
+        header.data_offset + header.data_bytes > length ||
+        header.index_offset > length ||
+        header.index_count > (length - header.index_offset) / sizeof(capture_checkpoint_t))
+    {
+        close();
+        return false;
+    }
+
+    madvise(p, length, MADV_RANDOM);
+    return true;
+}
+
+void MappedCaptureFile::close()
+{
+    if (data)
+        munmap((void*)data, length);
+
+    data = NULL;
+    length = 0;
+}
@@ -0,0 +1,54 @@
+/* Read-only memory mapping of a capture file on the PC, for use with
+ * CaptureFileStream. The operating system pages in the parts of the file
+ * that are actually read, so captures much larger than the RAM can be
+ * browsed and seeked efficiently. All offsets are 64-bit.
+ *
+ * Example:
+ *     MappedCaptureFile file;
+ *     if (file.open("LOGIC000.CAP"))
+ *     {
+ *         CaptureFileStream<MappedCaptureFile> stream(&file, file.get_header());
+ *         ...
+ *     }
+ */
+
+#pragma once
+
+#include "capturestream.hh"
+
+class MappedCaptureFile
+{
+public:
+    MappedCaptureFile();
+    ~MappedCaptureFile();
+
+    // Map the file and check the header. Returns false if the file
+    // can't be opened or is not a valid capture file.
+    bool open(const char *path);
+    void close();
+
+    const capture_header_t &get_header() const { return header; }
+    uint64_t size() const { return length; }
+
+    // Source interface for CaptureFileStream
+    uint8_t operator[](uint64_t offset) const { return data[offset]; }
+
+    void read(uint64_t offset, void *dest, size_t count) const
+    {
+        memcpy(dest, data + offset, count);
+    }
+
+    // The mapping can't fail after open()
+    bool ok() const { return true; }
+
+private:
+    // Not copyable
+    MappedCaptureFile(const MappedCaptureFile&);
+    MappedCaptureFile &operator=(const MappedCaptureFile&);
+
+    const uint8_t *data;
+    uint64_t length;
+    capture_header_t header;
+};
+
+typedef CaptureFileStream<MappedCaptureFile> MappedCaptureStream;
@@ -0,0 +1,138 @@
+#include "mappedcapture.hh"
+#include "unittests.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string>
+
+static bool store_sector(const uint8_t *sector, void *context)
+{
+    std::string *output = (std::string*)context;
+    output->append((const char*)sector, SectorWriter::sector_size);
+    return true;
+}
+
+static bool same_event(const SignalEvent &a, const SignalEvent &b)
+{
+    return a.start == b.start && a.end == b.end && a.levels == b.levels;
+}
+
+// Write data to a new temporary file at given offset, return the name.
+static std::string write_temp(const std::string &data, uint64_t offset = 0)
+{
+    char name[] = "/tmp/mappedcapture_XXXXXX";
+    int fd = mkstemp(name);
+    if (pwrite(fd, data.data(), data.size(), offset) != (ssize_t)data.size())
+        printf("Failed to write %s\n", name);
+    close(fd);
+    return name;
+}
+
+static signal_buffer_t buffer;
+
+int main()
+{
+    int status = 0;
+
+    for (int i = 0; i < 5000; i++)
+    {
+        signaltime_t duration = (i % 50) * 37 + 1;
+        buffer.bytes += varint_encode(buffer.storage + buffer.bytes,
+                                      (duration << 4) | (i % 16));
+    }
+    buffer.last_duration = 10;
+    buffer.last_value = 3;
+
+    std::string file;
+    uint8_t sector[SectorWriter::sector_size];
+    SectorWriter output(sector, store_sector, &file);
+    capture_info_t info = {500000, 0, {"A", "B", "C", "D"}, 256};
+    capturefile_write(&output, &buffer, info);
+
+    {
+        COMMENT("Test reading a mapped file");
+        std::string name = write_temp(file);
+        MappedCaptureFile mapped;
+        TEST(mapped.open(name.c_str()));
+        TEST(mapped.size() == file.size());
+        TEST(mapped.get_header().frequency == 500000);
+
+        MappedCaptureStream stream(&mapped, mapped.get_header());
+        TEST(stream.get_frequency() == 500000);
+        DSOSignalStream reference(&buffer);
+        SignalEvent a, b;
+        bool all_same = true;
+        while (reference.read_forwards(b))
+        {
+            if (!stream.read_forwards(a) || !same_event(a, b))
+                all_same = false;
+        }
+        TEST(all_same);
+        TEST(!stream.read_forwards(a));
+
+        all_same = true;
+        for (signaltime_t time = 0; time < b.end; time += 7919)
+        {
+            stream.seek(time);
+            reference.seek(time);
+            if (!stream.read_forwards(a) || !reference.read_forwards(b) ||
+                !same_event(a, b))
+                all_same = false;
+        }
+        TEST(all_same);
+
+        unlink(name.c_str());
+    }
+
+    {
+        COMMENT("Test invalid files");
+        MappedCaptureFile mapped;
+        TEST(!mapped.open("/nonexistent/file.cap"));
+
+        std::string name = write_temp(file.substr(0, 1024));
+        TEST(!mapped.open(name.c_str()));
+        unlink(name.c_str());
+
+        std::string broken = file;
+        broken[0] = 'X';
+        name = write_temp(broken);
+        TEST(!mapped.open(name.c_str()));
+        unlink(name.c_str());
+    }
+
+    {
+        COMMENT("Test data beyond 4 GB");
+        // Move the data and index to a sparse area after 5 GB
+        capture_header_t header;
+        capturefile_read_header((const uint8_t*)file.data(), header);
+        const uint64_t base = 5ULL << 30;
+        std::string contents = file.substr(header.data_offset);
+        header.index_offset = header.index_offset - header.data_offset + base;
+        header.data_offset = base;
+
+        std::string name = write_temp(std::string((const char*)&header, sizeof(header)));
+        int fd = ::open(name.c_str(), O_WRONLY);
+        bool written = pwrite(fd, contents.data(), contents.size(), base) == (ssize_t)contents.size();
+        ::close(fd);
+
+        MappedCaptureFile mapped;
+        if (written && mapped.open(name.c_str()))
+        {
+            MappedCaptureStream stream(&mapped, mapped.get_header());
+            DSOSignalStream reference(&buffer);
+            SignalEvent a, b;
+            stream.seek(header.total_time / 2);
+            reference.seek(header.total_time / 2);
+            TEST(stream.read_backwards(a) && reference.read_backwards(b) && same_event(a, b));
+            TEST(stream.read_forwards(a) && reference.read_forwards(b) && same_event(a, b));
+            TEST(mapped.size() > base);
+        }
+        else
+        {
+            printf("Skipped, sparse files not supported\n");
+        }
+        unlink(name.c_str());
+    }
+
+    return status;
+}
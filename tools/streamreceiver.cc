@@ -0,0 +1,226 @@
+#include "streamreceiver.hh"
+#include "crc32.hh"
+#include "varint.hh"
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+static uint64_t read_le(const uint8_t *p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+StreamReceiver::StreamReceiver():
+    frames_received(0), frames_lost(0), crc_errors(0), bytes_skipped(0),
+    is_started(false), is_finished(false), have_sequence(false),
+    next_sequence(0), frequency(0), time(0), last_duration(0), last_value(0)
+{
+}
+
+void StreamReceiver::receive(const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+        receive_byte(data[i]);
+}
+
+void StreamReceiver::receive_byte(uint8_t byte)
+{
+    if (frame.size() == 0 && byte != STREAMFRAME_SYNC1)
+    {
+        bytes_skipped++;
+        return;
+    }
+
+    frame.push_back(byte);
+
+    if (frame.size() == 2 && byte != STREAMFRAME_SYNC2)
+    {
+        resync();
+        return;
+    }
+
+    if (frame.size() == 4 && frame[3] > STREAMFRAME_MAX_PAYLOAD)
+    {
+        resync();
+        return;
+    }
+
+    size_t size = STREAMFRAME_HEADER_SIZE + STREAMFRAME_CRC_SIZE;
+    if (frame.size() < 4 || frame.size() < size + frame[3])
+        return;
+
+    size_t crc_pos = frame.size() - STREAMFRAME_CRC_SIZE;
+    uint32_t crc = crc32_update(0, &frame[2], crc_pos - 2);
+    if (crc != read_le(&frame[crc_pos], 4))
+    {
+        crc_errors++;
+        resync();
+        return;
+    }
+
+    process_frame();
+    frame.clear();
+}
+
+// The bytes in the frame buffer were not a valid frame, so look for the
+// next sync in them.
+void StreamReceiver::resync()
+{
+    std::vector<uint8_t> rest(frame.begin() + 1, frame.end());
+    frame.clear();
+    bytes_skipped++;
+    receive(rest.data(), rest.size());
+}
+
+void StreamReceiver::write_varint(uint64_t value)
+{
+    uint8_t bytes[VARINT_MAX_BYTES];
+    int count = varint_encode(bytes, value);
+    storage.insert(storage.end(), bytes, bytes + count);
+}
+
+void StreamReceiver::fill_gap(signaltime_t start_time)
+{
+    if (start_time > time)
+    {
+        write_varint(0);
+        write_varint(start_time - time);
+        time = start_time;
+    }
+}
+
+void StreamReceiver::process_frame()
+{
+    frames_received++;
+
+    uint8_t type = frame[2];
+    size_t length = frame[3];
+    uint16_t sequence = read_le(&frame[4], 2);
+    const uint8_t *payload = &frame[STREAMFRAME_HEADER_SIZE];
+
+    if (have_sequence && sequence != next_sequence && type != STREAMFRAME_START)
+        frames_lost += (uint16_t)(sequence - next_sequence);
+    have_sequence = true;
+    next_sequence = sequence + 1;
+
+    if (type == STREAMFRAME_START && length >= 4)
+    {
+        frequency = read_le(payload, 4);
+        storage.clear();
+        time = 0;
+        last_duration = 0;
+        last_value = 0;
+        is_started = true;
+        is_finished = false;
+    }
+    else if (type == STREAMFRAME_DATA && length >= 8 && is_started && !is_finished)
+    {
+        signaltime_t start_time = read_le(payload, 8);
+        if (start_time < time)
+            return; // Repeated frame
+
+        fill_gap(start_time);
+
+        size_t start = storage.size();
+        storage.insert(storage.end(), payload + 8, payload + length);
+
+        size_t pos = start;
+        while (pos < storage.size())
+        {
+            signaltime_t duration;
+            signals_t levels;
+            pos = varint_read_record(storage, pos, duration, levels);
+            time += duration;
+        }
+    }
+    else if (type == STREAMFRAME_END && length >= 18 && is_started)
+    {
+        fill_gap(read_le(payload, 8));
+        last_duration = read_le(payload + 8, 8);
+        last_value = read_le(payload + 16, 2);
+        is_finished = true;
+    }
+}
+
+bool StreamReceiver::receive_from(int fd, int timeout_ms)
+{
+    uint8_t buffer[4096];
+    struct pollfd pfd = {fd, POLLIN, 0};
+
+    while (!is_finished)
+    {
+        if (poll(&pfd, 1, timeout_ms) <= 0)
+            return false;
+
+        ssize_t count = read(fd, buffer, sizeof(buffer));
+        if (count <= 0)
+            return false;
+
+        receive(buffer, count);
+    }
+
+    return true;
+}
+
+static bool write_sector(const uint8_t *sector, void *context)
+{
+    return fwrite(sector, SectorWriter::sector_size, 1, (FILE*)context) == 1;
+}
+
+bool StreamReceiver::save(FILE *file) const
+{
+    capture_info_t info = {};
+    info.frequency = frequency;
+    info.channel_names[0] = "A";
+    info.channel_names[1] = "B";
+    info.channel_names[2] = "C";
+    info.channel_names[3] = "D";
+
+    uint8_t buffer[SectorWriter::sector_size];
+    SectorWriter writer(buffer, write_sector, file);
+    return capturefile_write_data(&writer, storage.data(), storage.size(),
+                                  last_duration, last_value, info);
+}
+
+int serial_open(const char *path, int baudrate)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        return -1;
+
+    speed_t speed;
+    switch (baudrate)
+    {
+        case 115200: speed = B115200; break;
+        case 230400: speed = B230400; break;
+        case 460800: speed = B460800; break;
+        case 921600: speed = B921600; break;
+        default: close(fd); return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+
+    if (tcsetattr(fd, TCSANOW, &tio) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
@@ -0,0 +1,70 @@
+/* Receiver for the live capture stream sent by CaptureStreamer, see
+ * streamframe.hh for the protocol.
+ *
+ * Reassembles the DATA frames into one continuous varint buffer, which
+ * can then be saved as a capture file. Bytes that are not part of a valid
+ * frame are skipped. Missing frames are replaced with lost data markers
+ * of the correct length, so the times of the later events stay correct.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include "capturefile.hh"
+#include "streamframe.hh"
+
+class StreamReceiver
+{
+public:
+    StreamReceiver();
+
+    // Process received bytes, in chunks of any size.
+    void receive(const uint8_t *data, size_t length);
+
+    // Read from a file descriptor until the END frame is received, or no
+    // data arrives within timeout_ms. Returns true if the stream finished.
+    bool receive_from(int fd, int timeout_ms);
+
+    bool started() const { return is_started; }
+    bool finished() const { return is_finished; }
+    frequency_t get_frequency() const { return frequency; }
+
+    // The received data, in the same format as signal_buffer_t
+    const std::vector<uint8_t> &get_storage() const { return storage; }
+    signaltime_t get_last_duration() const { return last_duration; }
+    signals_t get_last_value() const { return last_value; }
+
+    // Time at the end of the storage
+    signaltime_t get_time() const { return time; }
+
+    // Write the received data as a capture file.
+    bool save(FILE *file) const;
+
+    // Statistics
+    uint32_t frames_received;
+    uint32_t frames_lost; // Found from the sequence numbers
+    uint32_t crc_errors;
+    uint32_t bytes_skipped; // Bytes outside frames
+
+private:
+    std::vector<uint8_t> frame; // Frame being received
+    std::vector<uint8_t> storage;
+    bool is_started;
+    bool is_finished;
+    bool have_sequence;
+    uint16_t next_sequence;
+    frequency_t frequency;
+    signaltime_t time;
+    signaltime_t last_duration;
+    signals_t last_value;
+
+    void receive_byte(uint8_t byte);
+    void resync();
+    void process_frame();
+    void fill_gap(signaltime_t start_time);
+    void write_varint(uint64_t value);
+};
+
+// Open a serial port in raw mode. Returns the file descriptor or -1.
+int serial_open(const char *path, int baudrate);
@@ -0,0 +1,215 @@
+#include "streamreceiver.hh"
+#include "capturestreamer.hh"
+#include "mappedcapture.hh"
+#include "varint.hh"
+#include "unittests.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string>
+
+static signal_buffer_t buffer;
+
+// All the data written to the buffer, including the discarded parts
+static std::vector<uint8_t> written;
+static signaltime_t written_time;
+
+static void append_varint(uint64_t value)
+{
+    uint8_t bytes[VARINT_MAX_BYTES];
+    int count = varint_encode(bytes, value);
+    memcpy(buffer.storage + buffer.bytes, bytes, count);
+    written.insert(written.end(), bytes, bytes + count);
+    buffer.bytes += count;
+}
+
+// Add events that look like a slow UART, with the given number of edges.
+static void append_events(int edges)
+{
+    for (int i = 0; i < edges; i++)
+    {
+        signaltime_t duration = (i & 7) ? 5 : 100000 + i;
+        append_varint((duration << 4) | (i & 1));
+        written_time += duration;
+    }
+}
+
+static void reset_buffer()
+{
+    buffer.bytes = 0;
+    buffer.last_duration = 7;
+    buffer.last_value = 1;
+    written.clear();
+    written_time = 0;
+}
+
+// Move all the queued bytes to the output
+static void transmit(CaptureStreamer &streamer, std::string &output)
+{
+    uint8_t byte;
+    while (streamer.poll() || !streamer.idle())
+    {
+        while (streamer.get_byte(byte))
+            output += (char)byte;
+    }
+}
+
+static void receive(StreamReceiver &receiver, const std::string &data)
+{
+    receiver.receive((const uint8_t*)data.data(), data.size());
+}
+
+int main()
+{
+    int status = 0;
+
+    {
+        COMMENT("Test streaming while the capture continues");
+        reset_buffer();
+        CaptureStreamer streamer(&buffer);
+        StreamReceiver receiver;
+        std::string output;
+
+        streamer.start(500000);
+        for (int i = 0; i < 20; i++)
+        {
+            append_events(37);
+            transmit(streamer, output);
+        }
+        TEST(streamer.finish());
+        transmit(streamer, output);
+
+        // Data arrives in pieces of any size
+        for (size_t pos = 0; pos < output.size(); pos += 7)
+            receive(receiver, output.substr(pos, 7));
+
+        TEST(receiver.started() && receiver.finished());
+        TEST(receiver.get_frequency() == 500000);
+        TEST(receiver.get_storage() == written);
+        TEST(receiver.get_time() == written_time);
+        TEST(receiver.get_last_duration() == 7);
+        TEST(receiver.get_last_value() == 1);
+        TEST(receiver.frames_lost == 0 && receiver.crc_errors == 0);
+        TEST(receiver.bytes_skipped == 0);
+    }
+
+    {
+        COMMENT("Test capture longer than the buffer");
+        reset_buffer();
+        CaptureStreamer streamer(&buffer);
+        StreamReceiver receiver;
+        std::string output;
+
+        streamer.start(500000);
+        size_t total = 0;
+        while (total < 10 * sizeof(buffer.storage))
+        {
+            append_events(1000);
+            total += 1000;
+            transmit(streamer, output);
+
+            // Same as the main loop does once the buffer is half full
+            size_t sent = streamer.bytes_queued();
+            memmove(buffer.storage, buffer.storage + sent, buffer.bytes - sent);
+            buffer.bytes -= sent;
+            streamer.discard(sent);
+        }
+        TEST(streamer.finish());
+        transmit(streamer, output);
+        receive(receiver, output);
+
+        TEST(written.size() > 2 * sizeof(buffer.storage));
+        TEST(receiver.get_storage() == written);
+        TEST(receiver.get_time() == written_time);
+    }
+
+    {
+        COMMENT("Test debug messages and a corrupted frame");
+        reset_buffer();
+        CaptureStreamer streamer(&buffer);
+        StreamReceiver receiver;
+        std::string output;
+
+        streamer.start(1000);
+        transmit(streamer, output);
+        output += "Debug message \xA5 with a sync byte\n";
+
+        append_events(30);
+        transmit(streamer, output);
+
+        // These events fit in one frame, which gets corrupted
+        size_t corrupt = output.size() + 20;
+        signaltime_t lost_start = written_time;
+        append_events(40);
+        signaltime_t lost_time = written_time - lost_start;
+        transmit(streamer, output);
+        append_events(30);
+        TEST(streamer.finish());
+        transmit(streamer, output);
+
+        output[corrupt] ^= 0x10;
+        receive(receiver, output);
+
+        TEST(receiver.finished());
+        TEST(receiver.crc_errors == 1);
+        TEST(receiver.frames_lost == 1);
+        TEST(receiver.bytes_skipped > 30);
+        TEST(receiver.get_time() == written_time);
+
+        // The lost frame is replaced with a marker of the same length
+        SignalEvent event;
+        signaltime_t lost = 0;
+        signal_buffer_t received = {};
+        memcpy(received.storage, receiver.get_storage().data(), receiver.get_storage().size());
+        received.bytes = receiver.get_storage().size();
+        DSOSignalStream stream(&received);
+        stream.seek(0);
+        while (stream.read_forwards(event))
+        {
+            if (event.levels == SIGNALS_LOST)
+                lost += event.end - event.start;
+        }
+        TEST(lost == lost_time);
+    }
+
+    {
+        COMMENT("Test receiving through a pseudo-terminal");
+        reset_buffer();
+        CaptureStreamer streamer(&buffer);
+        std::string output;
+        streamer.start(500000);
+        append_events(500);
+        TEST(streamer.finish());
+        transmit(streamer, output);
+
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        TEST(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+        int fd = serial_open(ptsname(master), 115200);
+        TEST(fd >= 0);
+
+        TEST(write(master, output.data(), output.size()) == (ssize_t)output.size());
+        StreamReceiver receiver;
+        TEST(receiver.receive_from(fd, 1000));
+        TEST(receiver.get_storage() == written);
+
+        COMMENT("Test saving the received capture");
+        char name[] = "/tmp/streamreceiver_XXXXXX";
+        int tmp = mkstemp(name);
+        close(tmp);
+        FILE *file = fopen(name, "wb");
+        TEST(receiver.save(file));
+        fclose(file);
+
+        MappedCaptureFile capture;
+        TEST(capture.open(name));
+        TEST(capture.get_header().data_bytes == written.size() + 1); // Last event
+        TEST((signaltime_t)capture.get_header().total_time == written_time + 7);
+        capture.close();
+        unlink(name);
+
+        close(fd);
+        close(master);
+    }
+
+    return status;
+}
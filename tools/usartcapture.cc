@@ -0,0 +1,67 @@
+/* Receives a live capture streamed from the device over the serial port
+ * and saves it as a capture file. Stop the stream from the device menu,
+ * or press Ctrl-C to save what has been received so far.
+ *
+ * Usage: usartcapture /dev/ttyUSB0 output.cap [baudrate]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include "streamreceiver.hh"
+
+static volatile bool interrupted = false;
+
+static void handle_sigint(int)
+{
+    interrupted = true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s /dev/ttyUSB0 output.cap [baudrate]\n", argv[0]);
+        return 1;
+    }
+
+    int baudrate = (argc > 3) ? atoi(argv[3]) : 115200;
+    int fd = serial_open(argv[1], baudrate);
+    if (fd < 0)
+    {
+        fprintf(stderr, "%s: can't open at %d bps\n", argv[1], baudrate);
+        return 1;
+    }
+
+    signal(SIGINT, handle_sigint);
+
+    StreamReceiver receiver;
+    while (!interrupted && !receiver.finished())
+    {
+        receiver.receive_from(fd, 1000);
+        fprintf(stderr, "\r%lu frames, %lu lost, %lu bytes, %.1f s   ",
+                (unsigned long)receiver.frames_received,
+                (unsigned long)receiver.frames_lost,
+                (unsigned long)receiver.get_storage().size(),
+                receiver.get_frequency() ?
+                    (double)receiver.get_time() / receiver.get_frequency() : 0.0);
+    }
+    fprintf(stderr, "\n");
+    close(fd);
+
+    if (!receiver.started())
+    {
+        fprintf(stderr, "No stream received\n");
+        return 1;
+    }
+
+    FILE *output = fopen(argv[2], "wb");
+    if (!output || !receiver.save(output) || fclose(output) != 0)
+    {
+        fprintf(stderr, "%s: write failed\n", argv[2]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* Converts a VCD file to the capture file format, so that recordings from
+ * other logic analyzers and simulators can be viewed on the device.
+ *
+ * Usage: vcd2cap input.vcd output.cap [frequency] [channel names...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "vcdreader.hh"
+#include "capturefile.hh"
+
+static bool write_sector(const uint8_t *sector, void *context)
+{
+    return fwrite(sector, SectorWriter::sector_size, 1, (FILE*)context) == 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s input.vcd output.cap [frequency] [channels...]\n", argv[0]);
+        return 1;
+    }
+
+    VcdReader reader;
+    if (argc > 3)
+        reader.set_frequency(strtoul(argv[3], NULL, 10));
+
+    for (int i = 4; i < argc && i - 4 < VcdReader::channels; i++)
+        reader.set_channel(i - 4, argv[i]);
+
+    FILE *input = fopen(argv[1], "r");
+    if (!input)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    bool ok = reader.parse_file(input);
+    fclose(input);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: %s\n", argv[1], reader.get_error());
+        return 1;
+    }
+
+    FILE *output = fopen(argv[2], "wb");
+    if (!output)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    capture_info_t info = {};
+    info.frequency = reader.get_frequency();
+    for (int i = 0; i < CAPTUREFILE_CHANNELS; i++)
+        info.channel_names[i] = reader.get_channel_name(i);
+
+    uint8_t buffer[SectorWriter::sector_size];
+    SectorWriter writer(buffer, write_sector, output);
+    const std::vector<uint8_t> &storage = reader.get_storage();
+    ok = capturefile_write_data(&writer, storage.data(), storage.size(),
+                                reader.get_last_duration(),
+                                reader.get_last_value(), info);
+    ok = (fclose(output) == 0) && ok;
+
+    if (!ok)
+    {
+        fprintf(stderr, "%s: write failed\n", argv[2]);
+        return 1;
+    }
+
+    printf("%s: %lu bytes of events, %lld ticks at %lu Hz\n", argv[2],
+           (unsigned long)storage.size(), (long long)reader.get_end_time(),
+           (unsigned long)reader.get_frequency());
+    return 0;
+}